@@ -101,9 +101,12 @@ void Transform_setup(Transform *tr)
 	tr->transform_function(tr, TRUE);
 }
 
-void Transform_update_output(Transform *tr)
+bool Transform_update_output(Transform *tr)
 {
+	tr->updated = true;
 	tr->transform_function(tr, FALSE);
+
+	return tr->updated;
 }
 
 TrList* TrList_new(void)
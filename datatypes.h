@@ -15,6 +15,9 @@
 
 #include <iio.h>
 
+#include "latency.h"
+#include "window.h"
+
 #define FORCE_UPDATE TRUE
 #define NORMAL_UPDATE FALSE
 
@@ -35,16 +38,57 @@ enum {
 	CONSTELLATION_TRANSFORM,
 	COMPLEX_FFT_TRANSFORM,
 	CROSS_CORRELATION_TRANSFORM,
+	WATERFALL_TRANSFORM,
 	TRANSFORMS_TYPES_COUNT
 };
 
 typedef struct _transform Transform;
 typedef struct _tr_list TrList;
 
+/* Number of frames each acquisition thread can juggle: one being filled,
+ * one published as the latest, and one held by the UI thread. */
+#define CAPTURE_FRAME_SLOTS 3
+
+/* Default share of a triggered frame, in percent, before the trigger point */
+#define TRIGGER_PRETRIGGER_DEFAULT 50
+
+struct segbuf;
+struct fft_plan;
+
+struct capture_frame {
+	struct segbuf **channels_data;
+	unsigned int sample_count;
+	guint seq;
+	gint readers;
+};
+
+/* Reasons for (re)creating the RX buffer of a device */
+enum rx_buffer_event {
+	RX_BUFFER_CREATE,
+	RX_BUFFER_GROW,
+	RX_BUFFER_SHRINK,
+	RX_BUFFER_CHANNELS,
+	RX_BUFFER_KERNEL_COUNT,
+	RX_BUFFER_ONESHOT,
+	RX_BUFFER_EVENTS_COUNT
+};
+
+/* Timed stages of the acquisition threads */
+enum capture_stage {
+	CAPTURE_STAGE_REFILL,
+	CAPTURE_STAGE_DEMUX,
+	CAPTURE_STAGE_TRIGGER,
+	CAPTURE_STAGES_COUNT
+};
+
 struct extra_info {
 	struct iio_device *dev;
 	gfloat *data_ref;
-	off_t offset;
+	struct segbuf *data_buf;
+	guint data_ref_seq;
+	/* Serializes the conversion of data_ref between transforms */
+	GMutex data_ref_lock;
+	const struct segbuf *shown_ref;
 	int shadow_of_enabled;
 	bool may_be_enabled;
 	double lo_freq;
@@ -55,15 +99,38 @@ struct extra_dev_info {
 	struct iio_buffer *buffer;
 	unsigned int sample_count;
 	unsigned int buffer_size;
+	unsigned int buffer_kernel_count;
+	unsigned int buffer_oversized;
+	bool *buffer_mask;
+	unsigned int buffer_events[RX_BUFFER_EVENTS_COUNT];
+	/* Attempts to create the RX buffer that failed in a row */
+	unsigned int buffer_failures;
 	unsigned int channel_trigger;
 	bool channel_trigger_enabled;
 	bool trigger_falling_edge;
 	float trigger_value;
+	unsigned int trigger_pretrigger;
 	double adc_freq;
 	char adc_scale;
 	gfloat **channels_data_copy;
 	GSList *plots_sample_counts;
 	gfloat plugin_fft_corr;
+	/* Show the power spectral density rather than the power of tones */
+	bool plugin_fft_enbw_corr;
+	GThread *capture_thread;
+	struct recorder *recorder;
+	struct capture_frame *frames[CAPTURE_FRAME_SLOTS];
+	struct capture_frame *latest_frame;
+	struct capture_frame *pending_frame;
+	struct capture_frame *shown_frame;
+	guint frame_seq;
+	guint shown_frame_seq;
+	struct capture_frame *ring;
+	guint64 ring_written;
+	guint64 ring_searched;
+	guint64 ring_trigger;
+	struct latency_hist capture_latency[CAPTURE_STAGES_COUNT];
+	gint frames_busy;
 };
 
 struct buffer {
@@ -78,14 +145,34 @@ struct plot_params{
 	unsigned int sample_count;
 };
 
+struct fft_batch;
+struct ddc;
+
 struct _fft_alg_data{
 	gfloat fft_corr;
-	double *in;
-	double *win;
+	struct window *window;
 	unsigned int m;
-	fftw_complex *in_c;
-	fftw_complex *out;
-	fftw_plan plan_forward;
+	float *power;
+	float *mag;
+	bool use_double;
+	struct fft_plan *plan_forward;
+	struct fft_batch *batches;
+	unsigned int nb_batches;
+	/* Complex spectrum: I/Q channels, or a zoomed in real channel */
+	bool is_complex;
+	/* Samples of the channels the spectrum is made of, read from the
+	 * capture on each frame */
+	float *in_re;
+	float *in_im;
+	size_t in_length;
+	/* Samples the segments are taken from: the channels, or the output
+	 * of the down-converter when zoomed in */
+	const gfloat *src_re;
+	const gfloat *src_im;
+	struct ddc *ddc;
+	float *zoom_re;
+	float *zoom_im;
+	size_t zoom_length;
 	int cached_fft_size;
 	int cached_num_active_channels;
 	int num_active_channels;
@@ -105,6 +192,9 @@ struct _transform {
 	bool has_the_marker;
 	void *settings;
 	void (*transform_function)(Transform *tr, gboolean init_transform);
+	/* Cleared by the transform function when an update produced nothing
+	 * new, e.g. while the FFT planner is busy */
+	bool updated;
 };
 
 struct _tr_list {
@@ -112,8 +202,17 @@ struct _tr_list {
 	int size;
 };
 
+/* How a time transform gets its y axis from the samples, chosen when the
+ * transform is set up rather than for each sample */
+enum time_kernel {
+	TIME_KERNEL_NONE,		/* the y axis is the samples */
+	TIME_KERNEL_SCALE,
+	TIME_KERNEL_OFFSET,
+	TIME_KERNEL_SCALE_OFFSET,
+	TIME_KERNEL_RECIPROCAL,		/* then scaled and offset */
+};
+
 struct _time_settings {
-	gfloat *data_source;
 	unsigned int num_samples;
 	gfloat max_x_axis;
 	gboolean apply_inverse_funct;
@@ -121,38 +220,69 @@ struct _time_settings {
 	gboolean apply_add_funct;
 	gfloat multiply_value;
 	gfloat add_value;
+	enum time_kernel kernel;
+	/* Graph the traces are accumulated into, NULL to draw the last one */
+	struct _GtkDataboxGraph *density;
+	unsigned int persistence;
+	/* Samples per symbol of the eye diagram, off if 0, and the x axis
+	 * folded over two symbols */
+	gfloat eye_period;
+	gfloat *eye_x_axis;
+	/* Graph drawing the samples decimated for the screen, told when they
+	 * change */
+	struct _GtkDataboxGraph *envelope;
 };
 
 struct _fft_settings {
-	gfloat *real_source;
-	gfloat *imag_source;
 	unsigned int fft_size;
 	unsigned int fft_avg;
+	unsigned int welch_segments;
+	enum window_type window;
+	double window_beta;
+	/* Decimation of the zoom mode, off if below 2, and center of the span
+	 * in the units of the frequency axis */
+	unsigned int zoom;
+	double zoom_center;
 	gfloat fft_pwr_off;
 	struct _fft_alg_data fft_alg_data;
 	struct marker_type *markers;
+	unsigned int max_markers; /* index of the last marker */
 	struct marker_type **markers_copy;
 	GMutex *marker_lock;
 	enum marker_types *marker_type;
 };
 
+struct _GtkDataboxGraph;
+
+struct _waterfall_settings {
+	/* First, so that the FFT code works on the settings of a waterfall */
+	struct _fft_settings fft;
+	/* Spectra kept in the history, see waterfall_set_size() */
+	unsigned int depth;
+	struct _GtkDataboxGraph *graph;
+};
+
 struct _constellation_settings {
-	gfloat *x_source;
-	gfloat *y_source;
 	unsigned int num_samples;
+	/* Graph the samples are binned into, NULL to draw them as points */
+	struct _GtkDataboxGraph *density;
+	unsigned int persistence;
 };
 
 struct _cross_correlation_settings {
-	gfloat *i0_source;
-	gfloat *q0_source;
-	gfloat *i1_source;
-	gfloat *q1_source;
 	unsigned int num_samples;
 	int revert_xcorr;
+	/* The signals are zero-padded to fft_size, at least 2 * num_samples - 1 */
+	unsigned int fft_size;
 	fftw_complex *signal_a;
 	fftw_complex *signal_b;
+	fftw_complex *spectrum_a;
+	fftw_complex *spectrum_b;
 	fftw_complex *xcorr_data;
+	struct fft_plan *plan_forward;
+	struct fft_plan *plan_backward;
 	struct marker_type *markers;
+	unsigned int max_markers; /* index of the last marker */
 	struct marker_type **markers_copy;
 	GMutex *marker_lock;
 	enum marker_types *marker_type;
@@ -167,7 +297,7 @@ gfloat* Transform_get_y_axis_ref(Transform *tr);
 void Transform_attach_settings(Transform *tr, void *settings);
 void Transform_attach_function(Transform *tr, void (*f)(Transform *tr , gboolean init_transform));
 void Transform_setup(Transform *tr);
-void Transform_update_output(Transform *tr);
+bool Transform_update_output(Transform *tr);
 
 TrList* TrList_new(void);
 void TrList_destroy(TrList *list);
@@ -0,0 +1,164 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <glib.h>
+#include <math.h>
+
+#include "ddc.h"
+#include "window.h"
+
+/*
+ * The half-band filters have DDC_TAPS taps: every other tap is zero but
+ * the center one, so each output costs DDC_PAIRS multiplications of a sum
+ * of two inputs. With a Kaiser window of beta 8 the stop band is ~80 dB
+ * down and the transition band is ~0.11 of the input rate wide, centered
+ * on a quarter of the input rate (see DDC_PASSBAND).
+ */
+#define DDC_PAIRS 12
+#define DDC_TAPS (4 * DDC_PAIRS - 1)
+#define DDC_KAISER_BETA 8.0
+
+/* Renormalize the NCO phasor this often, to keep its rounding errors from
+ * changing its amplitude */
+#define DDC_NCO_BLOCK 1024
+
+struct ddc {
+	unsigned int decimation;
+	unsigned int stages;
+	/* The center tap, and the taps on odd offsets from it */
+	float center;
+	float taps[DDC_PAIRS];
+};
+
+static void ddc_design(struct ddc *ddc)
+{
+	struct window *win = window_get(WINDOW_KAISER, DDC_KAISER_BETA,
+			DDC_TAPS);
+	double sum = 0.5;
+	unsigned int k;
+
+	for (k = 0; k < DDC_PAIRS; k++) {
+		double offset = 2 * k + 1;
+		double w = win ? win->coefs[DDC_TAPS / 2 + 2 * k + 1] : 1.0;
+
+		ddc->taps[k] = sin(M_PI * offset / 2) / (M_PI * offset) * w;
+		sum += 2 * ddc->taps[k];
+	}
+	window_put(win);
+
+	/* Unity gain at DC */
+	ddc->center = 0.5 / sum;
+	for (k = 0; k < DDC_PAIRS; k++)
+		ddc->taps[k] /= sum;
+}
+
+struct ddc * ddc_new(unsigned int decimation)
+{
+	struct ddc *ddc;
+
+	if (decimation < 2 || decimation > DDC_MAX_DECIMATION ||
+			(decimation & (decimation - 1)))
+		return NULL;
+
+	ddc = g_new0(struct ddc, 1);
+	ddc->decimation = decimation;
+	ddc->stages = g_bit_nth_lsf(decimation, -1);
+	ddc_design(ddc);
+
+	return ddc;
+}
+
+void ddc_free(struct ddc *ddc)
+{
+	g_free(ddc);
+}
+
+unsigned int ddc_get_decimation(const struct ddc *ddc)
+{
+	return ddc->decimation;
+}
+
+size_t ddc_input_length(unsigned int decimation, size_t out_len)
+{
+	for (; decimation > 1 && out_len; decimation /= 2)
+		out_len = 2 * (out_len - 1) + DDC_TAPS;
+
+	return out_len;
+}
+
+size_t ddc_output_length(unsigned int decimation, size_t in_len)
+{
+	for (; decimation > 1; decimation /= 2) {
+		if (in_len < DDC_TAPS)
+			return 0;
+		in_len = (in_len - DDC_TAPS) / 2 + 1;
+	}
+
+	return in_len;
+}
+
+static void ddc_mix(const float *re, const float *im, size_t n,
+		double freq, float *out_re, float *out_im)
+{
+	double rot_re = cos(2 * M_PI * freq), rot_im = -sin(2 * M_PI * freq);
+	double ph_re = 1.0, ph_im = 0.0, tmp, mag;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		double x_re = re[i], x_im = im ? im[i] : 0.0;
+
+		out_re[i] = x_re * ph_re - x_im * ph_im;
+		out_im[i] = x_re * ph_im + x_im * ph_re;
+
+		tmp = ph_re * rot_re - ph_im * rot_im;
+		ph_im = ph_re * rot_im + ph_im * rot_re;
+		ph_re = tmp;
+
+		if (!(i % DDC_NCO_BLOCK)) {
+			mag = sqrt(ph_re * ph_re + ph_im * ph_im);
+			ph_re /= mag;
+			ph_im /= mag;
+		}
+	}
+}
+
+/* Filter and decimate @x by two, in place. Output j only reads inputs
+ * from 2 * j on, so it never overwrites an input that is still needed. */
+static size_t ddc_halfband(const struct ddc *ddc, float *x, size_t n)
+{
+	size_t j, n_out = (n - DDC_TAPS) / 2 + 1;
+	unsigned int k;
+
+	for (j = 0; j < n_out; j++) {
+		const float *mid = x + 2 * j + DDC_TAPS / 2;
+		float acc = ddc->center * mid[0];
+
+		for (k = 0; k < DDC_PAIRS; k++)
+			acc += ddc->taps[k] * (mid[-(int) (2 * k + 1)] +
+					mid[2 * k + 1]);
+		x[j] = acc;
+	}
+
+	return n_out;
+}
+
+size_t ddc_process(struct ddc *ddc, const float *re, const float *im,
+		size_t n, double freq, float *out_re, float *out_im)
+{
+	unsigned int s;
+
+	if (!ddc_output_length(ddc->decimation, n))
+		return 0;
+
+	ddc_mix(re, im, n, freq, out_re, out_im);
+
+	for (s = 0; s < ddc->stages; s++) {
+		ddc_halfband(ddc, out_re, n);
+		n = ddc_halfband(ddc, out_im, n);
+	}
+
+	return n;
+}
@@ -0,0 +1,41 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __DDC_H__
+#define __DDC_H__
+
+#include <stddef.h>
+
+#define DDC_MAX_DECIMATION 256
+
+/* Digital down-converter: an NCO mixer followed by a cascade of half-band
+ * filters, each decimating by two */
+struct ddc;
+
+/* @decimation must be a power of two, up to DDC_MAX_DECIMATION */
+struct ddc * ddc_new(unsigned int decimation);
+void ddc_free(struct ddc *ddc);
+unsigned int ddc_get_decimation(const struct ddc *ddc);
+
+/* Number of input samples needed to get @out_len output samples, and
+ * number of output samples made from @in_len input samples */
+size_t ddc_input_length(unsigned int decimation, size_t out_len);
+size_t ddc_output_length(unsigned int decimation, size_t in_len);
+
+/* Half of the span, relative to the output sample rate, over which the
+ * filters are flat and free of aliases */
+#define DDC_PASSBAND 0.39
+
+/*
+ * Shift @freq (in cycles per sample) down to DC in the @n samples of
+ * @re and @im (NULL for a real signal), filter and decimate them. The
+ * outputs are stored in @out_re and @out_im, which can't be the inputs.
+ * Returns the number of output samples.
+ */
+size_t ddc_process(struct ddc *ddc, const float *re, const float *im,
+		size_t n, double freq, float *out_re, float *out_im);
+
+#endif /* __DDC_H__ */
@@ -0,0 +1,608 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <glib.h>
+#include <iio.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "demux.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DEMUX_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define DEMUX_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+struct demux_chn {
+	const uint8_t *src;
+	void *dst;
+	unsigned int length;
+	unsigned int bits;
+	unsigned int shift;
+	bool is_signed;
+	bool is_be;
+	bool is_s16;
+};
+
+#define DEMUX_SCALAR_LOOP(type, from_be, from_le) \
+	for (i = start; i < end; i++, src += step) { \
+		type val; \
+		memcpy(&val, src, sizeof(val)); \
+		raw = (uint64_t) (c->is_be ? from_be(val) : from_le(val)) << lsh; \
+		if (c->is_s16) \
+			((gint16 *) c->dst)[i] = (gint16) (c->is_signed ? \
+				(int64_t) raw >> rsh : (int64_t) (raw >> rsh)); \
+		else if (c->is_signed) \
+			((gfloat *) c->dst)[i] = (gfloat) ((int64_t) raw >> rsh); \
+		else \
+			((gfloat *) c->dst)[i] = (gfloat) (raw >> rsh); \
+	}
+
+#define DEMUX_NO_SWAP(x) (x)
+
+/* Same conversion as iio_channel_convert(): the value is left-aligned in a
+ * 64-bit word, then shifted back to drop the padding bits and the "shift"
+ * bits while extending the sign. */
+static void demux_scalar(const struct demux_chn *c, ptrdiff_t step,
+		size_t start, size_t end)
+{
+	const uint8_t *src = c->src + start * step;
+	unsigned int lsh = 64 - c->bits - c->shift;
+	unsigned int rsh = 64 - c->bits;
+	uint64_t raw;
+	size_t i;
+
+	switch (c->length) {
+	case 1:
+		DEMUX_SCALAR_LOOP(uint8_t, DEMUX_NO_SWAP, DEMUX_NO_SWAP);
+		break;
+	case 2:
+		DEMUX_SCALAR_LOOP(uint16_t, GUINT16_FROM_BE, GUINT16_FROM_LE);
+		break;
+	case 4:
+		DEMUX_SCALAR_LOOP(uint32_t, GUINT32_FROM_BE, GUINT32_FROM_LE);
+		break;
+	default:
+		DEMUX_SCALAR_LOOP(uint64_t, GUINT64_FROM_BE, GUINT64_FROM_LE);
+		break;
+	}
+}
+
+/*
+ * The vector kernels handle the common case of 1, 2 or 4 channels stored as
+ * contiguous 16-bit words. Each sample ends up in the low half of a 32-bit
+ * lane; shifting it left by (32 - bits - shift) then right by (32 - bits)
+ * discards whatever is in the high half and extends the sign. The result is
+ * then either narrowed back to 16 bits or converted to float.
+ */
+#if defined(__SSE2__)
+static inline __m128i demux_swap16_sse2(__m128i v)
+{
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+static inline void demux_i16_store_sse2(__m128i v,
+		const struct demux_chn *c, size_t i)
+{
+	v = _mm_sll_epi32(v, _mm_cvtsi32_si128(32 - c->bits - c->shift));
+	if (c->is_signed)
+		v = _mm_sra_epi32(v, _mm_cvtsi32_si128(32 - c->bits));
+	else
+		v = _mm_srl_epi32(v, _mm_cvtsi32_si128(32 - c->bits));
+
+	if (c->is_s16)
+		_mm_storel_epi64((__m128i *) ((gint16 *) c->dst + i),
+				_mm_packs_epi32(v, v));
+	else
+		_mm_storeu_ps((gfloat *) c->dst + i, _mm_cvtepi32_ps(v));
+}
+
+static size_t demux_i16_sse2(const struct demux_chn *c, unsigned int nb,
+		size_t nb_samples, bool swap)
+{
+	const __m128i *src = (const __m128i *) c[0].src;
+	const __m128i zero = _mm_setzero_si128();
+	__m128i a, b, x, y;
+	size_t i, n;
+
+	switch (nb) {
+	case 1:
+		n = nb_samples & ~(size_t) 7;
+		for (i = 0; i < n; i += 8) {
+			a = _mm_loadu_si128(src++);
+			if (swap)
+				a = demux_swap16_sse2(a);
+			demux_i16_store_sse2(_mm_unpacklo_epi16(a, zero),
+					&c[0], i);
+			demux_i16_store_sse2(_mm_unpackhi_epi16(a, zero),
+					&c[0], i + 4);
+		}
+		break;
+	case 2:
+		n = nb_samples & ~(size_t) 3;
+		for (i = 0; i < n; i += 4) {
+			a = _mm_loadu_si128(src++);
+			if (swap)
+				a = demux_swap16_sse2(a);
+			demux_i16_store_sse2(a, &c[0], i);
+			demux_i16_store_sse2(_mm_srli_epi32(a, 16),
+					&c[1], i);
+		}
+		break;
+	case 4:
+		n = nb_samples & ~(size_t) 3;
+		for (i = 0; i < n; i += 4) {
+			a = _mm_loadu_si128(src++);
+			b = _mm_loadu_si128(src++);
+			if (swap) {
+				a = demux_swap16_sse2(a);
+				b = demux_swap16_sse2(b);
+			}
+			/* Gather channels 0/1 of the four samples in x,
+			 * channels 2/3 in y */
+			a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+			b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+			x = _mm_unpacklo_epi64(a, b);
+			y = _mm_unpackhi_epi64(a, b);
+			demux_i16_store_sse2(x, &c[0], i);
+			demux_i16_store_sse2(_mm_srli_epi32(x, 16),
+					&c[1], i);
+			demux_i16_store_sse2(y, &c[2], i);
+			demux_i16_store_sse2(_mm_srli_epi32(y, 16),
+					&c[3], i);
+		}
+		break;
+	default:
+		n = 0;
+		break;
+	}
+
+	return n;
+}
+#endif /* __SSE2__ */
+
+#if defined(DEMUX_HAVE_AVX2)
+__attribute__((target("avx2")))
+static inline __m256i demux_swap16_avx2(__m256i v)
+{
+	return _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+}
+
+__attribute__((target("avx2")))
+static inline void demux_i16_store_avx2(__m256i v,
+		const struct demux_chn *c, size_t i)
+{
+	v = _mm256_sll_epi32(v, _mm_cvtsi32_si128(32 - c->bits - c->shift));
+	if (c->is_signed)
+		v = _mm256_sra_epi32(v, _mm_cvtsi32_si128(32 - c->bits));
+	else
+		v = _mm256_srl_epi32(v, _mm_cvtsi32_si128(32 - c->bits));
+
+	if (c->is_s16)
+		_mm_storeu_si128((__m128i *) ((gint16 *) c->dst + i),
+				_mm_packs_epi32(_mm256_castsi256_si128(v),
+					_mm256_extracti128_si256(v, 1)));
+	else
+		_mm256_storeu_ps((gfloat *) c->dst + i, _mm256_cvtepi32_ps(v));
+}
+
+__attribute__((target("avx2")))
+static size_t demux_i16_avx2(const struct demux_chn *c, unsigned int nb,
+		size_t nb_samples, bool swap)
+{
+	const uint8_t *src = c[0].src;
+	__m256i a, b, x, y;
+	size_t i, n = nb_samples & ~(size_t) 7;
+
+	switch (nb) {
+	case 1:
+		for (i = 0; i < n; i += 8, src += 16) {
+			a = _mm256_cvtepu16_epi32(
+					_mm_loadu_si128((const __m128i *) src));
+			if (swap)
+				a = _mm256_or_si256(
+					_mm256_srli_epi32(a, 8),
+					_mm256_and_si256(_mm256_slli_epi32(a, 8),
+						_mm256_set1_epi32(0xff00)));
+			demux_i16_store_avx2(a, &c[0], i);
+		}
+		break;
+	case 2:
+		for (i = 0; i < n; i += 8, src += 32) {
+			a = _mm256_loadu_si256((const __m256i *) src);
+			if (swap)
+				a = demux_swap16_avx2(a);
+			demux_i16_store_avx2(a, &c[0], i);
+			demux_i16_store_avx2(_mm256_srli_epi32(a, 16),
+					&c[1], i);
+		}
+		break;
+	case 4:
+		for (i = 0; i < n; i += 8, src += 64) {
+			a = _mm256_loadu_si256((const __m256i *) src);
+			b = _mm256_loadu_si256((const __m256i *) (src + 32));
+			if (swap) {
+				a = demux_swap16_avx2(a);
+				b = demux_swap16_avx2(b);
+			}
+			/* Same as SSE2 within each 128-bit lane, then put
+			 * the 64-bit pairs back in sample order */
+			a = _mm256_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+			b = _mm256_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+			x = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(a, b),
+					_MM_SHUFFLE(3, 1, 2, 0));
+			y = _mm256_permute4x64_epi64(_mm256_unpackhi_epi64(a, b),
+					_MM_SHUFFLE(3, 1, 2, 0));
+			demux_i16_store_avx2(x, &c[0], i);
+			demux_i16_store_avx2(_mm256_srli_epi32(x, 16),
+					&c[1], i);
+			demux_i16_store_avx2(y, &c[2], i);
+			demux_i16_store_avx2(_mm256_srli_epi32(y, 16),
+					&c[3], i);
+		}
+		break;
+	default:
+		n = 0;
+		break;
+	}
+
+	return n;
+}
+#endif /* DEMUX_HAVE_AVX2 */
+
+#if defined(DEMUX_HAVE_NEON)
+static inline void demux_i16_store_neon(uint16x8_t v,
+		const struct demux_chn *c, size_t i, bool swap)
+{
+	int32x4_t lsh = vdupq_n_s32(32 - c->bits - c->shift);
+	int32x4_t rsh = vdupq_n_s32(-(int32_t) (32 - c->bits));
+	gfloat *dst = (gfloat *) c->dst + i;
+	uint32x4_t lo, hi;
+	int32x4_t a, b;
+
+	if (swap)
+		v = vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(v)));
+
+	lo = vshlq_u32(vmovl_u16(vget_low_u16(v)), lsh);
+	hi = vshlq_u32(vmovl_u16(vget_high_u16(v)), lsh);
+	if (c->is_signed) {
+		a = vshlq_s32(vreinterpretq_s32_u32(lo), rsh);
+		b = vshlq_s32(vreinterpretq_s32_u32(hi), rsh);
+	} else {
+		a = vreinterpretq_s32_u32(vshlq_u32(lo, rsh));
+		b = vreinterpretq_s32_u32(vshlq_u32(hi, rsh));
+	}
+
+	if (c->is_s16) {
+		vst1q_s16((gint16 *) c->dst + i,
+				vcombine_s16(vmovn_s32(a), vmovn_s32(b)));
+	} else if (c->is_signed) {
+		vst1q_f32(dst, vcvtq_f32_s32(a));
+		vst1q_f32(dst + 4, vcvtq_f32_s32(b));
+	} else {
+		vst1q_f32(dst, vcvtq_f32_u32(vreinterpretq_u32_s32(a)));
+		vst1q_f32(dst + 4, vcvtq_f32_u32(vreinterpretq_u32_s32(b)));
+	}
+}
+
+static size_t demux_i16_neon(const struct demux_chn *c, unsigned int nb,
+		size_t nb_samples, bool swap)
+{
+	const uint16_t *src = (const uint16_t *) c[0].src;
+	size_t i, n = nb_samples & ~(size_t) 7;
+	uint16x8x2_t v2;
+	uint16x8x4_t v4;
+
+	switch (nb) {
+	case 1:
+		for (i = 0; i < n; i += 8, src += 8)
+			demux_i16_store_neon(vld1q_u16(src),
+					&c[0], i, swap);
+		break;
+	case 2:
+		for (i = 0; i < n; i += 8, src += 16) {
+			v2 = vld2q_u16(src);
+			demux_i16_store_neon(v2.val[0], &c[0], i, swap);
+			demux_i16_store_neon(v2.val[1], &c[1], i, swap);
+		}
+		break;
+	case 4:
+		for (i = 0; i < n; i += 8, src += 32) {
+			v4 = vld4q_u16(src);
+			demux_i16_store_neon(v4.val[0], &c[0], i, swap);
+			demux_i16_store_neon(v4.val[1], &c[1], i, swap);
+			demux_i16_store_neon(v4.val[2], &c[2], i, swap);
+			demux_i16_store_neon(v4.val[3], &c[3], i, swap);
+		}
+		break;
+	default:
+		n = 0;
+		break;
+	}
+
+	return n;
+}
+#endif /* DEMUX_HAVE_NEON */
+
+static bool demux_is_packed_i16(const struct demux_chn *c, unsigned int nb,
+		ptrdiff_t step)
+{
+	unsigned int i;
+
+	if (nb != 1 && nb != 2 && nb != 4)
+		return false;
+	if (step != 2 * nb)
+		return false;
+
+	for (i = 0; i < nb; i++) {
+		if (c[i].length != 2 || c[i].bits == 0 ||
+				c[i].bits + c[i].shift > 16 ||
+				c[i].is_be != c[0].is_be ||
+				c[i].src != c[0].src + 2 * i)
+			return false;
+	}
+
+	return true;
+}
+
+/* Returns how many samples were converted; the scalar code does the rest */
+static size_t demux_i16_packed(const struct demux_chn *c, unsigned int nb,
+		size_t nb_samples)
+{
+	bool swap = c[0].is_be != (G_BYTE_ORDER == G_BIG_ENDIAN);
+
+#if defined(DEMUX_HAVE_AVX2)
+	if (__builtin_cpu_supports("avx2"))
+		return demux_i16_avx2(c, nb, nb_samples, swap);
+#endif
+#if defined(__SSE2__)
+	return demux_i16_sse2(c, nb, nb_samples, swap);
+#elif defined(DEMUX_HAVE_NEON)
+	return demux_i16_neon(c, nb, nb_samples, swap);
+#else
+	return 0;
+#endif
+}
+
+enum demux_sample_type demux_channel_sample_type(const struct iio_channel *chn)
+{
+	const struct iio_data_format *format = iio_channel_get_data_format(chn);
+
+	if (format->bits && (format->bits < 16 ||
+				(format->bits == 16 && format->is_signed)))
+		return DEMUX_SAMPLE_S16;
+	return DEMUX_SAMPLE_FLOAT;
+}
+
+size_t demux_buffer(struct iio_buffer *buf, const struct iio_device *dev,
+		size_t first, void **channels_data, size_t nb_samples)
+{
+	unsigned int i, j, nb = 0, nb_channels = iio_device_get_channels_count(dev);
+	ptrdiff_t step = iio_buffer_step(buf);
+	struct demux_chn *chns, tmp;
+	size_t done = 0;
+
+	chns = g_newa(struct demux_chn, nb_channels);
+
+	for (i = 0; i < nb_channels; i++) {
+		struct iio_channel *chn = iio_device_get_channel(dev, i);
+		const struct iio_data_format *format;
+
+		if (!iio_channel_is_enabled(chn))
+			continue;
+
+		format = iio_channel_get_data_format(chn);
+		chns[nb].src = (const uint8_t *) iio_buffer_first(buf, chn) +
+			first * step;
+		chns[nb].dst = channels_data[i];
+		chns[nb].length = format->length / 8;
+		chns[nb].bits = format->bits;
+		chns[nb].shift = format->shift;
+		chns[nb].is_signed = format->is_signed;
+		chns[nb].is_be = format->is_be;
+		chns[nb].is_s16 = demux_channel_sample_type(chn) ==
+			DEMUX_SAMPLE_S16;
+		nb++;
+	}
+
+	if (!nb)
+		return 0;
+
+	/* Order the channels as they are laid out in the buffer */
+	for (i = 1; i < nb; i++) {
+		tmp = chns[i];
+		for (j = i; j > 0 && chns[j - 1].src > tmp.src; j--)
+			chns[j] = chns[j - 1];
+		chns[j] = tmp;
+	}
+
+	if (demux_is_packed_i16(chns, nb, step))
+		done = demux_i16_packed(chns, nb, nb_samples);
+
+	for (i = 0; i < nb; i++)
+		demux_scalar(&chns[i], step, done, nb_samples);
+
+	return nb_samples;
+}
+
+void demux_to_float(gfloat *dst, const void *src,
+		enum demux_sample_type type, size_t nb_samples)
+{
+	const gint16 *s16 = src;
+	size_t i = 0;
+
+	if (type == DEMUX_SAMPLE_FLOAT) {
+		memcpy(dst, src, nb_samples * sizeof(gfloat));
+		return;
+	}
+
+#if defined(__SSE2__)
+	for (; i + 8 <= nb_samples; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (s16 + i));
+
+		/* Each sample goes to the high half of a 32-bit lane, the
+		 * arithmetic shift brings it back with its sign extended */
+		_mm_storeu_ps(dst + i, _mm_cvtepi32_ps(
+				_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)));
+		_mm_storeu_ps(dst + i + 4, _mm_cvtepi32_ps(
+				_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)));
+	}
+#elif defined(DEMUX_HAVE_NEON)
+	for (; i + 8 <= nb_samples; i += 8) {
+		int16x8_t v = vld1q_s16(s16 + i);
+
+		vst1q_f32(dst + i, vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))));
+		vst1q_f32(dst + i + 4, vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))));
+	}
+#endif
+
+	for (; i < nb_samples; i++)
+		dst[i] = (gfloat) s16[i];
+}
+
+static size_t demux_find_first_edge_float(const gfloat *data, size_t start,
+		size_t end, gfloat level, bool falling_edge)
+{
+	size_t i = start;
+
+#if defined(__SSE2__)
+	const __m128 lvl = _mm_set1_ps(level);
+
+	/* Lanes of prev/cur hold data[i - 1 + k] and data[i + k] */
+	for (; i + 4 <= end; i += 4) {
+		__m128 prev = _mm_loadu_ps(data + i - 1);
+		__m128 cur = _mm_loadu_ps(data + i);
+		int mask;
+
+		if (falling_edge)
+			mask = _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(prev, lvl),
+						_mm_cmplt_ps(cur, lvl)));
+		else
+			mask = _mm_movemask_ps(_mm_and_ps(_mm_cmplt_ps(prev, lvl),
+						_mm_cmpge_ps(cur, lvl)));
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+#elif defined(DEMUX_HAVE_NEON)
+	const float32x4_t lvl = vdupq_n_f32(level);
+
+	for (; i + 4 <= end; i += 4) {
+		float32x4_t prev = vld1q_f32(data + i - 1);
+		float32x4_t cur = vld1q_f32(data + i);
+		uint32x4_t hit;
+
+		if (falling_edge)
+			hit = vandq_u32(vcgeq_f32(prev, lvl), vcltq_f32(cur, lvl));
+		else
+			hit = vandq_u32(vcltq_f32(prev, lvl), vcgeq_f32(cur, lvl));
+
+		if (vgetq_lane_u32(hit, 0))
+			return i;
+		if (vgetq_lane_u32(hit, 1))
+			return i + 1;
+		if (vgetq_lane_u32(hit, 2))
+			return i + 2;
+		if (vgetq_lane_u32(hit, 3))
+			return i + 3;
+	}
+#endif
+
+	for (; i < end; i++) {
+		if (!falling_edge && data[i - 1] < level && data[i] >= level)
+			return i;
+		if (falling_edge && data[i - 1] >= level && data[i] < level)
+			return i;
+	}
+
+	return 0;
+}
+
+/* For an integer x, x >= level is x >= ceil(level), so the s16 search only
+ * needs integer compares against that threshold */
+static size_t demux_find_first_edge_s16(const gint16 *data, size_t start,
+		size_t end, gfloat level, bool falling_edge)
+{
+	double threshold = ceil(level);
+	gint16 t;
+	size_t i = start;
+
+	/* Every sample is on the same side of the level */
+	if (threshold <= G_MININT16 || threshold > G_MAXINT16)
+		return 0;
+	t = (gint16) threshold;
+
+#if defined(__SSE2__)
+	const __m128i lvl = _mm_set1_epi16(t);
+	const __m128i lvl_1 = _mm_set1_epi16(t - 1);
+
+	/* Lanes of prev/cur hold data[i - 1 + k] and data[i + k] */
+	for (; i + 8 <= end; i += 8) {
+		__m128i prev = _mm_loadu_si128((const __m128i *) (data + i - 1));
+		__m128i cur = _mm_loadu_si128((const __m128i *) (data + i));
+		int mask;
+
+		if (falling_edge)
+			mask = _mm_movemask_epi8(_mm_and_si128(
+					_mm_cmpgt_epi16(prev, lvl_1),
+					_mm_cmplt_epi16(cur, lvl)));
+		else
+			mask = _mm_movemask_epi8(_mm_and_si128(
+					_mm_cmplt_epi16(prev, lvl),
+					_mm_cmpgt_epi16(cur, lvl_1)));
+		if (mask)
+			return i + __builtin_ctz(mask) / 2;
+	}
+#elif defined(DEMUX_HAVE_NEON)
+	const int16x8_t lvl = vdupq_n_s16(t);
+
+	for (; i + 8 <= end; i += 8) {
+		int16x8_t prev = vld1q_s16(data + i - 1);
+		int16x8_t cur = vld1q_s16(data + i);
+		uint16x8_t hit;
+		uint64_t mask;
+
+		if (falling_edge)
+			hit = vandq_u16(vcgeq_s16(prev, lvl), vcltq_s16(cur, lvl));
+		else
+			hit = vandq_u16(vcltq_s16(prev, lvl), vcgeq_s16(cur, lvl));
+
+		/* One byte per lane, lane 0 in the low byte */
+		mask = vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(hit)), 0);
+		if (mask)
+			return i + __builtin_ctzll(mask) / 8;
+	}
+#endif
+
+	for (; i < end; i++) {
+		if (!falling_edge && data[i - 1] < t && data[i] >= t)
+			return i;
+		if (falling_edge && data[i - 1] >= t && data[i] < t)
+			return i;
+	}
+
+	return 0;
+}
+
+size_t demux_find_first_edge(const void *data, enum demux_sample_type type,
+		size_t start, size_t end, gfloat level, bool falling_edge)
+{
+	if (type == DEMUX_SAMPLE_S16)
+		return demux_find_first_edge_s16(data, start, end, level,
+				falling_edge);
+	return demux_find_first_edge_float(data, start, end, level,
+			falling_edge);
+}
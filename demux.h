@@ -0,0 +1,45 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __DEMUX_H__
+#define __DEMUX_H__
+
+#include <glib.h>
+#include <iio.h>
+#include <stdbool.h>
+
+/* Demuxed samples are kept in their native width when they fit in 16 bits,
+ * and as floats otherwise. */
+enum demux_sample_type {
+	DEMUX_SAMPLE_S16,
+	DEMUX_SAMPLE_FLOAT,
+};
+
+#define DEMUX_SAMPLE_SIZE(type) \
+	((type) == DEMUX_SAMPLE_S16 ? sizeof(gint16) : sizeof(gfloat))
+
+enum demux_sample_type demux_channel_sample_type(const struct iio_channel *chn);
+
+/* Deinterleave and convert @nb_samples samples of all the enabled channels
+ * of @buf, starting at sample @first, into @channels_data, which is indexed
+ * like the channels of the device and holds samples of
+ * demux_channel_sample_type(). Returns the number of samples written per
+ * channel. */
+size_t demux_buffer(struct iio_buffer *buf, const struct iio_device *dev,
+		size_t first, void **channels_data, size_t nb_samples);
+
+/* Convert @nb_samples demuxed samples of type @type to floats */
+void demux_to_float(gfloat *dst, const void *src,
+		enum demux_sample_type type, size_t nb_samples);
+
+/* Search forwards from index @start for the first crossing of @level:
+ * returns the smallest i in [@start, @end[ such that data[i - 1] is below
+ * @level and data[i] is not (the opposite for a falling edge), or 0 if
+ * there is no such crossing. @start must be at least 1. */
+size_t demux_find_first_edge(const void *data, enum demux_sample_type type,
+		size_t start, size_t end, gfloat level, bool falling_edge);
+
+#endif /* __DEMUX_H__ */
@@ -0,0 +1,303 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <glib.h>
+#include <glib-object.h>
+#include <gtk/gtk.h>
+#include <gtkdatabox.h>
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "density.h"
+#include "dsp.h"
+#include "image_graph.h"
+
+#define DENSITY_CELLS (DENSITY_BINS * DENSITY_BINS)
+#define DENSITY_COLORS 256
+
+/* Counts that faded below this are dropped, rather than left to decay
+ * into denormals that slow down the next frames */
+#define DENSITY_FLOOR 1e-3f
+
+#define DENSITY_TYPE (density_get_type())
+#define DENSITY(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), DENSITY_TYPE, Density))
+
+typedef struct _Density {
+	GtkDataboxGraph parent;
+	/* Row 0 is the top of the plot */
+	float *hist;
+	/* The histogram, color-mapped after each frame; the empty bins are
+	 * transparent, so that the grid and the other graphs show through */
+	guchar *image;
+	float decay;
+	bool fixed_x;
+	bool fitted;
+	gfloat x_min;
+	gfloat x_max;
+	gfloat y_min;
+	gfloat y_max;
+	/* Image of the visible part of the histogram, sized for the databox */
+	struct image_frame frame;
+} Density;
+
+typedef struct _DensityClass {
+	GtkDataboxGraphClass parent_class;
+} DensityClass;
+
+GType density_get_type(void);
+
+G_DEFINE_TYPE(Density, density, GTK_DATABOX_TYPE_GRAPH)
+
+/* Like a phosphor: black, green, yellow, white */
+static guchar colormap[DENSITY_COLORS][4];
+
+static void colormap_init(void)
+{
+	static const guchar stops[][3] = {
+		{ 0, 0, 0 },
+		{ 0, 96, 0 },
+		{ 0, 255, 0 },
+		{ 255, 255, 0 },
+		{ 255, 255, 255 },
+	};
+
+	image_graph_colormap(colormap[0], DENSITY_COLORS, 4,
+			stops, G_N_ELEMENTS(stops));
+	/* The empty bins */
+	colormap[0][3] = 0;
+}
+
+/* Smallest power of two above the magnitude of the values */
+static gfloat density_fit_range(const gfloat *v, size_t n)
+{
+	gfloat m = 0.0f;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		m = fmaxf(m, fabsf(v[i]));
+
+	if (!(m > 0.0f) || isinf(m))
+		return 1.0f;
+
+	return ldexpf(1.0f, ilogbf(m) + 1);
+}
+
+static void density_fit(Density *d, const gfloat *x, const gfloat *y,
+		size_t n)
+{
+	d->y_max = density_fit_range(y, n);
+	d->y_min = -d->y_max;
+	if (!d->fixed_x) {
+		d->x_max = density_fit_range(x, n);
+		d->x_min = -d->x_max;
+	}
+
+	memset(d->hist, 0, sizeof(float) * DENSITY_CELLS);
+	d->fitted = true;
+}
+
+/* Returns the number of points out of the fitted axes */
+static size_t density_bin(Density *d, const gfloat *x, const gfloat *y,
+		size_t n)
+{
+	float sx = DENSITY_BINS / (d->x_max - d->x_min);
+	float sy = DENSITY_BINS / (d->y_max - d->y_min);
+	size_t i, outside = 0;
+
+	for (i = 0; i < n; i++) {
+		float fx = (x[i] - d->x_min) * sx;
+		float fy = (d->y_max - y[i]) * sy;
+
+		/* Also drops NaNs */
+		if (!(fy >= 0.0f && fy < DENSITY_BINS)) {
+			outside++;
+			continue;
+		}
+		if (!(fx >= 0.0f && fx < DENSITY_BINS)) {
+			if (!d->fixed_x)
+				outside++;
+			continue;
+		}
+
+		d->hist[(unsigned int) fy * DENSITY_BINS + (unsigned int) fx] += 1.0f;
+	}
+
+	return outside;
+}
+
+/* Logarithmic, so that both the sparse and the dense areas are readable */
+static void density_map(Density *d)
+{
+	float max = 0.0f, scale;
+	unsigned int i;
+
+	for (i = 0; i < DENSITY_CELLS; i++) {
+		if (d->hist[i] < DENSITY_FLOOR)
+			d->hist[i] = 0.0f;
+		max = fmaxf(max, d->hist[i]);
+	}
+
+	/* A bin hit by one sample in the last frame is never transparent */
+	scale = (DENSITY_COLORS - 1) / log1pf(fmaxf(max, 1.0f));
+	for (i = 0; i < DENSITY_CELLS; i++) {
+		unsigned int index = 0;
+
+		if (d->hist[i] > 0.0f)
+			index = CLAMP((unsigned int) (log1pf(d->hist[i]) * scale),
+					d->hist[i] >= 1.0f, DENSITY_COLORS - 1);
+		memcpy(d->image + 4 * i, colormap[index], 4);
+	}
+}
+
+/* Histogram row shown on a pixel row of the image */
+struct density_layout {
+	Density *d;
+	GtkDatabox *box;
+	gint y0;
+	float sy;
+};
+
+static const guchar * density_row(gint py, gpointer data)
+{
+	struct density_layout *l = data;
+	Density *d = l->d;
+	gint row = (gint) floorf((d->y_max - gtk_databox_pixel_to_value_y(
+				l->box, l->y0 + py)) * l->sy);
+
+	row = CLAMP(row, 0, DENSITY_BINS - 1);
+	return d->image + (size_t) row * DENSITY_BINS * 4;
+}
+
+static void density_draw(GtkDataboxGraph *graph, GtkDatabox *box)
+{
+	Density *d = DENSITY(graph);
+	GdkPixmap *pixmap = gtk_databox_get_backing_pixmap(box);
+	struct density_layout layout;
+	GtkAllocation alloc;
+	gint x0, x1, y0, y1, w, h;
+
+	if (!d->fitted || !pixmap)
+		return;
+
+	gtk_widget_get_allocation(GTK_WIDGET(box), &alloc);
+
+	x0 = MAX(gtk_databox_value_to_pixel_x(box, d->x_min), 0);
+	x1 = MIN(gtk_databox_value_to_pixel_x(box, d->x_max), alloc.width);
+	y0 = MAX(gtk_databox_value_to_pixel_y(box, d->y_max), 0);
+	y1 = MIN(gtk_databox_value_to_pixel_y(box, d->y_min), alloc.height);
+	w = x1 - x0;
+	h = y1 - y0;
+	if (w <= 0 || h <= 0)
+		return;
+
+	if (image_frame_reserve(&d->frame, alloc.width, alloc.height) < 0)
+		return;
+
+	image_frame_map_columns(&d->frame, box, x0, w, d->x_min,
+			DENSITY_BINS / (d->x_max - d->x_min), DENSITY_BINS);
+
+	layout.d = d;
+	layout.box = box;
+	layout.y0 = y0;
+	layout.sy = DENSITY_BINS / (d->y_max - d->y_min);
+	image_frame_render(&d->frame, 0, h, w, density_row, &layout);
+
+	gdk_draw_pixbuf(pixmap, NULL, d->frame.pixbuf, 0, 0, x0, y0, w, h,
+			GDK_RGB_DITHER_NONE, 0, 0);
+}
+
+static gint density_calculate_extrema(GtkDataboxGraph *graph,
+		gfloat *min_x, gfloat *max_x, gfloat *min_y, gfloat *max_y)
+{
+	Density *d = DENSITY(graph);
+
+	if (!d->fitted)
+		return -1;
+
+	*min_x = d->x_min;
+	*max_x = d->x_max;
+	*min_y = d->y_min;
+	*max_y = d->y_max;
+
+	return 0;
+}
+
+static void density_finalize(GObject *obj)
+{
+	Density *d = DENSITY(obj);
+
+	g_free(d->hist);
+	g_free(d->image);
+	image_frame_free(&d->frame);
+
+	G_OBJECT_CLASS(density_parent_class)->finalize(obj);
+}
+
+static void density_class_init(DensityClass *klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+	GtkDataboxGraphClass *graph_class = GTK_DATABOX_GRAPH_CLASS(klass);
+
+	gobject_class->finalize = density_finalize;
+	graph_class->draw = density_draw;
+	graph_class->calculate_extrema = density_calculate_extrema;
+
+	colormap_init();
+}
+
+static void density_init(Density *d)
+{
+	d->hist = g_new0(float, DENSITY_CELLS);
+	d->image = g_new0(guchar, DENSITY_CELLS * 4);
+	d->frame.bpp = 4;
+}
+
+GtkDataboxGraph * density_new(void)
+{
+	return g_object_new(DENSITY_TYPE, NULL);
+}
+
+void density_set_persistence(GtkDataboxGraph *graph, unsigned int frames)
+{
+	DENSITY(graph)->decay = frames ? expf(-1.0f / frames) : 0.0f;
+}
+
+void density_set_x_range(GtkDataboxGraph *graph, gfloat min, gfloat max)
+{
+	Density *d = DENSITY(graph);
+
+	d->fixed_x = min < max;
+	if (d->fixed_x) {
+		d->x_min = min;
+		d->x_max = max;
+	}
+	d->fitted = false;
+}
+
+void density_add(GtkDataboxGraph *graph, const gfloat *x, const gfloat *y,
+		size_t n)
+{
+	Density *d = DENSITY(graph);
+
+	if (!n)
+		return;
+
+	if (!d->fitted)
+		density_fit(d, x, y, n);
+	else if (d->decay > 0.0f)
+		dsp_scale(d->hist, d->hist, d->decay, DENSITY_CELLS);
+	else
+		memset(d->hist, 0, sizeof(float) * DENSITY_CELLS);
+
+	/* The gain changed: start over on the new scale */
+	if (density_bin(d, x, y, n) > n / 8) {
+		density_fit(d, x, y, n);
+		density_bin(d, x, y, n);
+	}
+
+	density_map(d);
+}
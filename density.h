@@ -0,0 +1,39 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __DENSITY_H__
+#define __DENSITY_H__
+
+#include <stddef.h>
+#include <gtkdatabox_graph.h>
+
+/* Bins along each axis */
+#define DENSITY_BINS 512
+
+/*
+ * Databox graph showing how many samples fell in each bin of a 2D
+ * histogram, as one image: drawing it costs the same whatever the number
+ * of samples. Released with g_object_unref().
+ */
+GtkDataboxGraph * density_new(void);
+
+/* Fade the previous frames with a time constant of @frames frames; with 0,
+ * only the last frame is shown */
+void density_set_persistence(GtkDataboxGraph *graph, unsigned int frames);
+
+/* Fixed range of the x axis; if @min is not below @max, the x axis is
+ * fitted on the points like the y axis. Clears the histogram. */
+void density_set_x_range(GtkDataboxGraph *graph, gfloat min, gfloat max);
+
+/*
+ * Add a frame of @n points to the histogram. The fitted axes span +/- a
+ * power of two, chosen on the first frame and again (clearing the
+ * histogram) when too many points fall outside.
+ */
+void density_add(GtkDataboxGraph *graph, const gfloat *x, const gfloat *y,
+		size_t n);
+
+#endif /* __DENSITY_H__ */
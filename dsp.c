@@ -0,0 +1,539 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <glib.h>
+#include <float.h>
+#include <math.h>
+
+#include "dsp.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define DSP_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+void dsp_window_real(float *dst, const gfloat *src, const float *win,
+		size_t n)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i),
+					_mm_loadu_ps(win + i)));
+#elif defined(DSP_HAVE_NEON)
+	for (; i + 4 <= n; i += 4)
+		vst1q_f32(dst + i, vmulq_f32(vld1q_f32(src + i),
+					vld1q_f32(win + i)));
+#endif
+
+	for (; i < n; i++)
+		dst[i] = src[i] * win[i];
+}
+
+void dsp_window_complex(float *dst, const gfloat *re, const gfloat *im,
+		const float *win, size_t n)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 4 <= n; i += 4) {
+		__m128 w = _mm_loadu_ps(win + i);
+		__m128 r = _mm_mul_ps(_mm_loadu_ps(re + i), w);
+		__m128 m = _mm_mul_ps(_mm_loadu_ps(im + i), w);
+
+		_mm_storeu_ps(dst + 2 * i, _mm_unpacklo_ps(r, m));
+		_mm_storeu_ps(dst + 2 * i + 4, _mm_unpackhi_ps(r, m));
+	}
+#elif defined(DSP_HAVE_NEON)
+	for (; i + 4 <= n; i += 4) {
+		float32x4_t w = vld1q_f32(win + i);
+		float32x4x2_t v;
+
+		v.val[0] = vmulq_f32(vld1q_f32(re + i), w);
+		v.val[1] = vmulq_f32(vld1q_f32(im + i), w);
+		vst2q_f32(dst + 2 * i, v);
+	}
+#endif
+
+	for (; i < n; i++) {
+		dst[2 * i] = re[i] * win[i];
+		dst[2 * i + 1] = im[i] * win[i];
+	}
+}
+
+void dsp_power_add(float *acc, const float *src, size_t n)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 4 <= n; i += 4) {
+		__m128 a = _mm_loadu_ps(src + 2 * i);
+		__m128 b = _mm_loadu_ps(src + 2 * i + 4);
+
+		a = _mm_mul_ps(a, a);
+		b = _mm_mul_ps(b, b);
+		_mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i),
+				_mm_add_ps(
+				_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+				_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)))));
+	}
+#elif defined(DSP_HAVE_NEON)
+	for (; i + 4 <= n; i += 4) {
+		float32x4x2_t v = vld2q_f32(src + 2 * i);
+
+		vst1q_f32(acc + i, vmlaq_f32(vmlaq_f32(vld1q_f32(acc + i),
+				v.val[0], v.val[0]), v.val[1], v.val[1]));
+	}
+#endif
+
+	for (; i < n; i++)
+		acc[i] += src[2 * i] * src[2 * i] +
+			src[2 * i + 1] * src[2 * i + 1];
+}
+
+void dsp_power_add_double(float *acc, const double *src, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		acc[i] += (float) (src[2 * i] * src[2 * i] +
+				src[2 * i + 1] * src[2 * i + 1]);
+}
+
+void dsp_add(float *acc, const float *src, size_t n)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i),
+					_mm_loadu_ps(src + i)));
+#elif defined(DSP_HAVE_NEON)
+	for (; i + 4 <= n; i += 4)
+		vst1q_f32(acc + i, vaddq_f32(vld1q_f32(acc + i),
+					vld1q_f32(src + i)));
+#endif
+
+	for (; i < n; i++)
+		acc[i] += src[i];
+}
+
+/*
+ * Natural logarithm from the Cephes library: x = m * 2^e with m in
+ * [sqrt(2)/2, sqrt(2)[, then a polynomial in m - 1. The relative error is
+ * about 1e-7, well below what a plot can show.
+ */
+#define DSP_SQRTHF	0.707106781186547524f
+#define DSP_LOG_P0	7.0376836292e-2f
+#define DSP_LOG_P1	-1.1514610310e-1f
+#define DSP_LOG_P2	1.1676998740e-1f
+#define DSP_LOG_P3	-1.2420140846e-1f
+#define DSP_LOG_P4	1.4249322787e-1f
+#define DSP_LOG_P5	-1.6668057665e-1f
+#define DSP_LOG_P6	2.0000714765e-1f
+#define DSP_LOG_P7	-2.4999993993e-1f
+#define DSP_LOG_P8	3.3333331174e-1f
+#define DSP_LOG_Q1	-2.12194440e-4f
+#define DSP_LOG_Q2	0.693359375f
+
+/* 10 / ln(10) */
+#define DSP_DB_PER_NEPER	4.34294481903251828f
+
+static inline float dsp_log_poly(float x)
+{
+	float y = DSP_LOG_P0;
+
+	y = y * x + DSP_LOG_P1;
+	y = y * x + DSP_LOG_P2;
+	y = y * x + DSP_LOG_P3;
+	y = y * x + DSP_LOG_P4;
+	y = y * x + DSP_LOG_P5;
+	y = y * x + DSP_LOG_P6;
+	y = y * x + DSP_LOG_P7;
+	y = y * x + DSP_LOG_P8;
+
+	return y * x * x * x;
+}
+
+static inline float dsp_log(float x)
+{
+	union { float f; guint32 i; } u;
+	float e, y, z;
+
+	u.f = x;
+	e = (float) ((int) (u.i >> 23) - 126);
+	u.i = (u.i & 0x007fffff) | 0x3f000000;
+	x = u.f;
+
+	if (x < DSP_SQRTHF) {
+		e -= 1.0f;
+		x = x + x - 1.0f;
+	} else {
+		x = x - 1.0f;
+	}
+
+	z = x * x;
+	y = dsp_log_poly(x) + DSP_LOG_Q1 * e;
+	y -= 0.5f * z;
+	x += y;
+
+	return x + DSP_LOG_Q2 * e;
+}
+
+#if defined(__SSE2__)
+static inline __m128 dsp_log_sse2(__m128 x)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	__m128i xi = _mm_castps_si128(x);
+	__m128 e, mask, y, z;
+
+	e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(xi, 23),
+				_mm_set1_epi32(126)));
+	x = _mm_castsi128_ps(_mm_or_si128(
+			_mm_and_si128(xi, _mm_set1_epi32(0x007fffff)),
+			_mm_set1_epi32(0x3f000000)));
+
+	/* below sqrt(2)/2, use 2m - 1 and decrement the exponent */
+	mask = _mm_cmplt_ps(x, _mm_set1_ps(DSP_SQRTHF));
+	e = _mm_sub_ps(e, _mm_and_ps(mask, one));
+	x = _mm_add_ps(_mm_sub_ps(x, one), _mm_and_ps(mask, x));
+
+	z = _mm_mul_ps(x, x);
+	y = _mm_set1_ps(DSP_LOG_P0);
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(DSP_LOG_P1));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(DSP_LOG_P2));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(DSP_LOG_P3));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(DSP_LOG_P4));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(DSP_LOG_P5));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(DSP_LOG_P6));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(DSP_LOG_P7));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(DSP_LOG_P8));
+	y = _mm_mul_ps(_mm_mul_ps(y, x), z);
+
+	y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(DSP_LOG_Q1)));
+	y = _mm_sub_ps(y, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+	x = _mm_add_ps(x, y);
+	return _mm_add_ps(x, _mm_mul_ps(e, _mm_set1_ps(DSP_LOG_Q2)));
+}
+#elif defined(DSP_HAVE_NEON)
+static inline float32x4_t dsp_log_neon(float32x4_t x)
+{
+	const float32x4_t one = vdupq_n_f32(1.0f);
+	uint32x4_t xi = vreinterpretq_u32_f32(x);
+	uint32x4_t mask;
+	float32x4_t e, y, z;
+
+	e = vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(xi, 23)),
+				vdupq_n_s32(126)));
+	x = vreinterpretq_f32_u32(vorrq_u32(
+			vandq_u32(xi, vdupq_n_u32(0x007fffff)),
+			vdupq_n_u32(0x3f000000)));
+
+	/* below sqrt(2)/2, use 2m - 1 and decrement the exponent */
+	mask = vcltq_f32(x, vdupq_n_f32(DSP_SQRTHF));
+	e = vsubq_f32(e, vreinterpretq_f32_u32(
+			vandq_u32(mask, vreinterpretq_u32_f32(one))));
+	x = vaddq_f32(vsubq_f32(x, one), vreinterpretq_f32_u32(
+			vandq_u32(mask, vreinterpretq_u32_f32(x))));
+
+	z = vmulq_f32(x, x);
+	y = vdupq_n_f32(DSP_LOG_P0);
+	y = vmlaq_f32(vdupq_n_f32(DSP_LOG_P1), y, x);
+	y = vmlaq_f32(vdupq_n_f32(DSP_LOG_P2), y, x);
+	y = vmlaq_f32(vdupq_n_f32(DSP_LOG_P3), y, x);
+	y = vmlaq_f32(vdupq_n_f32(DSP_LOG_P4), y, x);
+	y = vmlaq_f32(vdupq_n_f32(DSP_LOG_P5), y, x);
+	y = vmlaq_f32(vdupq_n_f32(DSP_LOG_P6), y, x);
+	y = vmlaq_f32(vdupq_n_f32(DSP_LOG_P7), y, x);
+	y = vmlaq_f32(vdupq_n_f32(DSP_LOG_P8), y, x);
+	y = vmulq_f32(vmulq_f32(y, x), z);
+
+	y = vmlaq_n_f32(y, e, DSP_LOG_Q1);
+	y = vmlsq_n_f32(y, z, 0.5f);
+	x = vaddq_f32(x, y);
+	return vmlaq_n_f32(x, e, DSP_LOG_Q2);
+}
+#endif
+
+void dsp_power_to_db(float *dst, const float *src, float offset, size_t n)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128 min = _mm_set1_ps(FLT_MIN);
+	const __m128 scale = _mm_set1_ps(DSP_DB_PER_NEPER);
+	const __m128 off = _mm_set1_ps(offset);
+
+	for (; i + 4 <= n; i += 4) {
+		__m128 x = _mm_max_ps(min, _mm_loadu_ps(src + i));
+
+		_mm_storeu_ps(dst + i, _mm_add_ps(off,
+				_mm_mul_ps(scale, dsp_log_sse2(x))));
+	}
+#elif defined(DSP_HAVE_NEON)
+	const float32x4_t min = vdupq_n_f32(FLT_MIN);
+	const float32x4_t off = vdupq_n_f32(offset);
+
+	for (; i + 4 <= n; i += 4) {
+		float32x4_t x = vmaxq_f32(min, vld1q_f32(src + i));
+
+		vst1q_f32(dst + i, vmlaq_n_f32(off, dsp_log_neon(x),
+					DSP_DB_PER_NEPER));
+	}
+#endif
+
+	for (; i < n; i++) {
+		float x = src[i] < FLT_MIN ? FLT_MIN : src[i];
+
+		dst[i] = DSP_DB_PER_NEPER * dsp_log(x) + offset;
+	}
+}
+
+void dsp_max(float *acc, const float *src, size_t n)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(acc + i, _mm_max_ps(_mm_loadu_ps(acc + i),
+					_mm_loadu_ps(src + i)));
+#elif defined(DSP_HAVE_NEON)
+	for (; i + 4 <= n; i += 4)
+		vst1q_f32(acc + i, vmaxq_f32(vld1q_f32(acc + i),
+					vld1q_f32(src + i)));
+#endif
+
+	for (; i < n; i++)
+		if (acc[i] < src[i])
+			acc[i] = src[i];
+}
+
+void dsp_min(float *acc, const float *src, size_t n)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(acc + i, _mm_min_ps(_mm_loadu_ps(acc + i),
+					_mm_loadu_ps(src + i)));
+#elif defined(DSP_HAVE_NEON)
+	for (; i + 4 <= n; i += 4)
+		vst1q_f32(acc + i, vminq_f32(vld1q_f32(acc + i),
+					vld1q_f32(src + i)));
+#endif
+
+	for (; i < n; i++)
+		if (acc[i] > src[i])
+			acc[i] = src[i];
+}
+
+void dsp_ema(float *acc, const float *src, float alpha, size_t n)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128 a = _mm_set1_ps(alpha);
+
+	for (; i + 4 <= n; i += 4) {
+		__m128 v = _mm_loadu_ps(acc + i);
+
+		_mm_storeu_ps(acc + i, _mm_add_ps(v, _mm_mul_ps(a,
+				_mm_sub_ps(_mm_loadu_ps(src + i), v))));
+	}
+#elif defined(DSP_HAVE_NEON)
+	for (; i + 4 <= n; i += 4) {
+		float32x4_t v = vld1q_f32(acc + i);
+
+		vst1q_f32(acc + i, vmlaq_n_f32(v,
+				vsubq_f32(vld1q_f32(src + i), v), alpha));
+	}
+#endif
+
+	for (; i < n; i++)
+		acc[i] += alpha * (src[i] - acc[i]);
+}
+
+void dsp_scale(float *dst, const float *src, float scale, size_t n)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128 s = _mm_set1_ps(scale);
+
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), s));
+#elif defined(DSP_HAVE_NEON)
+	for (; i + 4 <= n; i += 4)
+		vst1q_f32(dst + i, vmulq_n_f32(vld1q_f32(src + i), scale));
+#endif
+
+	for (; i < n; i++)
+		dst[i] = src[i] * scale;
+}
+
+void dsp_offset(float *dst, const float *src, float offset, size_t n)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128 o = _mm_set1_ps(offset);
+
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(src + i), o));
+#elif defined(DSP_HAVE_NEON)
+	const float32x4_t o = vdupq_n_f32(offset);
+
+	for (; i + 4 <= n; i += 4)
+		vst1q_f32(dst + i, vaddq_f32(vld1q_f32(src + i), o));
+#endif
+
+	for (; i < n; i++)
+		dst[i] = src[i] + offset;
+}
+
+void dsp_scale_offset(float *dst, const float *src, float scale,
+		float offset, size_t n)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128 s = _mm_set1_ps(scale), o = _mm_set1_ps(offset);
+
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(dst + i, _mm_add_ps(
+				_mm_mul_ps(_mm_loadu_ps(src + i), s), o));
+#elif defined(DSP_HAVE_NEON)
+	const float32x4_t o = vdupq_n_f32(offset);
+
+	for (; i + 4 <= n; i += 4)
+		vst1q_f32(dst + i, vaddq_f32(
+				vmulq_n_f32(vld1q_f32(src + i), scale), o));
+#endif
+
+	for (; i < n; i++)
+		dst[i] = src[i] * scale + offset;
+}
+
+void dsp_reciprocal(float *dst, const float *src, float zero, float scale,
+		float offset, size_t n)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128 s = _mm_set1_ps(scale), o = _mm_set1_ps(offset);
+	const __m128 z = _mm_set1_ps(zero), one = _mm_set1_ps(1.0f);
+
+	for (; i + 4 <= n; i += 4) {
+		__m128 v = _mm_loadu_ps(src + i);
+		__m128 is_zero = _mm_cmpeq_ps(v, _mm_setzero_ps());
+
+		v = _mm_or_ps(_mm_and_ps(is_zero, z),
+				_mm_andnot_ps(is_zero, _mm_div_ps(one, v)));
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_mul_ps(v, s), o));
+	}
+#elif defined(DSP_HAVE_NEON) && defined(__aarch64__)
+	/* ARMv7 NEON only has a reciprocal estimate, not an exact division */
+	const float32x4_t z = vdupq_n_f32(zero), one = vdupq_n_f32(1.0f);
+	const float32x4_t o = vdupq_n_f32(offset);
+
+	for (; i + 4 <= n; i += 4) {
+		float32x4_t v = vld1q_f32(src + i);
+		uint32x4_t is_zero = vceqq_f32(v, vdupq_n_f32(0.0f));
+
+		v = vbslq_f32(is_zero, z, vdivq_f32(one, v));
+		vst1q_f32(dst + i, vaddq_f32(vmulq_n_f32(v, scale), o));
+	}
+#endif
+
+	for (; i < n; i++)
+		dst[i] = (src[i] != 0 ? 1 / src[i] : zero) * scale + offset;
+}
+
+static void dsp_heap_sift_down(unsigned int *bins, float *values,
+		unsigned int size, unsigned int i)
+{
+	unsigned int child, bin = bins[i];
+	float value = values[i];
+
+	while ((child = 2 * i + 1) < size) {
+		if (child + 1 < size && values[child + 1] < values[child])
+			child++;
+		if (values[child] >= value)
+			break;
+		bins[i] = bins[child];
+		values[i] = values[child];
+		i = child;
+	}
+
+	bins[i] = bin;
+	values[i] = value;
+}
+
+static void dsp_heap_sift_up(unsigned int *bins, float *values,
+		unsigned int i)
+{
+	unsigned int parent, bin = bins[i];
+	float value = values[i];
+
+	while (i && values[parent = (i - 1) / 2] > value) {
+		bins[i] = bins[parent];
+		values[i] = values[parent];
+		i = parent;
+	}
+
+	bins[i] = bin;
+	values[i] = value;
+}
+
+unsigned int dsp_find_peaks(const float *data, size_t n, bool absolute,
+		float floor, unsigned int *bins, float *values, unsigned int k)
+{
+	unsigned int size = 0, tmp;
+	float prev, cur, next, value;
+	size_t i;
+
+	if (!k || n < 3)
+		return 0;
+
+	/* bins and values hold a min-heap of the k highest peaks so far */
+	prev = absolute ? fabsf(data[0]) : data[0];
+	cur = absolute ? fabsf(data[1]) : data[1];
+	for (i = 1; i + 1 < n; i++, prev = cur, cur = next) {
+		next = absolute ? fabsf(data[i + 1]) : data[i + 1];
+
+		/* A plateau counts once, at its start */
+		if (cur <= prev || cur < next || cur <= floor)
+			continue;
+
+		if (size < k) {
+			bins[size] = i;
+			values[size] = cur;
+			dsp_heap_sift_up(bins, values, size++);
+		} else if (cur > values[0]) {
+			bins[0] = i;
+			values[0] = cur;
+			dsp_heap_sift_down(bins, values, size, 0);
+		}
+	}
+
+	/* Sort by popping the smallest to the end */
+	for (i = size; i > 1; i--) {
+		tmp = bins[0];
+		value = values[0];
+		bins[0] = bins[i - 1];
+		values[0] = values[i - 1];
+		bins[i - 1] = tmp;
+		values[i - 1] = value;
+		dsp_heap_sift_down(bins, values, i - 1, 0);
+	}
+
+	return size;
+}
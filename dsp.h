@@ -0,0 +1,60 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __DSP_H__
+#define __DSP_H__
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Complex arrays are interleaved real and imaginary parts, the layout of
+ * fftwf_complex and fftw_complex */
+
+/* dst[i] = src[i] * win[i] */
+void dsp_window_real(float *dst, const gfloat *src, const float *win,
+		size_t n);
+/* dst[i] = (re[i] + j * im[i]) * win[i] */
+void dsp_window_complex(float *dst, const gfloat *re, const gfloat *im,
+		const float *win, size_t n);
+
+/* acc[i] += |src[i]|^2 */
+void dsp_power_add(float *acc, const float *src, size_t n);
+void dsp_power_add_double(float *acc, const double *src, size_t n);
+
+/* acc[i] += src[i] */
+void dsp_add(float *acc, const float *src, size_t n);
+
+/* dst[i] = 10 * log10(src[i]) + offset, with src[i] floored at FLT_MIN so
+ * that the result is finite. Within 1e-4 dB of the libm result. */
+void dsp_power_to_db(float *dst, const float *src, float offset, size_t n);
+
+/* Averaging of successive spectra: peak hold, min hold and exponential
+ * moving average, acc[i] += alpha * (src[i] - acc[i]) */
+void dsp_max(float *acc, const float *src, size_t n);
+void dsp_min(float *acc, const float *src, size_t n);
+void dsp_ema(float *acc, const float *src, float alpha, size_t n);
+
+/* dst[i] = src[i] * scale, src[i] + offset and src[i] * scale + offset;
+ * @dst may be @src */
+void dsp_scale(float *dst, const float *src, float scale, size_t n);
+void dsp_offset(float *dst, const float *src, float offset, size_t n);
+void dsp_scale_offset(float *dst, const float *src, float scale,
+		float offset, size_t n);
+/* dst[i] = (1 / src[i]) * scale + offset, with @zero instead of 1 / 0 */
+void dsp_reciprocal(float *dst, const float *src, float zero, float scale,
+		float offset, size_t n);
+
+/*
+ * Find the (at most) @k highest local maxima of @data, or of its absolute
+ * value if @absolute is set, that are above @floor. Their indexes and
+ * values are stored in @bins and @values by decreasing value, and their
+ * number is returned. Runs in O(n + p log k) for p local maxima.
+ */
+unsigned int dsp_find_peaks(const float *data, size_t n, bool absolute,
+		float floor, unsigned int *bins, float *values, unsigned int k);
+
+#endif /* __DSP_H__ */
@@ -0,0 +1,272 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <glib.h>
+#include <glib-object.h>
+#include <gtk/gtk.h>
+#include <gtkdatabox.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include "envelope.h"
+
+#define ENVELOPE_TYPE (envelope_get_type())
+#define ENVELOPE(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), ENVELOPE_TYPE, Envelope))
+
+typedef struct _Envelope {
+	GtkDataboxGraph parent;
+	guint len;
+	gfloat *X;
+	gfloat *Y;
+	gboolean points;
+	/* Points to draw, in pixels, and what they were computed for */
+	GdkPoint *pixels;
+	guint nb_pixels;
+	guint max_pixels;
+	bool valid;
+	gfloat left;
+	gfloat right;
+	gfloat top;
+	gfloat bottom;
+	gint width;
+	gint height;
+} Envelope;
+
+typedef struct _EnvelopeClass {
+	GtkDataboxGraphClass parent_class;
+} EnvelopeClass;
+
+GType envelope_get_type(void);
+
+G_DEFINE_TYPE(Envelope, envelope, GTK_DATABOX_TYPE_GRAPH)
+
+/* Index of the first of the increasing values that is not below @v */
+static guint lower_bound(const gfloat *X, guint len, gfloat v)
+{
+	guint lo = 0, hi = len;
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+
+		if (X[mid] < v)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void envelope_add_point(Envelope *e, GtkDatabox *box,
+		gint x, gfloat y)
+{
+	e->pixels[e->nb_pixels].x = x;
+	e->pixels[e->nb_pixels].y = gtk_databox_value_to_pixel_y(box, y);
+	e->nb_pixels++;
+}
+
+/* The minimum and the maximum of a column, the first one first */
+static void envelope_add_column(Envelope *e, GtkDatabox *box, gint x,
+		guint imin, guint imax)
+{
+	if (imin == imax) {
+		envelope_add_point(e, box, x, e->Y[imin]);
+	} else if (imin < imax) {
+		envelope_add_point(e, box, x, e->Y[imin]);
+		envelope_add_point(e, box, x, e->Y[imax]);
+	} else {
+		envelope_add_point(e, box, x, e->Y[imax]);
+		envelope_add_point(e, box, x, e->Y[imin]);
+	}
+}
+
+static void envelope_decimate(Envelope *e, GtkDatabox *box,
+		gint width, gint height)
+{
+	gfloat left, right, top, bottom, scale;
+	guint i, first, last, imin, imax;
+	gint col, x;
+
+	gtk_databox_get_visible_limits(box, &left, &right, &top, &bottom);
+	if (e->valid && e->left == left && e->right == right &&
+			e->top == top && e->bottom == bottom &&
+			e->width == width && e->height == height)
+		return;
+
+	e->valid = true;
+	e->left = left;
+	e->right = right;
+	e->top = top;
+	e->bottom = bottom;
+	e->width = width;
+	e->height = height;
+	e->nb_pixels = 0;
+
+	/* The visible samples, and their neighbours for the lines to reach
+	 * the edges */
+	first = lower_bound(e->X, e->len, MIN(left, right));
+	last = lower_bound(e->X, e->len, MAX(left, right));
+	if (first > 0)
+		first--;
+	if (last < e->len)
+		last++;
+	if (first >= last)
+		return;
+
+	if (e->max_pixels < 2 * (guint) width + 4) {
+		e->max_pixels = 2 * width + 4;
+		e->pixels = g_renew(GdkPoint, e->pixels, e->max_pixels);
+	}
+
+	/* Few enough samples to draw them all */
+	if (last - first <= 2 * (guint) width) {
+		for (i = first; i < last; i++)
+			envelope_add_point(e, box,
+				gtk_databox_value_to_pixel_x(box, e->X[i]), e->Y[i]);
+		return;
+	}
+
+	/* Otherwise the samples are so dense that the neighbours are at most
+	 * a column away, and the columns can be found without going through
+	 * the databox for each sample */
+	scale = width / (right - left);
+	col = (gint) floorf((e->X[first] - left) * scale);
+	imin = imax = first;
+	for (i = first + 1; i < last; i++) {
+		x = (gint) floorf((e->X[i] - left) * scale);
+		if (x != col) {
+			envelope_add_column(e, box, col, imin, imax);
+			col = x;
+			imin = imax = i;
+		} else if (e->Y[i] < e->Y[imin]) {
+			imin = i;
+		} else if (e->Y[i] > e->Y[imax]) {
+			imax = i;
+		}
+	}
+	envelope_add_column(e, box, col, imin, imax);
+}
+
+static void envelope_draw(GtkDataboxGraph *graph, GtkDatabox *box)
+{
+	Envelope *e = ENVELOPE(graph);
+	GdkPixmap *pixmap = gtk_databox_get_backing_pixmap(box);
+	GtkAllocation alloc;
+	GdkGC *gc;
+	gint size;
+	guint i;
+
+	if (!e->len || !pixmap)
+		return;
+
+	gtk_widget_get_allocation(GTK_WIDGET(box), &alloc);
+	if (alloc.width <= 0)
+		return;
+
+	envelope_decimate(e, box, alloc.width, alloc.height);
+	if (!e->nb_pixels)
+		return;
+
+	gc = gtk_databox_graph_get_gc(graph);
+	if (!gc)
+		gc = gtk_databox_graph_create_gc(graph, box);
+
+	if (!e->points) {
+		if (e->nb_pixels > 1)
+			gdk_draw_lines(pixmap, gc, e->pixels, e->nb_pixels);
+		return;
+	}
+
+	size = gtk_databox_graph_get_size(graph);
+	if (size <= 1) {
+		gdk_draw_points(pixmap, gc, e->pixels, e->nb_pixels);
+		return;
+	}
+	for (i = 0; i < e->nb_pixels; i++)
+		gdk_draw_rectangle(pixmap, gc, TRUE,
+				e->pixels[i].x - size / 2,
+				e->pixels[i].y - size / 2, size, size);
+}
+
+static GdkGC * envelope_create_gc(GtkDataboxGraph *graph, GtkDatabox *box)
+{
+	GdkGC *gc;
+	GdkGCValues values;
+
+	gc = GTK_DATABOX_GRAPH_CLASS(envelope_parent_class)->create_gc(graph, box);
+	if (gc && !ENVELOPE(graph)->points) {
+		gdk_gc_get_values(gc, &values);
+		values.line_width = gtk_databox_graph_get_size(graph);
+		gdk_gc_set_values(gc, &values, GDK_GC_LINE_WIDTH);
+	}
+
+	return gc;
+}
+
+static gint envelope_calculate_extrema(GtkDataboxGraph *graph,
+		gfloat *min_x, gfloat *max_x, gfloat *min_y, gfloat *max_y)
+{
+	Envelope *e = ENVELOPE(graph);
+	guint i;
+
+	if (!e->len)
+		return -1;
+
+	*min_x = e->X[0];
+	*max_x = e->X[e->len - 1];
+	*min_y = *max_y = e->Y[0];
+	for (i = 1; i < e->len; i++) {
+		if (e->Y[i] < *min_y)
+			*min_y = e->Y[i];
+		else if (e->Y[i] > *max_y)
+			*max_y = e->Y[i];
+	}
+
+	return 0;
+}
+
+static void envelope_finalize(GObject *obj)
+{
+	g_free(ENVELOPE(obj)->pixels);
+
+	G_OBJECT_CLASS(envelope_parent_class)->finalize(obj);
+}
+
+static void envelope_class_init(EnvelopeClass *klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+	GtkDataboxGraphClass *graph_class = GTK_DATABOX_GRAPH_CLASS(klass);
+
+	gobject_class->finalize = envelope_finalize;
+	graph_class->draw = envelope_draw;
+	graph_class->create_gc = envelope_create_gc;
+	graph_class->calculate_extrema = envelope_calculate_extrema;
+}
+
+static void envelope_init(Envelope *e)
+{
+}
+
+GtkDataboxGraph * envelope_new(guint len, gfloat *X, gfloat *Y,
+		GdkColor *color, gint size, gboolean points)
+{
+	GtkDataboxGraph *graph = g_object_new(ENVELOPE_TYPE, NULL);
+	Envelope *e = ENVELOPE(graph);
+
+	e->len = len;
+	e->X = X;
+	e->Y = Y;
+	e->points = points;
+	gtk_databox_graph_set_color(graph, color);
+	gtk_databox_graph_set_size(graph, size);
+
+	return graph;
+}
+
+void envelope_invalidate(GtkDataboxGraph *graph)
+{
+	ENVELOPE(graph)->valid = false;
+}
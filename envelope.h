@@ -0,0 +1,30 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __ENVELOPE_H__
+#define __ENVELOPE_H__
+
+#include <gtkdatabox_graph.h>
+
+/*
+ * Databox graph drawing @len points like the lines graph (or the points
+ * graph if @points is set), but decimated for the screen first: when there
+ * are more visible samples than pixel columns, each column only gets the
+ * minimum and the maximum of its samples, in the order they come, so that
+ * the envelope of the signal and its glitches are drawn as they would be
+ * at full resolution. The decimated points are only computed again when
+ * the visible limits, the size of the databox or the data change.
+ *
+ * @X must be increasing. The arrays are not copied and must outlive the
+ * graph, which is released with g_object_unref().
+ */
+GtkDataboxGraph * envelope_new(guint len, gfloat *X, gfloat *Y,
+		GdkColor *color, gint size, gboolean points);
+
+/* The values of the arrays changed since the graph was last drawn */
+void envelope_invalidate(GtkDataboxGraph *graph);
+
+#endif /* __ENVELOPE_H__ */
@@ -0,0 +1,374 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <glib.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fft_plan.h"
+
+/*
+ * The FFTW planner is not thread-safe, so every planner call is made with
+ * planner_lock held. A new plan is taken from the wisdom when a better one
+ * was measured before for the same problem, and made with FFTW_ESTIMATE
+ * otherwise. In that case the planner thread measures it on its own arrays
+ * and the measured plan replaces the estimated one the next time the
+ * transform is executed. The wisdom is kept in a file across sessions, so
+ * each size is only measured once. The double (fftw) and single (fftwf)
+ * precision libraries have separate wisdom.
+ *
+ * The planner thread measures in slices of FFT_PLAN_SLICE seconds and
+ * releases the lock between them, so a new plan waits at most one slice to
+ * get its estimated plan. The subproblems solved in a slice are kept in the
+ * wisdom, so the next slice goes on where it stopped, until a slice
+ * completes or FFT_PLAN_TIME_LIMIT is reached. Released plans are handed
+ * over to the planner thread when it is busy.
+ */
+#define FFT_PLAN_TIME_LIMIT 5.0 /* seconds */
+#define FFT_PLAN_SLICE 0.1 /* seconds */
+
+struct fft_plan {
+	enum fft_plan_type type;
+	int n;
+	gpointer plan;
+	gpointer measured;
+	gint refcount;
+};
+
+static const struct {
+	const char *name;
+	unsigned int flags;
+} fft_rigors[] = {
+	{ "estimate", FFTW_ESTIMATE },
+	{ "measure", FFTW_MEASURE },
+	{ "patient", FFTW_PATIENT },
+};
+
+static GMutex planner_lock;
+static GThreadPool *planner_pool;
+static unsigned int planner_rigor = FFTW_MEASURE;
+static gint planner_stop;
+static bool use_double;
+static bool wisdom_changed;
+
+static bool fft_plan_is_single(enum fft_plan_type type)
+{
+	return type == FFT_PLAN_R2C_F || type == FFT_PLAN_FORWARD_F;
+}
+
+static gchar * fft_wisdom_file_name(const char *name)
+{
+	return g_build_filename(getenv("HOME") ?: getenv("LOCALAPPDATA"),
+			name, NULL);
+}
+
+/* Called with planner_lock held */
+static gpointer fft_plan_create(enum fft_plan_type type, int n,
+		void *in, void *out, unsigned int flags)
+{
+	switch (type) {
+	case FFT_PLAN_R2C:
+		return fftw_plan_dft_r2c_1d(n, in, out, flags);
+	case FFT_PLAN_FORWARD:
+		return fftw_plan_dft_1d(n, in, out, FFTW_FORWARD, flags);
+	case FFT_PLAN_BACKWARD:
+		return fftw_plan_dft_1d(n, in, out, FFTW_BACKWARD, flags);
+	case FFT_PLAN_R2C_F:
+		return fftwf_plan_dft_r2c_1d(n, in, out, flags);
+	default:
+		return fftwf_plan_dft_1d(n, in, out, FFTW_FORWARD, flags);
+	}
+}
+
+/* Called with planner_lock held */
+static void fft_plan_destroy_one(enum fft_plan_type type, gpointer plan)
+{
+	if (fft_plan_is_single(type))
+		fftwf_destroy_plan(plan);
+	else
+		fftw_destroy_plan(plan);
+}
+
+/* Called with planner_lock held */
+static void fft_plan_destroy(struct fft_plan *p)
+{
+	if (p->measured && p->measured != p->plan)
+		fft_plan_destroy_one(p->type, p->measured);
+	fft_plan_destroy_one(p->type, p->plan);
+	g_free(p);
+}
+
+static void fft_plan_measure(struct fft_plan *p)
+{
+	bool single = fft_plan_is_single(p->type);
+	size_t in_size, out_size;
+	gpointer plan, complete, best = NULL;
+	gint64 deadline;
+	void *in, *out;
+
+	if (single) {
+		out_size = sizeof(fftwf_complex);
+		in_size = p->type == FFT_PLAN_R2C_F ? sizeof(float) : out_size;
+	} else {
+		out_size = sizeof(fftw_complex);
+		in_size = p->type == FFT_PLAN_R2C ? sizeof(double) : out_size;
+	}
+
+	/* Measuring overwrites the arrays, the ones in use can't be used.
+	 * fftw_malloc() gives the same alignment as fftwf_malloc(). */
+	in = fftw_malloc(in_size * p->n);
+	out = fftw_malloc(out_size * p->n);
+	if (!in || !out)
+		goto out_free;
+
+	deadline = g_get_monotonic_time() +
+		(gint64) (FFT_PLAN_TIME_LIMIT * G_USEC_PER_SEC);
+	do {
+		g_mutex_lock(&planner_lock);
+		plan = fft_plan_create(p->type, p->n, in, out, planner_rigor);
+		wisdom_changed = true;
+
+		/* The slice was long enough to plan without cutting corners */
+		complete = fft_plan_create(p->type, p->n, in, out,
+				planner_rigor | FFTW_WISDOM_ONLY);
+		if (complete) {
+			if (plan)
+				fft_plan_destroy_one(p->type, plan);
+			plan = complete;
+		}
+		if (plan && best)
+			fft_plan_destroy_one(p->type, best);
+		g_mutex_unlock(&planner_lock);
+
+		if (plan)
+			best = plan;
+		if (complete)
+			break;
+	} while (g_get_monotonic_time() < deadline &&
+			g_atomic_int_get(&p->refcount) > 1 &&
+			!g_atomic_int_get(&planner_stop));
+
+	if (best)
+		g_atomic_pointer_set(&p->measured, best);
+
+out_free:
+	fftw_free(in);
+	fftw_free(out);
+}
+
+static void fft_planner_func(gpointer data, gpointer user_data)
+{
+	struct fft_plan *p = data;
+
+	/* A plan released while the planner was busy */
+	if (g_atomic_int_get(&p->refcount) == 0) {
+		g_mutex_lock(&planner_lock);
+		fft_plan_destroy(p);
+		g_mutex_unlock(&planner_lock);
+		return;
+	}
+
+	/* Not worth measuring if nobody uses the plan anymore */
+	if (g_atomic_int_get(&p->refcount) > 1 &&
+			!g_atomic_int_get(&planner_stop))
+		fft_plan_measure(p);
+
+	fft_plan_free(p);
+}
+
+void fft_plan_init(void)
+{
+	gchar *path, *path_f;
+
+	if (planner_pool)
+		return;
+
+	path = fft_wisdom_file_name(FFT_WISDOM_FILE_NAME);
+	path_f = fft_wisdom_file_name(FFTF_WISDOM_FILE_NAME);
+	g_mutex_lock(&planner_lock);
+	/* No wisdom yet is not an error */
+	fftw_import_wisdom_from_filename(path);
+	fftwf_import_wisdom_from_filename(path_f);
+	fftw_set_timelimit(FFT_PLAN_SLICE);
+	fftwf_set_timelimit(FFT_PLAN_SLICE);
+	g_mutex_unlock(&planner_lock);
+	g_free(path);
+	g_free(path_f);
+
+	g_atomic_int_set(&planner_stop, FALSE);
+	planner_pool = g_thread_pool_new(fft_planner_func,
+			NULL, 1, FALSE, NULL);
+}
+
+void fft_plan_exit(void)
+{
+	gchar *path, *path_f;
+
+	if (!planner_pool)
+		return;
+
+	/* Pending measurements are skipped, the running one completes */
+	g_atomic_int_set(&planner_stop, TRUE);
+	g_thread_pool_free(planner_pool, FALSE, TRUE);
+	planner_pool = NULL;
+
+	if (!wisdom_changed)
+		return;
+
+	path = fft_wisdom_file_name(FFT_WISDOM_FILE_NAME);
+	path_f = fft_wisdom_file_name(FFTF_WISDOM_FILE_NAME);
+	if (!fftw_export_wisdom_to_filename(path))
+		fprintf(stderr, "Unable to save the FFTW wisdom to %s\n", path);
+	else if (!fftwf_export_wisdom_to_filename(path_f))
+		fprintf(stderr, "Unable to save the FFTW wisdom to %s\n", path_f);
+	else
+		wisdom_changed = false;
+	g_free(path);
+	g_free(path_f);
+}
+
+int fft_plan_set_rigor(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(fft_rigors); i++) {
+		if (!strcmp(name, fft_rigors[i].name)) {
+			planner_rigor = fft_rigors[i].flags;
+			return 0;
+		}
+	}
+
+	fprintf(stderr, "Unknown FFTW planning rigor: %s\n", name);
+	return -EINVAL;
+}
+
+const char * fft_plan_get_rigor(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(fft_rigors); i++)
+		if (fft_rigors[i].flags == planner_rigor)
+			return fft_rigors[i].name;
+
+	return NULL;
+}
+
+void fft_plan_set_double(bool enable)
+{
+	use_double = enable;
+}
+
+bool fft_plan_get_double(void)
+{
+	return use_double;
+}
+
+unsigned int fft_plan_good_size(unsigned int n)
+{
+	static const unsigned int primes[] = { 2, 3, 5, 7 };
+	unsigned int size, rest, i;
+
+	for (size = MAX(n, 1); ; size++) {
+		rest = size;
+		for (i = 0; i < G_N_ELEMENTS(primes); i++)
+			while (rest % primes[i] == 0)
+				rest /= primes[i];
+		if (rest == 1)
+			return size;
+	}
+}
+
+struct fft_plan * fft_plan_new(enum fft_plan_type type, int n,
+		void *in, void *out)
+{
+	bool measure = planner_rigor != FFTW_ESTIMATE && planner_pool;
+	struct fft_plan *p;
+	gpointer plan = NULL;
+
+	/* Held at most for one slice of a measurement */
+	g_mutex_lock(&planner_lock);
+	if (measure) {
+		plan = fft_plan_create(type, n, in, out,
+				planner_rigor | FFTW_WISDOM_ONLY);
+		if (plan)
+			measure = false;
+	}
+	if (!plan)
+		plan = fft_plan_create(type, n, in, out, FFTW_ESTIMATE);
+	g_mutex_unlock(&planner_lock);
+
+	if (!plan)
+		return NULL;
+
+	p = g_new0(struct fft_plan, 1);
+	p->type = type;
+	p->n = n;
+	p->plan = plan;
+	p->refcount = 1;
+
+	if (measure) {
+		g_atomic_int_inc(&p->refcount);
+		g_thread_pool_push(planner_pool, p, NULL);
+	}
+
+	return p;
+}
+
+void fft_plan_free(struct fft_plan *p)
+{
+	if (!p || !g_atomic_int_dec_and_test(&p->refcount))
+		return;
+
+	if (!g_mutex_trylock(&planner_lock)) {
+		if (planner_pool) {
+			g_thread_pool_push(planner_pool, p, NULL);
+			return;
+		}
+		g_mutex_lock(&planner_lock);
+	}
+
+	fft_plan_destroy(p);
+	g_mutex_unlock(&planner_lock);
+}
+
+void fft_plan_update(struct fft_plan *p)
+{
+	gpointer measured = g_atomic_pointer_get(&p->measured);
+
+	if (measured && measured != p->plan &&
+			g_mutex_trylock(&planner_lock)) {
+		fft_plan_destroy_one(p->type, p->plan);
+		p->plan = measured;
+		g_mutex_unlock(&planner_lock);
+	}
+}
+
+void fft_plan_execute(struct fft_plan *p, void *in, void *out)
+{
+	fft_plan_update(p);
+	fft_plan_execute_shared(p, in, out);
+}
+
+void fft_plan_execute_shared(struct fft_plan *p, void *in, void *out)
+{
+	switch (p->type) {
+	case FFT_PLAN_R2C:
+		fftw_execute_dft_r2c(p->plan, in, out);
+		break;
+	case FFT_PLAN_R2C_F:
+		fftwf_execute_dft_r2c(p->plan, in, out);
+		break;
+	case FFT_PLAN_FORWARD_F:
+		fftwf_execute_dft(p->plan, in, out);
+		break;
+	default:
+		fftw_execute_dft(p->plan, in, out);
+		break;
+	}
+}
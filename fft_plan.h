@@ -0,0 +1,67 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __FFT_PLAN_H__
+#define __FFT_PLAN_H__
+
+#include <fftw3.h>
+
+#include <stdbool.h>
+
+#define FFT_WISDOM_FILE_NAME ".osc_fftw_wisdom"
+#define FFTF_WISDOM_FILE_NAME ".osc_fftwf_wisdom"
+
+enum fft_plan_type {
+	FFT_PLAN_R2C,
+	FFT_PLAN_FORWARD,
+	FFT_PLAN_BACKWARD,
+	/* Single precision (fftwf) */
+	FFT_PLAN_R2C_F,
+	FFT_PLAN_FORWARD_F,
+};
+
+struct fft_plan;
+
+/* Load the wisdom and start the background planner */
+void fft_plan_init(void);
+/* Stop the background planner and save the wisdom */
+void fft_plan_exit(void);
+
+/* "estimate", "measure" or "patient" */
+int fft_plan_set_rigor(const char *name);
+const char * fft_plan_get_rigor(void);
+
+/* Whether the spectrum transforms use double precision plans rather than
+ * single precision ones; off by default */
+void fft_plan_set_double(bool enable);
+bool fft_plan_get_double(void);
+
+/* Smallest size >= @n that only has 2, 3, 5 and 7 as prime factors, which
+ * FFTW transforms much faster than sizes with large prime factors */
+unsigned int fft_plan_good_size(unsigned int n);
+
+/*
+ * Plan a 1-D transform of size @n, from @in (double or float for the R2C
+ * types, fftw_complex or fftwf_complex otherwise) to @out. The arrays are
+ * not modified, and must be allocated with fftw_malloc() or fftwf_malloc().
+ * Without wisdom for the size, an estimated plan is returned right away and
+ * replaced by a measured one later. Returns NULL only if FFTW fails.
+ */
+struct fft_plan * fft_plan_new(enum fft_plan_type type, int n,
+		void *in, void *out);
+void fft_plan_free(struct fft_plan *p);
+
+/* Run the transform on @in and @out, which must be aligned as the arrays
+ * the plan was made for */
+void fft_plan_execute(struct fft_plan *p, void *in, void *out);
+
+/* fft_plan_execute() first swaps in the measured plan once it is ready.
+ * To run @p from several threads at once, call fft_plan_update() when no
+ * one is using it, then fft_plan_execute_shared(), which keeps the plan. */
+void fft_plan_update(struct fft_plan *p);
+void fft_plan_execute_shared(struct fft_plan *p, void *in, void *out);
+
+#endif /* __FFT_PLAN_H__ */
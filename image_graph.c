@@ -0,0 +1,103 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <glib.h>
+#include <gtk/gtk.h>
+#include <gtkdatabox.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "image_graph.h"
+
+void image_graph_colormap(guchar *map, unsigned int nb_colors,
+		unsigned int bpp, const guchar (*stops)[3], unsigned int nb_stops)
+{
+	unsigned int i, c, nb_steps = nb_stops - 1;
+
+	for (i = 0; i < nb_colors; i++, map += bpp) {
+		double pos = (double) i * nb_steps / (nb_colors - 1);
+		unsigned int s = MIN((unsigned int) pos, nb_steps - 1);
+		double frac = pos - s;
+
+		for (c = 0; c < 3; c++)
+			map[c] = (guchar) (stops[s][c] +
+				frac * (stops[s + 1][c] - stops[s][c]) + 0.5);
+		if (bpp > 3)
+			map[3] = 255;
+	}
+}
+
+int image_frame_reserve(struct image_frame *f, gint width, gint height)
+{
+	if (f->pixbuf && gdk_pixbuf_get_width(f->pixbuf) >= width &&
+			gdk_pixbuf_get_height(f->pixbuf) >= height)
+		return 0;
+
+	if (f->pixbuf)
+		g_object_unref(f->pixbuf);
+	f->pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, f->bpp > 3, 8,
+			width, height);
+	f->columns = g_renew(unsigned int, f->columns, width);
+
+	return f->pixbuf ? 1 : -ENOMEM;
+}
+
+void image_frame_free(struct image_frame *f)
+{
+	g_free(f->columns);
+	f->columns = NULL;
+	if (f->pixbuf)
+		g_object_unref(f->pixbuf);
+	f->pixbuf = NULL;
+}
+
+void image_frame_map_columns(struct image_frame *f, GtkDatabox *box,
+		gint x0, gint w, gfloat origin, gfloat scale,
+		unsigned int nb_bins)
+{
+	gint px;
+
+	for (px = 0; px < w; px++) {
+		gint bin = (gint) floorf((gtk_databox_pixel_to_value_x(box,
+				x0 + px) - origin) * scale);
+
+		f->columns[px] = f->bpp * CLAMP(bin, 0, (gint) nb_bins - 1);
+	}
+}
+
+void image_frame_render(struct image_frame *f, gint from, gint to, gint w,
+		image_row_fn row_of, gpointer data)
+{
+	guchar *pixels = gdk_pixbuf_get_pixels(f->pixbuf);
+	int rowstride = gdk_pixbuf_get_rowstride(f->pixbuf);
+	const guchar *src, *last = NULL;
+	gint py, px;
+
+	for (py = from; py < to; py++) {
+		guchar *dst = pixels + py * rowstride;
+
+		src = row_of(py, data);
+		if (src == last) {
+			memcpy(dst, dst - rowstride, f->bpp * w);
+			continue;
+		}
+		last = src;
+
+		if (f->bpp == 4) {
+			for (px = 0; px < w; px++)
+				memcpy(dst + 4 * px, src + f->columns[px], 4);
+			continue;
+		}
+		for (px = 0; px < w; px++) {
+			const guchar *color = src + f->columns[px];
+
+			dst[3 * px] = color[0];
+			dst[3 * px + 1] = color[1];
+			dst[3 * px + 2] = color[2];
+		}
+	}
+}
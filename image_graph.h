@@ -0,0 +1,53 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __IMAGE_GRAPH_H__
+#define __IMAGE_GRAPH_H__
+
+#include <glib.h>
+#include <gtk/gtk.h>
+#include <gtkdatabox.h>
+
+/*
+ * Helpers for the databox graphs drawn as one image (waterfall, density):
+ * the data is kept as rows of color-mapped bins, and resampled to an image
+ * sized for the databox, which is drawn with a single gdk_draw_pixbuf().
+ */
+
+/* Fill @map with @nb_colors colors of @bpp bytes (3 or 4), linearly
+ * interpolated between @nb_stops RGB stops; the alpha byte is opaque */
+void image_graph_colormap(guchar *map, unsigned int nb_colors,
+		unsigned int bpp, const guchar (*stops)[3], unsigned int nb_stops);
+
+struct image_frame {
+	GdkPixbuf *pixbuf;
+	/* Bytes per pixel, 4 with an alpha channel */
+	unsigned int bpp;
+	/* Offset in a source row of the bin shown by each column */
+	unsigned int *columns;
+};
+
+/* Make the frame at least @width x @height pixels. Returns 1 if it was
+ * reallocated and its content is lost, 0 if it was kept, or -ENOMEM. */
+int image_frame_reserve(struct image_frame *f, gint width, gint height);
+void image_frame_free(struct image_frame *f);
+
+/* The columns from pixel @x0 on, @w of them, show bin
+ * floor((x - @origin) * @scale) of the @nb_bins of a row, x being their
+ * value on the x axis of @box */
+void image_frame_map_columns(struct image_frame *f, GtkDatabox *box,
+		gint x0, gint w, gfloat origin, gfloat scale,
+		unsigned int nb_bins);
+
+/* Source row to show on pixel row @py; pixel rows showing the same row as
+ * the previous one are copies of it */
+typedef const guchar * (*image_row_fn)(gint py, gpointer data);
+
+/* Render the pixel rows @from to @to of the frame, @w pixels wide */
+void image_frame_render(struct image_frame *f, gint from, gint to, gint w,
+		image_row_fn row_of, gpointer data);
+
+#endif /* __IMAGE_GRAPH_H__ */
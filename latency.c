@@ -0,0 +1,93 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <glib.h>
+
+#include "latency.h"
+
+/*
+ * Buckets 0 to 3 hold 0 to 3 us. Above that, each power of two is split
+ * in 4 buckets, which bounds the error of a percentile to 25%.
+ */
+static unsigned int latency_bucket(gint64 us)
+{
+	unsigned int octave;
+
+	if (us < 4)
+		return us < 0 ? 0 : (unsigned int) us;
+	if (us >= (gint64) 1 << 25)
+		return LATENCY_BUCKETS - 1;
+
+	octave = 63 - __builtin_clzll((unsigned long long) us);
+	return 4 + (octave - 2) * 4 + ((us >> (octave - 2)) & 3);
+}
+
+static gint64 latency_bucket_upper(unsigned int bucket)
+{
+	unsigned int octave, sub;
+
+	if (bucket < 4)
+		return bucket;
+
+	octave = (bucket - 4) / 4 + 2;
+	sub = (bucket - 4) % 4;
+	return ((gint64) (5 + sub) << (octave - 2)) - 1;
+}
+
+void latency_hist_add(struct latency_hist *hist, gint64 start)
+{
+	gint64 us = g_get_monotonic_time() - start;
+	gint max;
+
+	g_atomic_int_inc(&hist->buckets[latency_bucket(us)]);
+	g_atomic_int_inc(&hist->count);
+
+	if (us > G_MAXINT)
+		us = G_MAXINT;
+	do {
+		max = g_atomic_int_get(&hist->max);
+	} while (us > max && !g_atomic_int_compare_and_exchange(&hist->max,
+				max, (gint) us));
+}
+
+static gint64 latency_hist_percentile(const struct latency_hist *hist,
+		unsigned int count, unsigned int percent)
+{
+	unsigned int i, seen = 0;
+	unsigned int rank = (count * percent + 99) / 100;
+
+	for (i = 0; i < LATENCY_BUCKETS; i++) {
+		seen += g_atomic_int_get(&hist->buckets[i]);
+		if (seen >= rank)
+			return MIN(latency_bucket_upper(i),
+					g_atomic_int_get(&hist->max));
+	}
+
+	return g_atomic_int_get(&hist->max);
+}
+
+void latency_hist_get(const struct latency_hist *hist,
+		struct latency_stats *stats)
+{
+	stats->count = g_atomic_int_get(&hist->count);
+	stats->max = g_atomic_int_get(&hist->max);
+	if (!stats->count) {
+		stats->p50 = stats->p99 = 0;
+		return;
+	}
+
+	stats->p50 = latency_hist_percentile(hist, stats->count, 50);
+	stats->p99 = latency_hist_percentile(hist, stats->count, 99);
+}
+
+void latency_stats_append(GString *str, const char *name,
+		const struct latency_stats *stats)
+{
+	g_string_append_printf(str,
+			"%-24s %8u  p50 %9.3f ms  p99 %9.3f ms  max %9.3f ms\n",
+			name, stats->count, stats->p50 / 1000.0,
+			stats->p99 / 1000.0, stats->max / 1000.0);
+}
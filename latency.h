@@ -0,0 +1,44 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+#include <glib.h>
+
+/* Exact up to 4 us, then 4 buckets per power of two up to ~33 s */
+#define LATENCY_BUCKETS 100
+
+struct latency_hist {
+	gint buckets[LATENCY_BUCKETS];
+	gint count;
+	gint max;
+};
+
+/* All times in microseconds */
+struct latency_stats {
+	unsigned int count;
+	gint64 p50;
+	gint64 p99;
+	gint64 max;
+};
+
+/* Timestamps come from g_get_monotonic_time() */
+static inline gint64 latency_start(void)
+{
+	return g_get_monotonic_time();
+}
+
+/* Account the time elapsed since @start; safe against concurrent calls */
+void latency_hist_add(struct latency_hist *hist, gint64 start);
+void latency_hist_get(const struct latency_hist *hist,
+		struct latency_stats *stats);
+
+/* Append one line with the count, p50, p99 and max of @stats */
+void latency_stats_append(GString *str, const char *name,
+		const struct latency_stats *stats);
+
+#endif /* __LATENCY_H__ */
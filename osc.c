@@ -29,11 +29,21 @@
 #include "osc.h"
 #include "datatypes.h"
 #include "int_fft.h"
+#include "demux.h"
+#include "segbuf.h"
+#include "record.h"
+#include "fft_plan.h"
 #include "config.h"
 #include "osc_plugin.h"
 
 extern void math_expression_objects_clean(void);
 
+/* Captures in a row with an oversized buffer before it gets shrunk */
+#define RX_BUFFER_SHRINK_HOLDOFF 16
+
+/* Longer captures are acquired in several refills of this many samples */
+#define CAPTURE_REFILL_MAX (1 << 21)
+
 GSList *plugin_list = NULL;
 
 gint capture_function = 0;
@@ -41,6 +51,15 @@ static GList *plot_list = NULL;
 static int num_capturing_plots;
 G_LOCK_DEFINE_STATIC(buffer_full);
 static gboolean stop_capture;
+static gint frames_pending;
+static gint capture_failed;
+static GMutex capture_sync_lock;
+static GCond capture_sync_cond;
+static unsigned int capture_sync_waiting;
+static unsigned int capture_sync_absent;
+static guint capture_cycle;
+static unsigned int kernel_buffers_count;
+static char *latency_dump_file;
 static struct plugin_check_fct *setup_check_functions = NULL;
 static int num_check_fcts = 0;
 static GSList *dplugin_list = NULL;
@@ -59,6 +78,10 @@ static void plugin_restore_ini_state(const char *plugin_name,
 static void plot_init(GtkWidget *plot);
 static void plot_destroyed_cb(OscPlot *plot);
 static void capture_profile_save(const char *filename);
+static void capture_threads_join(void);
+static void capture_frames_destroy(struct iio_device *dev);
+static void rx_buffer_destroy(struct iio_device *dev);
+static void rx_buffer_stats_print(void);
 static void load_profile(const char *filename, bool load_plugins);
 
 static char * dma_devices[] = {
@@ -180,14 +203,14 @@ static void gfunc_destroy_plot(gpointer data, gpointer user_data)
 	osc_plot_destroy(OSC_PLOT(plot));
 }
 
-static void update_plot(struct iio_buffer *buf)
+static void update_plot(struct iio_device *dev)
 {
 	GList *node;
 
 	for (node = plot_list; node; node = g_list_next(node)) {
 		OscPlot *plot = (OscPlot *) node->data;
 
-		if (osc_plot_get_buffer(plot) == buf) {
+		if (osc_plot_get_device(plot) == dev) {
 			osc_plot_data_update(plot);
 		}
 	}
@@ -219,13 +242,18 @@ static void close_active_buffers(void)
 {
 	unsigned int i;
 
+	capture_threads_join();
+
 	for (i = 0; i < num_devices; i++) {
 		struct iio_device *dev = iio_context_get_device(ctx, i);
-		struct extra_dev_info *info = iio_device_get_data(dev);
-		if (info->buffer) {
-			iio_buffer_destroy(info->buffer);
-			info->buffer = NULL;
-		}
+		struct extra_dev_info *dev_info = iio_device_get_data(dev);
+
+		/* The recorder owns the device until it is stopped */
+		if (dev_info->recorder)
+			continue;
+
+		rx_buffer_destroy(dev);
+		capture_frames_destroy(dev);
 
 		disable_all_channels(dev);
 	}
@@ -469,6 +497,56 @@ gdouble plugin_get_plot_fft_avg(OscPlot *plot, const char *device)
 	return osc_plot_get_fft_avg(plot);
 }
 
+int plugin_get_capture_latency(const char *device, int stage,
+		struct latency_stats *stats)
+{
+	struct extra_dev_info *info;
+	struct iio_device *dev;
+
+	if (!device || !stats || stage < 0 || stage >= CAPTURE_STAGES_COUNT)
+		return -EINVAL;
+
+	dev = iio_context_find_device(ctx, device);
+	if (!dev || !is_input_device(dev))
+		return -ENODEV;
+
+	info = iio_device_get_data(dev);
+	latency_hist_get(&info->capture_latency[stage], stats);
+	return 0;
+}
+
+int plugin_get_capture_counters(const char *device,
+		unsigned int *resizes, unsigned int *busy)
+{
+	struct extra_dev_info *info;
+	struct iio_device *dev;
+
+	if (!device)
+		return -EINVAL;
+
+	dev = iio_context_find_device(ctx, device);
+	if (!dev || !is_input_device(dev))
+		return -ENODEV;
+
+	info = iio_device_get_data(dev);
+	if (resizes)
+		*resizes = info->buffer_events[RX_BUFFER_GROW] +
+			info->buffer_events[RX_BUFFER_SHRINK];
+	if (busy)
+		*busy = g_atomic_int_get(&info->frames_busy);
+	return 0;
+}
+
+int plugin_get_plot_latency(OscPlot *plot, int stage, int transform_type,
+		struct latency_stats *stats)
+{
+	if (!plot || !stats)
+		return -EINVAL;
+
+	return osc_plot_get_latency(plot, stage, transform_type, stats) ?
+		0 : -EINVAL;
+}
+
 int plugin_data_capture_size(const char *device)
 {
 	struct extra_dev_info *info;
@@ -951,70 +1029,76 @@ static void plugin_state_ini_save(gpointer data, gpointer user_data)
 	}
 }
 
-static ssize_t demux_sample(const struct iio_channel *chn,
-		void *sample, size_t size, void *d)
+/* Whether there is an edge between samples @a and @b of @sb */
+static bool edge_between(const struct segbuf *sb, enum demux_sample_type type,
+		size_t a, size_t b, gfloat level, bool falling_edge)
 {
-	struct extra_info *info = iio_channel_get_data(chn);
-	struct extra_dev_info *dev_info = iio_device_get_data(info->dev);
-	const struct iio_data_format *format = iio_channel_get_data_format(chn);
-
-	/* Prevent buffer overflow */
-	if (info->offset == dev_info->sample_count)
-		return 0;
+	size_t size = DEMUX_SAMPLE_SIZE(type);
+	char pair[2 * sizeof(gfloat)];
 
-	if (size == 1) {
-		int8_t val;
-		iio_channel_convert(chn, &val, sample);
-		if (format->is_signed)
-			*(info->data_ref + info->offset++) = (gfloat) val;
-		else
-			*(info->data_ref + info->offset++) = (gfloat) (uint8_t)val;
-	} else if (size == 2) {
-		int16_t val;
-		iio_channel_convert(chn, &val, sample);
-		if (format->is_signed)
-			*(info->data_ref + info->offset++) = (gfloat) val;
-		else
-			*(info->data_ref + info->offset++) = (gfloat) (uint16_t)val;
-	} else {
-		int32_t val;
-		iio_channel_convert(chn, &val, sample);
-		if (format->is_signed)
-			*(info->data_ref + info->offset++) = (gfloat) val;
-		else
-			*(info->data_ref + info->offset++) = (gfloat) (uint32_t)val;
-	}
-
-	return size;
+	memcpy(pair, segbuf_chunk(sb, a, NULL), size);
+	memcpy(pair + size, segbuf_chunk(sb, b, NULL), size);
+	return !!demux_find_first_edge(pair, type, 1, 2, level, falling_edge);
 }
 
-static off_t get_trigger_offset(const struct iio_channel *chn,
-		bool falling_edge, float trigger_value)
+/* Same as demux_find_first_edge(), on samples stored in segments: returns
+ * the first edge in ]lo, hi], or 0 */
+static size_t find_first_edge(const struct segbuf *sb,
+		enum demux_sample_type type, size_t lo, size_t hi,
+		gfloat level, bool falling_edge)
 {
-	struct extra_info *info = iio_channel_get_data(chn);
-	size_t i;
+	size_t seg_length = segbuf_segment_length(sb);
+	size_t first, last, i;
 
-	if (iio_channel_is_enabled(chn)) {
-		for (i = info->offset / 2; i >= 1; i--) {
-			if (!falling_edge && info->data_ref[i - 1] < trigger_value &&
-					info->data_ref[i] >= trigger_value)
-				return i * sizeof(gfloat);
-			if (falling_edge && info->data_ref[i - 1] >= trigger_value &&
-					info->data_ref[i] < trigger_value)
-				return i * sizeof(gfloat);
+	while (lo < hi) {
+		first = lo - lo % seg_length;
+		last = MIN(first + seg_length - 1, hi);
+		if (lo < last) {
+			i = demux_find_first_edge(segbuf_chunk(sb, first, NULL),
+					type, lo + 1 - first, last + 1 - first,
+					level, falling_edge);
+			if (i)
+				return first + i;
 		}
+		if (last == hi)
+			break;
+
+		/* Crossing between the last sample of this segment and the
+		 * first one of the next segment */
+		if (edge_between(sb, type, last, last + 1,
+					level, falling_edge))
+			return last + 1;
+
+		lo = last + 1;
 	}
+
 	return 0;
 }
 
-static void apply_trigger_offset(const struct iio_channel *chn, off_t offset)
+/* Returns the first edge in ]from, to] of a ring buffer, where positions
+ * count the samples written since the ring was reset, or 0 */
+static guint64 ring_find_edge(const struct segbuf *sb,
+		enum demux_sample_type type, guint64 from, guint64 to,
+		gfloat level, bool falling_edge)
 {
-	if (offset) {
-		struct extra_info *info = iio_channel_get_data(chn);
+	size_t length = segbuf_length(sb);
+	size_t lo = from % length, hi = to % length, e;
+	guint64 base = from - lo;
 
-		memmove(info->data_ref, (void *) info->data_ref + offset,
-				info->offset * sizeof(gfloat) - offset);
+	if (hi < lo) {
+		/* The range wraps around the end of the ring */
+		e = find_first_edge(sb, type, lo, length - 1,
+				level, falling_edge);
+		if (e)
+			return base + e;
+		if (edge_between(sb, type, length - 1, 0, level, falling_edge))
+			return base + length;
+		e = find_first_edge(sb, type, 0, hi, level, falling_edge);
+		return e ? base + length + e : 0;
 	}
+
+	e = find_first_edge(sb, type, lo, hi, level, falling_edge);
+	return e ? base + e : 0;
 }
 
 static bool device_is_oneshot(struct iio_device *dev)
@@ -1027,297 +1111,1256 @@ static bool device_is_oneshot(struct iio_device *dev)
 	return false;
 }
 
-static gboolean capture_process(void)
+/*
+ * Frame handoff between the acquisition thread of a device (the only
+ * producer) and its readers. The producer fills a slot that is neither
+ * published nor held by a reader, then publishes it as the latest frame.
+ * Readers take a reference on the latest frame and only keep it if it is
+ * still the latest one after the reference was taken, so a slot can never
+ * be overwritten while it is being read. No locks are involved.
+ */
+static void capture_frame_free(struct capture_frame *frame,
+		unsigned int nb_channels)
 {
 	unsigned int i;
 
-	if (stop_capture == TRUE)
-		goto capture_stop_check;
+	if (!frame)
+		return;
 
-	for (i = 0; i < num_devices; i++) {
-		struct iio_device *dev = iio_context_get_device(ctx, i);
-		struct extra_dev_info *dev_info = iio_device_get_data(dev);
-		unsigned int i, sample_size = iio_device_get_sample_size(dev);
-		unsigned int nb_channels = iio_device_get_channels_count(dev);
-		unsigned int sample_count = dev_info->sample_count;
-		struct iio_channel *chn;
-		off_t offset = 0;
+	for (i = 0; i < nb_channels; i++)
+		segbuf_free(frame->channels_data[i]);
+	g_free(frame->channels_data);
+	g_free(frame);
+}
 
-		if (dev_info->input_device == false)
-			continue;
+/* Samples of the enabled channels are stored in their native width (see
+ * demux_channel_sample_type()), in segmented buffers */
+static struct capture_frame * capture_frame_new(struct iio_device *dev,
+		unsigned int sample_count)
+{
+	unsigned int i, nb_channels = iio_device_get_channels_count(dev);
+	struct capture_frame *frame;
 
-		if (sample_size == 0)
+	frame = g_new0(struct capture_frame, 1);
+	frame->channels_data = g_new0(struct segbuf *, nb_channels);
+	frame->sample_count = sample_count;
+
+	for (i = 0; i < nb_channels; i++) {
+		struct iio_channel *ch = iio_device_get_channel(dev, i);
+
+		if (!iio_channel_is_enabled(ch))
 			continue;
 
-		if (dev_info->buffer == NULL || device_is_oneshot(dev)) {
-			dev_info->buffer_size = sample_count;
-			dev_info->buffer = iio_device_create_buffer(dev,
-				sample_count, false);
-			if (!dev_info->buffer) {
-				fprintf(stderr, "Error: Unable to create buffer: %s\n", strerror(errno));
-				goto capture_stop_check;
-			}
+		frame->channels_data[i] = segbuf_new(sample_count,
+				DEMUX_SAMPLE_SIZE(demux_channel_sample_type(ch)),
+				false);
+		if (!frame->channels_data[i]) {
+			capture_frame_free(frame, nb_channels);
+			return NULL;
 		}
+	}
 
-		/* Reset the data offset for all channels */
-		for (i = 0; i < nb_channels; i++) {
-			struct iio_channel *ch = iio_device_get_channel(dev, i);
-			struct extra_info *info = iio_channel_get_data(ch);
-			info->offset = 0;
-		}
+	return frame;
+}
 
-		while (true) {
-			ssize_t ret = iio_buffer_refill(dev_info->buffer);
-			if (ret < 0) {
-				fprintf(stderr, "Error while reading data: %s\n", strerror(-ret));
-				stop_sampling();
-				goto capture_stop_check;
-			}
+static void capture_frames_destroy(struct iio_device *dev)
+{
+	struct extra_dev_info *dev_info = iio_device_get_data(dev);
+	unsigned int i, nb_channels = iio_device_get_channels_count(dev);
 
-			ret /= iio_buffer_step(dev_info->buffer);
-			if (ret >= sample_count) {
-				iio_buffer_foreach_sample(
-						dev_info->buffer, demux_sample, NULL);
-
-				if (ret >= sample_count * 2) {
-					printf("Decreasing buffer size\n");
-					iio_buffer_destroy(dev_info->buffer);
-					dev_info->buffer_size /= 2;
-					dev_info->buffer = iio_device_create_buffer(dev,
-							dev_info->buffer_size, false);
-				}
-				break;
-			}
+	dev_info->latest_frame = NULL;
+	dev_info->pending_frame = NULL;
+	dev_info->shown_frame = NULL;
+	for (i = 0; i < CAPTURE_FRAME_SLOTS; i++) {
+		capture_frame_free(dev_info->frames[i], nb_channels);
+		dev_info->frames[i] = NULL;
+	}
+	capture_frame_free(dev_info->ring, nb_channels);
+	dev_info->ring = NULL;
+}
 
-			printf("Increasing buffer size\n");
-			iio_buffer_destroy(dev_info->buffer);
-			dev_info->buffer_size *= 2;
-			dev_info->buffer = iio_device_create_buffer(dev,
-					dev_info->buffer_size, false);
-		}
+static int capture_frames_create(struct iio_device *dev,
+		unsigned int sample_count)
+{
+	struct extra_dev_info *dev_info = iio_device_get_data(dev);
+	unsigned int i;
 
-		if (dev_info->channel_trigger_enabled) {
-			chn = iio_device_get_channel(dev, dev_info->channel_trigger);
-			if (!iio_channel_is_enabled(chn))
-				dev_info->channel_trigger_enabled = false;
+	capture_frames_destroy(dev);
+	for (i = 0; i < CAPTURE_FRAME_SLOTS; i++) {
+		dev_info->frames[i] = capture_frame_new(dev, sample_count);
+		if (!dev_info->frames[i]) {
+			capture_frames_destroy(dev);
+			return -ENOMEM;
 		}
+	}
 
-		if (dev_info->channel_trigger_enabled) {
-			struct extra_info *info = iio_channel_get_data(chn);
-			offset = get_trigger_offset(chn, dev_info->trigger_falling_edge,
-					dev_info->trigger_value);
-			if (offset / sizeof(gfloat) < info->offset / 4) {
-				offset = 0;
-			} else if (offset) {
-				offset -= info->offset * sizeof(gfloat) / 4;
-				for (i = 0; i < nb_channels; i++) {
-					chn = iio_device_get_channel(dev, i);
-					if (iio_channel_is_enabled(chn))
-						apply_trigger_offset(chn, offset);
-				}
-			}
-		}
+	return 0;
+}
 
-		if (dev_info->channels_data_copy) {
-			for (i = 0; i < nb_channels; i++) {
-				struct iio_channel *ch = iio_device_get_channel(dev, i);
-				struct extra_info *info = iio_channel_get_data(ch);
-				memcpy(dev_info->channels_data_copy[i], info->data_ref,
-					sample_count * sizeof(gfloat));
-			}
-			dev_info->channels_data_copy = NULL;
-			G_UNLOCK(buffer_full);
-		}
+static struct capture_frame * capture_frame_get_free(
+		struct extra_dev_info *dev_info)
+{
+	struct capture_frame *latest = g_atomic_pointer_get(&dev_info->latest_frame);
+	unsigned int i;
 
-		if (device_is_oneshot(dev)) {
-			iio_buffer_destroy(dev_info->buffer);
-			dev_info->buffer = NULL;
-		}
+	for (i = 0; i < CAPTURE_FRAME_SLOTS; i++) {
+		struct capture_frame *frame = dev_info->frames[i];
 
-		if (!dev_info->channel_trigger_enabled || offset)
-			update_plot(dev_info->buffer);
+		if (frame && frame != latest &&
+				g_atomic_int_get(&frame->readers) == 0)
+			return frame;
 	}
 
-	update_plot(NULL);
-
-capture_stop_check:
-	if (stop_capture == TRUE)
-		capture_function = 0;
+	return NULL;
+}
 
-	return !stop_capture;
+static void capture_frame_publish(struct extra_dev_info *dev_info,
+		struct capture_frame *frame)
+{
+	frame->seq = ++dev_info->frame_seq;
+	g_atomic_pointer_set(&dev_info->latest_frame, frame);
 }
 
-static unsigned int max_sample_count_from_plots(struct extra_dev_info *info)
+static struct capture_frame * capture_frame_get_latest(
+		struct extra_dev_info *dev_info)
 {
-	unsigned int max_count = 0;
-	struct plot_params *prm;
-	GSList *node;
-	GSList *list = info->plots_sample_counts;
+	struct capture_frame *frame;
 
-	for (node = list; node; node = g_slist_next(node)) {
-		prm = node->data;
-		if (prm->sample_count > max_count)
-			max_count = prm->sample_count;
+	while (true) {
+		frame = g_atomic_pointer_get(&dev_info->latest_frame);
+		if (!frame)
+			return NULL;
+
+		g_atomic_int_inc(&frame->readers);
+		if (g_atomic_pointer_get(&dev_info->latest_frame) == frame)
+			return frame;
+
+		/* A newer frame was published meanwhile, try again */
+		g_atomic_int_add(&frame->readers, -1);
 	}
+}
 
-	return max_count;
+static void capture_frame_release(struct capture_frame *frame)
+{
+	g_atomic_int_add(&frame->readers, -1);
 }
 
-static double read_sampling_frequency(const struct iio_device *dev)
+/* Convert the samples of a channel, one segment at a time */
+static void capture_frame_to_float(const struct capture_frame *frame,
+		const struct iio_channel *ch, const struct segbuf *data,
+		gfloat *dst)
 {
-	double freq = 400.0;
-	int ret = -1;
-	unsigned int i, nb_channels = iio_device_get_channels_count(dev);
-	char buf[1024];
+	enum demux_sample_type type = demux_channel_sample_type(ch);
+	size_t i, len;
 
-	for (i = 0; i < nb_channels; i++) {
-		struct iio_channel *ch = iio_device_get_channel(dev, i);
+	for (i = 0; i < frame->sample_count; i += len, dst += len)
+		demux_to_float(dst, segbuf_chunk(data, i, &len), type, len);
+}
 
-		if (iio_channel_is_output(ch) || strncmp(iio_channel_get_id(ch),
-					"voltage", sizeof("voltage") - 1))
-			continue;
+/*
+ * The UI keeps a reference on the frame it shows. The transforms read it
+ * with osc_channel_read_float(), but math expressions take whole arrays:
+ * float views of the channels are allocated and converted when a math
+ * channel asks for them. A view is then reused until another frame is
+ * shown, and freed by capture_setup() once no plot uses the channel
+ * anymore.
+ */
+gfloat * osc_channel_get_float_data(struct iio_channel *ch)
+{
+	struct extra_info *info = iio_channel_get_data(ch);
+	struct extra_dev_info *dev_info;
+	struct capture_frame *frame;
+	gfloat *ref;
 
-		ret = iio_channel_attr_read(ch, "sampling_frequency",
-				buf, sizeof(buf));
-		if (ret > 0)
-			break;
-	}
+	if (!info || !iio_channel_is_enabled(ch))
+		return NULL;
 
-	if (ret < 0)
-		ret = iio_device_attr_read(dev, "sampling_frequency",
-				buf, sizeof(buf));
-	if (ret < 0) {
-		const struct iio_device *trigger;
-		ret = iio_device_get_trigger(dev, &trigger);
-		if (!ret)
-			ret = iio_device_attr_read(trigger, "frequency",
-					buf, sizeof(buf));
+	dev_info = iio_device_get_data(info->dev);
+	frame = dev_info->shown_frame;
+
+	/* Transforms running in parallel may share a channel */
+	g_mutex_lock(&info->data_ref_lock);
+	if (!info->data_buf && dev_info->sample_count) {
+		/* Plots need contiguous samples */
+		info->data_buf = segbuf_new(dev_info->sample_count,
+				sizeof(gfloat), true);
+		if (info->data_buf)
+			info->data_ref = segbuf_chunk(info->data_buf, 0, NULL);
+		info->data_ref_seq = 0;
 	}
+	if (info->data_ref && frame && info->shown_ref &&
+			info->data_ref_seq != frame->seq) {
+		capture_frame_to_float(frame, ch, info->shown_ref,
+				info->data_ref);
+		info->data_ref_seq = frame->seq;
+	}
+	ref = info->data_ref;
+	g_mutex_unlock(&info->data_ref_lock);
 
-	if (ret > 0)
-		sscanf(buf, "%lf", &freq);
+	return ref;
+}
 
-	if (freq < 0)
-		freq += 4294967296.0;
+/*
+ * Convert up to @len samples of the shown frame of a channel, from sample
+ * @pos, without going through its float view. Returns the number of
+ * samples converted, or -ENODATA if the channel wasn't captured.
+ */
+ssize_t osc_channel_read_float(struct iio_channel *ch, size_t pos,
+		gfloat *dst, size_t len)
+{
+	struct extra_info *info = iio_channel_get_data(ch);
+	enum demux_sample_type type = demux_channel_sample_type(ch);
+	struct extra_dev_info *dev_info;
+	struct capture_frame *frame;
+	size_t i, avail;
 
-	return freq;
+	if (!info || !info->shown_ref)
+		return -ENODATA;
+
+	dev_info = iio_device_get_data(info->dev);
+	frame = dev_info->shown_frame;
+	if (!frame || pos >= frame->sample_count)
+		return -ENODATA;
+
+	len = MIN(len, frame->sample_count - pos);
+	for (i = 0; i < len; i += avail) {
+		const void *src = segbuf_chunk(info->shown_ref, pos + i, &avail);
+
+		avail = MIN(avail, len - i);
+		demux_to_float(dst + i, src, type, avail);
+	}
+
+	return (ssize_t) len;
 }
 
-static int capture_setup(void)
+static gboolean capture_frames_dispatch(gpointer data)
 {
+	struct capture_frame **frames;
 	unsigned int i, j;
-	unsigned int min_timeout = 1000;
-	unsigned int timeout;
-	double freq;
 
+	g_atomic_int_set(&frames_pending, FALSE);
+
+	if (g_atomic_int_get(&capture_failed)) {
+		g_atomic_int_set(&capture_failed, FALSE);
+		stop_sampling();
+		return FALSE;
+	}
+
+	if (!ctx || stop_capture == TRUE)
+		return FALSE;
+
+	/* The frames of a capture cycle are published under the sync lock,
+	 * so taking the latest ones under it never splits a cycle: plots
+	 * using channels of several devices see simultaneous data. A device
+	 * that published nothing in the last cycle (its trigger didn't fire,
+	 * its buffer couldn't be created...) keeps showing its latest frame,
+	 * the others are shown without it. */
+	frames = g_new0(struct capture_frame *, num_devices);
+	g_mutex_lock(&capture_sync_lock);
 	for (i = 0; i < num_devices; i++) {
 		struct iio_device *dev = iio_context_get_device(ctx, i);
 		struct extra_dev_info *dev_info = iio_device_get_data(dev);
-		unsigned int nb_channels = iio_device_get_channels_count(dev);
-		unsigned int sample_size, sample_count = max_sample_count_from_plots(dev_info);
 
-		if (dev_info->channel_trigger_enabled)
-			sample_count *= 2;
+		if (dev_info->capture_thread)
+			frames[i] = capture_frame_get_latest(dev_info);
+	}
+	g_mutex_unlock(&capture_sync_lock);
 
-		for (j = 0; j < nb_channels; j++) {
-			struct iio_channel *ch = iio_device_get_channel(dev, j);
-			struct extra_info *info = iio_channel_get_data(ch);
-			if (info->shadow_of_enabled > 0)
-				iio_channel_enable(ch);
-			else
-				iio_channel_disable(ch);
-		}
+	for (i = 0; i < num_devices; i++) {
+		struct iio_device *dev = iio_context_get_device(ctx, i);
+		struct extra_dev_info *dev_info = iio_device_get_data(dev);
+		unsigned int nb_channels = iio_device_get_channels_count(dev);
+		struct capture_frame *frame = frames[i];
 
-		sample_size = iio_device_get_sample_size(dev);
-		if (sample_size == 0 || sample_count == 0)
+		if (!frame)
 			continue;
 
+		if (frame->seq == dev_info->shown_frame_seq) {
+			capture_frame_release(frame);
+			continue;
+		}
+
+		/* The frame stays referenced until the next one is shown */
 		for (j = 0; j < nb_channels; j++) {
 			struct iio_channel *ch = iio_device_get_channel(dev, j);
 			struct extra_info *info = iio_channel_get_data(ch);
 
-			if (info->data_ref)
-				g_free(info->data_ref);
-			info->data_ref = (gfloat *) g_new0(gfloat, sample_count);
+			info->shown_ref = iio_channel_is_enabled(ch) ?
+				frame->channels_data[j] : NULL;
 		}
+		if (dev_info->shown_frame)
+			capture_frame_release(dev_info->shown_frame);
+		dev_info->shown_frame = frame;
+		dev_info->shown_frame_seq = frame->seq;
 
-		if (dev_info->buffer)
-			iio_buffer_destroy(dev_info->buffer);
-		dev_info->buffer = NULL;
-		dev_info->sample_count = sample_count;
-
-		iio_device_set_data(dev, dev_info);
-
-		freq = read_sampling_frequency(dev);
-		if (freq > 0) {
-			/* 2 x capture time + 1s */
-			timeout = sample_count * 1000 / freq;
-			if (dev_info->channel_trigger_enabled)
-				timeout *= 2;
-			timeout += 1000;
-			if (timeout > min_timeout)
-				min_timeout = timeout;
-		}
+		update_plot(dev);
 	}
 
-	if (ctx)
-		iio_context_set_timeout(ctx, min_timeout);
-
-	return 0;
+	g_free(frames);
+	return FALSE;
 }
 
-static void capture_start(void)
+static void capture_frames_notify(void)
 {
-	if (capture_function) {
-		stop_capture = FALSE;
-	}
-	else {
-		stop_capture = FALSE;
-		capture_function = g_timeout_add_full(G_PRIORITY_DEFAULT_IDLE, 50, (GSourceFunc) capture_process, NULL, NULL);
-	}
+	if (g_atomic_int_compare_and_exchange(&frames_pending, FALSE, TRUE))
+		g_idle_add(capture_frames_dispatch, NULL);
 }
 
-static void start(OscPlot *plot, gboolean start_event)
+/*
+ * The acquisition threads run in lock-step capture cycles: each thread
+ * refills its device concurrently with the others, then waits here until
+ * every thread is done with the cycle. The last one to arrive publishes
+ * the frames of all the devices at once, under the sync lock.
+ */
+static void capture_cycle_publish(void)
 {
-	if (start_event) {
-		num_capturing_plots++;
-		/* Stop the capture process to allow settings to be updated */
-		stop_capture = TRUE;
+	unsigned int i;
 
-		G_TRYLOCK(buffer_full);
+	capture_cycle++;
 
-		/* Start the capture process */
-		capture_setup();
-		capture_start();
-		restart_all_running_plots();
-	} else {
-		G_TRYLOCK(buffer_full);
-		G_UNLOCK(buffer_full);
-		num_capturing_plots--;
-		if (num_capturing_plots == 0) {
-			stop_capture = TRUE;
-			close_active_buffers();
-		}
+	for (i = 0; i < num_devices; i++) {
+		struct iio_device *dev = iio_context_get_device(ctx, i);
+		struct extra_dev_info *dev_info = iio_device_get_data(dev);
+		struct capture_frame *frame = dev_info->pending_frame;
+
+		if (!frame)
+			continue;
+
+		capture_frame_publish(dev_info, frame);
+		dev_info->pending_frame = NULL;
 	}
+
+	capture_frames_notify();
 }
 
-static void plot_destroyed_cb(OscPlot *plot)
+/* Called with the sync lock held */
+static bool capture_cycle_complete(void)
 {
-	plot_list = g_list_remove(plot_list, plot);
-	stop_sampling();
-	capture_setup();
-	if (num_capturing_plots)
-		capture_start();
-	restart_all_running_plots();
+	if (!capture_sync_waiting || capture_sync_waiting +
+			capture_sync_absent < (unsigned int) capture_function)
+		return false;
+
+	capture_sync_waiting = 0;
+	capture_cycle_publish();
+	g_cond_broadcast(&capture_sync_cond);
+	return true;
 }
 
-static void new_plot_created_cb(OscPlot *plot, OscPlot *new_plot, gpointer data)
+static void capture_cycle_wait(void)
 {
-	plot_init(GTK_WIDGET(new_plot));
+	guint cycle;
+
+	g_mutex_lock(&capture_sync_lock);
+	cycle = capture_cycle;
+
+	capture_sync_waiting++;
+	if (!capture_cycle_complete()) {
+		while (cycle == capture_cycle &&
+				!g_atomic_int_get(&stop_capture))
+			g_cond_wait(&capture_sync_cond, &capture_sync_lock);
+	}
+
+	g_mutex_unlock(&capture_sync_lock);
 }
 
-static void plot_init(GtkWidget *plot)
-{
+/*
+ * A device that can't capture for a while (its buffer can't be created)
+ * leaves the capture cycles meanwhile, so that the other devices don't
+ * wait for it.
+ */
+static void capture_cycle_leave(void)
+{
+	g_mutex_lock(&capture_sync_lock);
+	capture_sync_absent++;
+	capture_cycle_complete();
+	g_mutex_unlock(&capture_sync_lock);
+}
+
+static void capture_cycle_join(void)
+{
+	g_mutex_lock(&capture_sync_lock);
+	capture_sync_absent--;
+	g_mutex_unlock(&capture_sync_lock);
+}
+
+/*
+ * RX buffers are kept across captures and across capture_setup() calls, and
+ * only recreated when they can no longer be used as they are: the channel
+ * mask or the kernel block count changed, the buffer is too small for the
+ * sample count, or it has been at least twice too large for a while.
+ */
+static const char * const rx_buffer_event_names[] = {
+	[RX_BUFFER_CREATE] = "created",
+	[RX_BUFFER_GROW] = "too small",
+	[RX_BUFFER_SHRINK] = "too large",
+	[RX_BUFFER_CHANNELS] = "channels changed",
+	[RX_BUFFER_KERNEL_COUNT] = "kernel buffers changed",
+	[RX_BUFFER_ONESHOT] = "one-shot re-arm",
+};
+
+static void rx_buffer_destroy(struct iio_device *dev)
+{
+	struct extra_dev_info *dev_info = iio_device_get_data(dev);
+
+	if (dev_info->buffer) {
+		iio_buffer_destroy(dev_info->buffer);
+		dev_info->buffer = NULL;
+	}
+	dev_info->buffer_size = 0;
+	dev_info->buffer_oversized = 0;
+}
+
+static bool rx_buffer_mask_changed(struct iio_device *dev)
+{
+	struct extra_dev_info *dev_info = iio_device_get_data(dev);
+	unsigned int i, nb_channels = iio_device_get_channels_count(dev);
+
+	for (i = 0; i < nb_channels; i++) {
+		struct iio_channel *ch = iio_device_get_channel(dev, i);
+
+		if (dev_info->buffer_mask[i] != iio_channel_is_enabled(ch))
+			return true;
+	}
+
+	return false;
+}
+
+/* Returns the reason why the buffer must be recreated, or -1 */
+static int rx_buffer_check(struct iio_device *dev, unsigned int sample_count)
+{
+	struct extra_dev_info *dev_info = iio_device_get_data(dev);
+
+	if (!dev_info->buffer)
+		return dev_info->buffer_size ? RX_BUFFER_ONESHOT : RX_BUFFER_CREATE;
+	if (dev_info->buffer_kernel_count != kernel_buffers_count)
+		return RX_BUFFER_KERNEL_COUNT;
+	if (rx_buffer_mask_changed(dev))
+		return RX_BUFFER_CHANNELS;
+	if (dev_info->buffer_size < sample_count)
+		return RX_BUFFER_GROW;
+
+	if (dev_info->buffer_size >= sample_count * 2) {
+		if (++dev_info->buffer_oversized >= RX_BUFFER_SHRINK_HOLDOFF)
+			return RX_BUFFER_SHRINK;
+	} else {
+		dev_info->buffer_oversized = 0;
+	}
+
+	return -1;
+}
+
+static int rx_buffer_create(struct iio_device *dev, unsigned int size,
+		enum rx_buffer_event event)
+{
+	struct extra_dev_info *dev_info = iio_device_get_data(dev);
+	unsigned int i, nb_channels = iio_device_get_channels_count(dev);
+	int ret;
+
+	if (dev_info->buffer) {
+		iio_buffer_destroy(dev_info->buffer);
+		dev_info->buffer = NULL;
+	}
+
+	if (kernel_buffers_count) {
+		ret = iio_device_set_kernel_buffers_count(dev,
+				kernel_buffers_count);
+		if (ret < 0)
+			fprintf(stderr, "Unable to set %u kernel buffers for %s: %s\n",
+					kernel_buffers_count,
+					iio_device_get_name(dev), strerror(-ret));
+	}
+
+	dev_info->buffer = iio_device_create_buffer(dev, size, false);
+	if (!dev_info->buffer) {
+		ret = -errno;
+		/* It is retried on every capture cycle, only say it once */
+		if (!dev_info->buffer_failures++)
+			fprintf(stderr, "Error: Unable to create buffer for %s, "
+					"retrying: %s\n",
+					iio_device_get_name(dev), strerror(-ret));
+		dev_info->buffer_size = 0;
+		return ret;
+	}
+
+	dev_info->buffer_failures = 0;
+
+	if (!dev_info->buffer_mask)
+		dev_info->buffer_mask = g_new0(bool, nb_channels);
+	for (i = 0; i < nb_channels; i++)
+		dev_info->buffer_mask[i] = iio_channel_is_enabled(
+				iio_device_get_channel(dev, i));
+
+	dev_info->buffer_size = size;
+	dev_info->buffer_kernel_count = kernel_buffers_count;
+	dev_info->buffer_oversized = 0;
+	dev_info->buffer_events[event]++;
+
+	return 0;
+}
+
+static void rx_buffer_stats_print(void)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < num_devices; i++) {
+		struct iio_device *dev = iio_context_get_device(ctx, i);
+		struct extra_dev_info *dev_info = iio_device_get_data(dev);
+		unsigned int total = 0;
+
+		if (!dev_info->input_device)
+			continue;
+
+		for (j = 0; j < RX_BUFFER_EVENTS_COUNT; j++)
+			total += dev_info->buffer_events[j];
+		if (!total)
+			continue;
+
+		printf("%s: %u buffer(s) created:", iio_device_get_name(dev), total);
+		for (j = 0; j < RX_BUFFER_EVENTS_COUNT; j++)
+			if (dev_info->buffer_events[j])
+				printf(" %s %u,", rx_buffer_event_names[j],
+						dev_info->buffer_events[j]);
+		printf("\n");
+	}
+}
+
+/* Refill the RX buffer. Returns the number of samples it holds, 0 if it
+ * had to be recreated, or a negative error code. */
+static ssize_t capture_refill(struct iio_device *dev,
+		unsigned int refill_count)
+{
+	struct extra_dev_info *dev_info = iio_device_get_data(dev);
+	gint64 start = latency_start();
+	ssize_t ret = iio_buffer_refill(dev_info->buffer);
+
+	latency_hist_add(&dev_info->capture_latency[CAPTURE_STAGE_REFILL],
+			start);
+	if (ret < 0) {
+		fprintf(stderr, "Error while reading data: %s\n", strerror(-ret));
+		return ret;
+	}
+
+	ret /= iio_buffer_step(dev_info->buffer);
+	if (ret < refill_count) {
+		/* Short read, the buffer can't hold a full refill */
+		if (rx_buffer_create(dev, dev_info->buffer_size * 2,
+					RX_BUFFER_GROW) < 0)
+			return -EAGAIN;
+		return 0;
+	}
+
+	return ret;
+}
+
+/* Demux @len samples of the RX buffer, from sample @first, to the frame
+ * from sample @pos onwards, one segment of the frame at a time */
+static void capture_demux(struct iio_device *dev,
+		const struct capture_frame *frame, size_t pos,
+		size_t first, size_t len)
+{
+	struct extra_dev_info *dev_info = iio_device_get_data(dev);
+	unsigned int i, nb_channels = iio_device_get_channels_count(dev);
+	void **dst = g_newa(void *, nb_channels);
+	size_t chunk, avail;
+
+	for (; len; len -= chunk, first += chunk, pos += chunk) {
+		chunk = len;
+		for (i = 0; i < nb_channels; i++) {
+			dst[i] = NULL;
+			if (!frame->channels_data[i])
+				continue;
+			dst[i] = segbuf_chunk(frame->channels_data[i],
+					pos, &avail);
+			chunk = MIN(chunk, avail);
+		}
+		demux_buffer(dev_info->buffer, dev, first, dst, chunk);
+	}
+}
+
+/* Untriggered captures: a frame is filled with consecutive refills */
+static int capture_continuous(struct iio_device *dev,
+		unsigned int refill_count, struct capture_frame **out)
+{
+	struct extra_dev_info *dev_info = iio_device_get_data(dev);
+	unsigned int sample_count = dev_info->sample_count;
+	struct capture_frame *frame;
+	size_t pos = 0;
+
+	frame = capture_frame_get_free(dev_info);
+	if (!frame) {
+		g_atomic_int_inc(&dev_info->frames_busy);
+		return -EBUSY;
+	}
+
+	while (pos < sample_count) {
+		ssize_t ret = capture_refill(dev, refill_count);
+		size_t len;
+		gint64 start;
+
+		if (ret < 0)
+			return (int) ret;
+		if (!ret) {
+			pos = 0;
+			continue;
+		}
+
+		start = latency_start();
+		len = MIN((size_t) ret, sample_count - pos);
+		capture_demux(dev, frame, pos, 0, len);
+		pos += len;
+		latency_hist_add(&dev_info->capture_latency[CAPTURE_STAGE_DEMUX],
+				start);
+	}
+
+	*out = frame;
+	return 0;
+}
+
+/*
+ * Triggered captures don't fetch more samples than they show. Refills are
+ * appended to a ring that holds a frame and a refill, and only the new
+ * samples are searched for the trigger. The first edge found is used: the
+ * samples that must follow it mostly came with the same refill, so one
+ * refill per frame is usually enough. Once enough samples followed the
+ * trigger point, the frame is copied out of the ring, trigger_pretrigger
+ * percent of it being before the trigger point. The ring is kept across
+ * capture cycles, so the search doesn't miss anything between two frames;
+ * it is only reset when the RX buffer is recreated.
+ */
+static void capture_ring_reset(struct extra_dev_info *dev_info)
+{
+	dev_info->ring_written = 0;
+	dev_info->ring_searched = 0;
+	dev_info->ring_trigger = 0;
+}
+
+static struct capture_frame * capture_ring_get(struct iio_device *dev)
+{
+	struct extra_dev_info *dev_info = iio_device_get_data(dev);
+	unsigned int length = dev_info->sample_count + dev_info->buffer_size;
+
+	if (dev_info->ring && dev_info->ring->sample_count >= length)
+		return dev_info->ring;
+
+	capture_frame_free(dev_info->ring, iio_device_get_channels_count(dev));
+	dev_info->ring = capture_frame_new(dev, length);
+	capture_ring_reset(dev_info);
+	return dev_info->ring;
+}
+
+/* Copy the frame starting at sample @first of the ring */
+static void capture_ring_copy(struct iio_device *dev,
+		const struct capture_frame *ring,
+		struct capture_frame *frame, guint64 first)
+{
+	unsigned int i, nb_channels = iio_device_get_channels_count(dev);
+
+	for (i = 0; i < nb_channels; i++) {
+		struct iio_channel *ch = iio_device_get_channel(dev, i);
+		size_t pos, len, avail, size, src = first % ring->sample_count;
+
+		if (!frame->channels_data[i])
+			continue;
+
+		size = DEMUX_SAMPLE_SIZE(demux_channel_sample_type(ch));
+		for (pos = 0; pos < frame->sample_count; pos += len) {
+			void *from = segbuf_chunk(ring->channels_data[i],
+					src, &len);
+			void *to = segbuf_chunk(frame->channels_data[i],
+					pos, &avail);
+
+			len = MIN(MIN(len, avail), frame->sample_count - pos);
+			memcpy(to, from, len * size);
+			src = (src + len) % ring->sample_count;
+		}
+	}
+}
+
+static int capture_triggered(struct iio_device *dev,
+		struct iio_channel *chn, unsigned int refill_count,
+		struct capture_frame **out)
+{
+	struct extra_dev_info *dev_info = iio_device_get_data(dev);
+	enum demux_sample_type type = demux_channel_sample_type(chn);
+	unsigned int sample_count = dev_info->sample_count;
+	size_t pre = (guint64) sample_count *
+		MIN(dev_info->trigger_pretrigger, 100) / 100;
+	size_t post = sample_count - pre;
+	size_t fetched = 0;
+	struct capture_frame *frame;
+	guint64 trigger;
+
+	/* After a frame worth of samples without a trigger, the capture
+	 * cycle completes without a frame and the search goes on in the
+	 * next one */
+	while (dev_info->ring_trigger || fetched < sample_count) {
+		struct capture_frame *ring = capture_ring_get(dev);
+		guint64 written, from;
+		size_t pos, len;
+		ssize_t ret;
+		gint64 start;
+
+		if (!ring)
+			return -ENOMEM;
+
+		ret = capture_refill(dev, refill_count);
+		if (ret < 0)
+			return (int) ret;
+		if (!ret) {
+			capture_ring_reset(dev_info);
+			continue;
+		}
+
+		start = latency_start();
+		pos = dev_info->ring_written % ring->sample_count;
+		len = MIN((size_t) ret, ring->sample_count - pos);
+		capture_demux(dev, ring, pos, 0, len);
+		if (len < (size_t) ret)
+			capture_demux(dev, ring, 0, len, ret - len);
+		latency_hist_add(&dev_info->capture_latency[CAPTURE_STAGE_DEMUX],
+				start);
+
+		dev_info->ring_written += ret;
+		fetched += ret;
+		written = dev_info->ring_written;
+
+		if (!dev_info->ring_trigger) {
+			/* The trigger point needs "pre" samples before it, and
+			 * the edge its previous sample, still in the ring */
+			from = dev_info->ring_searched;
+			if (pre && from < pre - 1)
+				from = pre - 1;
+			if (written > ring->sample_count &&
+					from < written - ring->sample_count)
+				from = written - ring->sample_count;
+
+			start = latency_start();
+			if (from < written - 1)
+				dev_info->ring_trigger = ring_find_edge(
+					ring->channels_data[dev_info->channel_trigger],
+					type, from, written - 1,
+					dev_info->trigger_value,
+					dev_info->trigger_falling_edge);
+			latency_hist_add(&dev_info->capture_latency[
+					CAPTURE_STAGE_TRIGGER], start);
+			dev_info->ring_searched = written - 1;
+		}
+
+		if (dev_info->ring_trigger &&
+				written >= dev_info->ring_trigger + post)
+			break;
+	}
+
+	if (!dev_info->ring_trigger)
+		return 0;
+
+	/* The next trigger point is searched after the end of this frame */
+	trigger = dev_info->ring_trigger;
+	dev_info->ring_trigger = 0;
+	dev_info->ring_searched = MAX(dev_info->ring_searched, trigger + post);
+
+	frame = capture_frame_get_free(dev_info);
+	if (!frame) {
+		g_atomic_int_inc(&dev_info->frames_busy);
+		return -EBUSY;
+	}
+
+	capture_ring_copy(dev, dev_info->ring, frame, trigger - pre);
+	*out = frame;
+	return 0;
+}
+
+/*
+ * Acquire one frame from the device into a free frame slot, to be published
+ * at the end of the capture cycle. Runs on the acquisition thread of the
+ * device. No frame is published when the trigger didn't fire.
+ */
+static int capture_device(struct iio_device *dev)
+{
+	struct extra_dev_info *dev_info = iio_device_get_data(dev);
+	unsigned int i, nb_channels = iio_device_get_channels_count(dev);
+	unsigned int refill_count = MIN(dev_info->sample_count,
+			CAPTURE_REFILL_MAX);
+	struct capture_frame *frame = NULL;
+	struct iio_channel *chn = NULL;
+	int event, ret;
+
+	event = rx_buffer_check(dev, refill_count);
+	if (event >= 0) {
+		capture_ring_reset(dev_info);
+		if (rx_buffer_create(dev, refill_count, event) < 0)
+			return -EAGAIN;
+	}
+
+	if (dev_info->channel_trigger_enabled) {
+		chn = iio_device_get_channel(dev, dev_info->channel_trigger);
+		if (!iio_channel_is_enabled(chn)) {
+			dev_info->channel_trigger_enabled = false;
+			chn = NULL;
+		}
+	}
+
+	if (chn)
+		ret = capture_triggered(dev, chn, refill_count, &frame);
+	else
+		ret = capture_continuous(dev, refill_count, &frame);
+	if (ret < 0)
+		return ret;
+
+	if (frame && dev_info->channels_data_copy) {
+		for (i = 0; i < nb_channels; i++) {
+			struct iio_channel *ch = iio_device_get_channel(dev, i);
+
+			if (frame->channels_data[i])
+				capture_frame_to_float(frame, ch,
+						frame->channels_data[i],
+						dev_info->channels_data_copy[i]);
+		}
+		dev_info->channels_data_copy = NULL;
+		G_UNLOCK(buffer_full);
+	}
+
+	if (device_is_oneshot(dev)) {
+		iio_buffer_destroy(dev_info->buffer);
+		dev_info->buffer = NULL;
+		capture_ring_reset(dev_info);
+	}
+
+	dev_info->pending_frame = frame;
+
+	return 0;
+}
+
+static gpointer capture_thread_func(gpointer data)
+{
+	struct iio_device *dev = data;
+
+	while (!g_atomic_int_get(&stop_capture)) {
+		int ret = capture_device(dev);
+
+		if (ret < 0 && ret != -EAGAIN && ret != -EBUSY) {
+			g_mutex_lock(&capture_sync_lock);
+			g_atomic_int_set(&stop_capture, TRUE);
+			g_cond_broadcast(&capture_sync_cond);
+			g_mutex_unlock(&capture_sync_lock);
+			g_atomic_int_set(&capture_failed, TRUE);
+			capture_frames_notify();
+			break;
+		}
+
+		if (ret == -EAGAIN) {
+			/* Buffer creation failed, retry a bit later */
+			capture_cycle_leave();
+			g_usleep(50000);
+			capture_cycle_join();
+			continue;
+		}
+
+		capture_cycle_wait();
+
+		if (ret == -EBUSY) {
+			/* All the frames are being read, don't overwrite them */
+			g_usleep(1000);
+		}
+	}
+
+	return NULL;
+}
+
+static void capture_threads_join(void)
+{
+	unsigned int i;
+
+	if (!capture_function)
+		return;
+
+	g_mutex_lock(&capture_sync_lock);
+	g_atomic_int_set(&stop_capture, TRUE);
+	g_cond_broadcast(&capture_sync_cond);
+	g_mutex_unlock(&capture_sync_lock);
+
+	for (i = 0; i < num_devices; i++) {
+		struct iio_device *dev = iio_context_get_device(ctx, i);
+		struct extra_dev_info *dev_info = iio_device_get_data(dev);
+
+		if (dev_info->capture_thread) {
+			g_thread_join(dev_info->capture_thread);
+			dev_info->capture_thread = NULL;
+		}
+		dev_info->pending_frame = NULL;
+	}
+
+	capture_function = 0;
+	capture_sync_waiting = 0;
+	capture_sync_absent = 0;
+}
+
+static unsigned int max_sample_count_from_plots(struct extra_dev_info *info)
+{
+	unsigned int max_count = 0;
+	struct plot_params *prm;
+	GSList *node;
+	GSList *list = info->plots_sample_counts;
+
+	for (node = list; node; node = g_slist_next(node)) {
+		prm = node->data;
+		if (prm->sample_count > max_count)
+			max_count = prm->sample_count;
+	}
+
+	return max_count;
+}
+
+static double read_sampling_frequency(const struct iio_device *dev)
+{
+	double freq = 400.0;
+	int ret = -1;
+	unsigned int i, nb_channels = iio_device_get_channels_count(dev);
+	char buf[1024];
+
+	for (i = 0; i < nb_channels; i++) {
+		struct iio_channel *ch = iio_device_get_channel(dev, i);
+
+		if (iio_channel_is_output(ch) || strncmp(iio_channel_get_id(ch),
+					"voltage", sizeof("voltage") - 1))
+			continue;
+
+		ret = iio_channel_attr_read(ch, "sampling_frequency",
+				buf, sizeof(buf));
+		if (ret > 0)
+			break;
+	}
+
+	if (ret < 0)
+		ret = iio_device_attr_read(dev, "sampling_frequency",
+				buf, sizeof(buf));
+	if (ret < 0) {
+		const struct iio_device *trigger;
+		ret = iio_device_get_trigger(dev, &trigger);
+		if (!ret)
+			ret = iio_device_attr_read(trigger, "frequency",
+					buf, sizeof(buf));
+	}
+
+	if (ret > 0)
+		sscanf(buf, "%lf", &freq);
+
+	if (freq < 0)
+		freq += 4294967296.0;
+
+	return freq;
+}
+
+static int capture_setup(void)
+{
+	unsigned int i, j;
+	unsigned int min_timeout = 1000;
+	unsigned int timeout;
+	double freq;
+
+	/* Buffers and frames can't change under the acquisition threads */
+	capture_threads_join();
+
+	for (i = 0; i < num_devices; i++) {
+		struct iio_device *dev = iio_context_get_device(ctx, i);
+		struct extra_dev_info *dev_info = iio_device_get_data(dev);
+		unsigned int nb_channels = iio_device_get_channels_count(dev);
+		unsigned int sample_size, sample_count = max_sample_count_from_plots(dev_info);
+
+		/* The recorder owns the device until it is stopped */
+		if (dev_info->recorder)
+			continue;
+
+		for (j = 0; j < nb_channels; j++) {
+			struct iio_channel *ch = iio_device_get_channel(dev, j);
+			struct extra_info *info = iio_channel_get_data(ch);
+			if (info->shadow_of_enabled > 0)
+				iio_channel_enable(ch);
+			else
+				iio_channel_disable(ch);
+		}
+
+		/* Float views are allocated when a math channel first asks
+		 * for them, and only kept for the channels still captured at
+		 * the same sample count */
+		for (j = 0; j < nb_channels; j++) {
+			struct iio_channel *ch = iio_device_get_channel(dev, j);
+			struct extra_info *info = iio_channel_get_data(ch);
+
+			info->shown_ref = NULL;
+			if (info->data_buf && iio_channel_is_enabled(ch) &&
+					segbuf_length(info->data_buf) == sample_count)
+				continue;
+
+			segbuf_free(info->data_buf);
+			info->data_buf = NULL;
+			info->data_ref = NULL;
+		}
+
+		sample_size = iio_device_get_sample_size(dev);
+		if (sample_size == 0 || sample_count == 0) {
+			rx_buffer_destroy(dev);
+			capture_frames_destroy(dev);
+			continue;
+		}
+
+		if (capture_frames_create(dev, sample_count) < 0) {
+			fprintf(stderr, "Unable to capture %u samples from %s\n",
+					sample_count, iio_device_get_name(dev));
+			rx_buffer_destroy(dev);
+			continue;
+		}
+
+		/* The buffer is kept, the acquisition thread recreates it
+		 * only if it doesn't fit the new settings */
+		dev_info->sample_count = sample_count;
+
+		iio_device_set_data(dev, dev_info);
+
+		freq = read_sampling_frequency(dev);
+		if (freq > 0) {
+			/* Refill time + 1s */
+			timeout = MIN(sample_count, CAPTURE_REFILL_MAX) * 1000 / freq;
+			timeout += 1000;
+			if (timeout > min_timeout)
+				min_timeout = timeout;
+		}
+	}
+
+	if (ctx)
+		iio_context_set_timeout(ctx, min_timeout);
+
+	return 0;
+}
+
+static void capture_start(void)
+{
+	unsigned int i;
+
+	capture_threads_join();
+	stop_capture = FALSE;
+
+	/* No thread may complete a cycle before all of them are started */
+	g_mutex_lock(&capture_sync_lock);
+
+	for (i = 0; i < num_devices; i++) {
+		struct iio_device *dev = iio_context_get_device(ctx, i);
+		struct extra_dev_info *dev_info = iio_device_get_data(dev);
+
+		if (dev_info->input_device == false || !dev_info->frames[0])
+			continue;
+
+		/* The recorder owns the device until it is stopped */
+		if (dev_info->recorder)
+			continue;
+
+		if (iio_device_get_sample_size(dev) == 0)
+			continue;
+
+		dev_info->capture_thread = g_thread_new(iio_device_get_name(dev) ?:
+				iio_device_get_id(dev), capture_thread_func, dev);
+		capture_function++;
+	}
+
+	g_mutex_unlock(&capture_sync_lock);
+}
+
+static void start(OscPlot *plot, gboolean start_event)
+{
+	if (start_event) {
+		num_capturing_plots++;
+		/* Stop the capture process to allow settings to be updated */
+		stop_capture = TRUE;
+
+		G_TRYLOCK(buffer_full);
+
+		/* Start the capture process */
+		capture_setup();
+		capture_start();
+		restart_all_running_plots();
+	} else {
+		G_TRYLOCK(buffer_full);
+		G_UNLOCK(buffer_full);
+		num_capturing_plots--;
+		if (num_capturing_plots == 0) {
+			stop_capture = TRUE;
+			close_active_buffers();
+		}
+	}
+}
+
+/* From the main loop, after the recorder of a device stopped on an error */
+static gboolean record_error_cb(gpointer data)
+{
+	struct iio_device *dev = data;
+	struct extra_dev_info *dev_info = iio_device_get_data(dev);
+	const char *name = iio_device_get_name(dev) ?: iio_device_get_id(dev);
+	struct record_stats stats;
+
+	/* Stopped in the meantime, maybe even started again */
+	if (!dev_info->recorder || !recorder_get_error(dev_info->recorder))
+		return FALSE;
+
+	osc_record_stop(name, &stats);
+	create_blocking_popup(GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
+			"Recording stopped",
+			"Recording of %s stopped on error: %s\n"
+			"%llu bytes recorded, %llu buffers dropped",
+			name, strerror(-stats.error),
+			(unsigned long long) stats.bytes_written,
+			(unsigned long long) stats.buffers_dropped);
+
+	return FALSE;
+}
+
+/*
+ * Record the RX samples of a device to disk, continuously, as raw
+ * interleaved samples. The channels enabled in the plots are recorded, or
+ * all of them if none is. A device can't have more than one buffer, so it
+ * is taken away from the plots until the recording is stopped.
+ */
+int osc_record_start(const char *device, const char *filename)
+{
+	struct iio_device *dev;
+	struct extra_dev_info *dev_info;
+	unsigned int i, nb_channels, nb_enabled = 0;
+	int ret = 0;
+
+	if (!device || !filename)
+		return -EINVAL;
+
+	dev = iio_context_find_device(ctx, device);
+	if (!dev)
+		return -ENXIO;
+
+	dev_info = iio_device_get_data(dev);
+	if (!dev_info->input_device)
+		return -EINVAL;
+	if (dev_info->recorder)
+		return -EBUSY;
+
+	stop_sampling();
+
+	nb_channels = iio_device_get_channels_count(dev);
+	for (i = 0; i < nb_channels; i++) {
+		struct iio_channel *ch = iio_device_get_channel(dev, i);
+		struct extra_info *info = iio_channel_get_data(ch);
+
+		if (info->shadow_of_enabled > 0) {
+			iio_channel_enable(ch);
+			nb_enabled++;
+		}
+	}
+
+	if (!nb_enabled) {
+		for (i = 0; i < nb_channels; i++) {
+			struct iio_channel *ch = iio_device_get_channel(dev, i);
+
+			if (iio_channel_is_scan_element(ch))
+				iio_channel_enable(ch);
+		}
+	}
+
+	dev_info->recorder = recorder_start(dev, filename,
+			record_error_cb, dev, &ret);
+	if (!dev_info->recorder)
+		fprintf(stderr, "Unable to record %s to %s: %s\n",
+				device, filename, strerror(-ret));
+
+	if (num_capturing_plots) {
+		capture_setup();
+		capture_start();
+	}
+
+	return ret;
+}
+
+int osc_record_stop(const char *device, struct record_stats *stats)
+{
+	struct iio_device *dev;
+	struct extra_dev_info *dev_info;
+	struct record_stats tmp;
+
+	if (!device)
+		return -EINVAL;
+
+	dev = iio_context_find_device(ctx, device);
+	if (!dev)
+		return -ENXIO;
+
+	dev_info = iio_device_get_data(dev);
+	if (!dev_info->recorder)
+		return -EINVAL;
+
+	if (!stats)
+		stats = &tmp;
+
+	recorder_stop(dev_info->recorder, stats);
+	dev_info->recorder = NULL;
+
+	printf("Recorded %llu bytes from %s, %llu buffers dropped\n",
+			(unsigned long long) stats->bytes_written, device,
+			(unsigned long long) stats->buffers_dropped);
+	if (stats->error)
+		fprintf(stderr, "Recording of %s stopped on error: %s\n",
+				device, strerror(-stats->error));
+
+	if (num_capturing_plots) {
+		capture_setup();
+		capture_start();
+	}
+
+	return stats->error;
+}
+
+bool osc_record_active(const char *device)
+{
+	struct iio_device *dev;
+	struct extra_dev_info *dev_info;
+
+	if (!device || !ctx)
+		return false;
+
+	dev = iio_context_find_device(ctx, device);
+	if (!dev)
+		return false;
+
+	dev_info = iio_device_get_data(dev);
+	return dev_info && dev_info->recorder;
+}
+
+static void stop_all_recordings(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < num_devices; i++) {
+		struct iio_device *dev = iio_context_get_device(ctx, i);
+		struct extra_dev_info *dev_info = iio_device_get_data(dev);
+
+		if (dev_info->recorder) {
+			recorder_stop(dev_info->recorder, NULL);
+			dev_info->recorder = NULL;
+		}
+	}
+}
+
+static void plot_destroyed_cb(OscPlot *plot)
+{
+	plot_list = g_list_remove(plot_list, plot);
+	stop_sampling();
+	capture_setup();
+	if (num_capturing_plots)
+		capture_start();
+	restart_all_running_plots();
+}
+
+static void new_plot_created_cb(OscPlot *plot, OscPlot *new_plot, gpointer data)
+{
+	plot_init(GTK_WIDGET(new_plot));
+}
+
+static void plot_init(GtkWidget *plot)
+{
 	plot_list = g_list_append(plot_list, plot);
 	g_signal_connect(plot, "osc-capture-event", G_CALLBACK(start), NULL);
 	g_signal_connect(plot, "osc-destroy-event", G_CALLBACK(plot_destroyed_cb), NULL);
@@ -1405,6 +2448,30 @@ static gchar * get_default_profile_name(void)
 			DEFAULT_PROFILE_NAME, NULL);
 }
 
+static void gfunc_print_plot_latency(gpointer data, gpointer user_data)
+{
+	osc_plot_print_latency(OSC_PLOT(data), (FILE *) user_data);
+}
+
+/* Write the latency statistics of all the plots to "latency_dump_file" */
+static void latency_dump(void)
+{
+	FILE *fp;
+
+	if (!latency_dump_file || !plot_list)
+		return;
+
+	fp = fopen(latency_dump_file, "w");
+	if (!fp) {
+		fprintf(stderr, "Failed to open %s: %s\n",
+				latency_dump_file, strerror(errno));
+		return;
+	}
+
+	g_list_foreach(plot_list, gfunc_print_plot_latency, fp);
+	fclose(fp);
+}
+
 static void do_quit(bool reload)
 {
 	unsigned int i, nb = gtk_notebook_get_n_pages(GTK_NOTEBOOK(notebook));
@@ -1420,6 +2487,9 @@ static void do_quit(bool reload)
 	G_TRYLOCK(buffer_full);
 	G_UNLOCK(buffer_full);
 	close_active_buffers();
+	stop_all_recordings();
+	rx_buffer_stats_print();
+	latency_dump();
 
 	close_all_plots();
 	destroy_all_plots();
@@ -1428,6 +2498,9 @@ static void do_quit(bool reload)
 	free_setup_check_fct_list();
 	osc_plot_reset_numbering();
 
+	if (!reload)
+		fft_plan_exit();
+
 	if (!reload && gtk_main_level())
 		gtk_main_quit();
 
@@ -1520,11 +2593,13 @@ static void init_device_list(struct iio_context *ctx)
 		struct extra_dev_info *dev_info = calloc(1, sizeof(*dev_info));
 		iio_device_set_data(dev, dev_info);
 		dev_info->input_device = is_input_device(dev);
+		dev_info->trigger_pretrigger = TRIGGER_PRETRIGGER_DEFAULT;
 
 		for (j = 0; j < nb_channels; j++) {
 			struct iio_channel *ch = iio_device_get_channel(dev, j);
 			struct extra_info *info = calloc(1, sizeof(*info));
 			info->dev = dev;
+			g_mutex_init(&info->data_ref_lock);
 			iio_channel_set_data(ch, info);
 		}
 
@@ -1840,6 +2915,17 @@ static void capture_profile_save(const char *filename)
 
 	fprintf(fp, "tooltips_enable=%d\n", gtk_check_menu_item_get_active(GTK_CHECK_MENU_ITEM(tooltips_en)));
 
+	if (kernel_buffers_count)
+		fprintf(fp, "kernel_buffers_count=%u\n", kernel_buffers_count);
+	if (latency_dump_file)
+		fprintf(fp, "latency_dump_file=%s\n", latency_dump_file);
+	if (strcmp(fft_plan_get_rigor(), "measure"))
+		fprintf(fp, "fftw_planning=%s\n", fft_plan_get_rigor());
+	if (fft_plan_get_double())
+		fprintf(fp, "fft_precision=double\n");
+	if (osc_plot_get_max_fps() != OSC_PLOT_MAX_FPS_DEFAULT)
+		fprintf(fp, "max_fps=%u\n", osc_plot_get_max_fps());
+
 	fclose(fp);
 
 	/* All opened "Capture" windows save their own configurations */
@@ -1911,6 +2997,32 @@ static int handle_osc_param(int line, const char *name, const char *value)
 		return 0;
 	}
 
+	if (!strcmp(name, "kernel_buffers_count")) {
+		kernel_buffers_count = atoi(value);
+		return 0;
+	}
+
+	if (!strcmp(name, "latency_dump_file")) {
+		g_free(latency_dump_file);
+		latency_dump_file = g_strdup(value);
+		return 0;
+	}
+
+	if (!strcmp(name, "fftw_planning")) {
+		fft_plan_set_rigor(value);
+		return 0;
+	}
+
+	if (!strcmp(name, "fft_precision")) {
+		fft_plan_set_double(!strcmp(value, "double"));
+		return 0;
+	}
+
+	if (!strcmp(name, "max_fps")) {
+		osc_plot_set_max_fps(atoi(value));
+		return 0;
+	}
+
 	if (!strcmp(name, "test") || !strcmp(name, "window_x_pos") ||
 			!strcmp(name, "window_y_pos")) {
 		printf("Ignoring token \'%s\' when loading sequentially\n", name);
@@ -2017,6 +3129,42 @@ static void load_profile(const char *filename, bool load_plugins)
 		free(value);
 	}
 
+	value = read_token_from_ini(filename,
+			OSC_INI_SECTION, "kernel_buffers_count");
+	if (value) {
+		kernel_buffers_count = atoi(value);
+		free(value);
+	}
+
+	value = read_token_from_ini(filename,
+			OSC_INI_SECTION, "latency_dump_file");
+	if (value) {
+		g_free(latency_dump_file);
+		latency_dump_file = g_strdup(value);
+		free(value);
+	}
+
+	value = read_token_from_ini(filename,
+			OSC_INI_SECTION, "fftw_planning");
+	if (value) {
+		fft_plan_set_rigor(value);
+		free(value);
+	}
+
+	value = read_token_from_ini(filename,
+			OSC_INI_SECTION, "fft_precision");
+	if (value) {
+		fft_plan_set_double(!strcmp(value, "double"));
+		free(value);
+	}
+
+	value = read_token_from_ini(filename,
+			OSC_INI_SECTION, "max_fps");
+	if (value) {
+		osc_plot_set_max_fps(atoi(value));
+		free(value);
+	}
+
 	value = read_token_from_ini(filename, OSC_INI_SECTION, "window_x_pos");
 	if (value) {
 		x_pos = atoi(value);
@@ -28,13 +28,17 @@ extern GtkWidget *capture_graph;
 extern gint capture_function;
 extern bool str_endswith(const char *str, const char *needle);
 
-/* Max 1 Meg (2^20) */
-#define MAX_SAMPLES 1048576
+/* Max 128 Meg (2^27), long captures are stored in segments */
+#define MAX_SAMPLES 134217728
 #define TMP_INI_FILE "/tmp/.%s.tmp"
 #ifndef MAX_MARKERS
 #define MAX_MARKERS 10
 #endif
 
+/* Range of the number of markers of a plot; the tone markers use three */
+#define MIN_MARKER_COUNT 3
+#define MAX_MARKER_COUNT 256
+
 #define OFF_MRK    "Markers Off"
 #define PEAK_MRK   "Peak Markers"
 #define FIX_MRK    "Fixed Markers"
@@ -69,6 +73,7 @@ enum marker_types {
 #define FFT_PLOT 1
 #define XY_PLOT 2
 #define XCORR_PLOT 3
+#define WATERFALL_PLOT 4
 
 #define USE_INTERN_SAMPLING_FREQ -1.0
 
@@ -97,6 +102,20 @@ enum marker_types plugin_get_plot_marker_type(OscPlot *plot, const char *device)
 void plugin_set_plot_marker_type(OscPlot *plot, const char *device, enum marker_types type);
 gdouble plugin_get_plot_fft_avg(OscPlot *plot, const char *device);
 OscPlot * plugin_get_new_plot(void);
+int plugin_get_capture_latency(const char *device, int stage,
+		struct latency_stats *stats);
+int plugin_get_capture_counters(const char *device,
+		unsigned int *resizes, unsigned int *busy);
+int plugin_get_plot_latency(OscPlot *plot, int stage, int transform_type,
+		struct latency_stats *stats);
+gfloat * osc_channel_get_float_data(struct iio_channel *ch);
+ssize_t osc_channel_read_float(struct iio_channel *ch, size_t pos,
+		gfloat *dst, size_t len);
+
+struct record_stats;
+int osc_record_start(const char *device, const char *filename);
+int osc_record_stop(const char *device, struct record_stats *stats);
+bool osc_record_active(const char *device);
 
 void save_complete_profile(const char *filename);
 void load_complete_profile(const char *filename);
@@ -7,6 +7,7 @@
 
 #include "config.h"
 #include "osc.h"
+#include "fft_plan.h"
 
 extern GtkWidget *notebook;
 extern GtkWidget *infobar;
@@ -99,6 +100,7 @@ static void init_application ()
 	g_signal_connect(G_OBJECT(infobar_reconnect), "clicked", G_CALLBACK(infobar_reconnect_cb), NULL);
 
 	dialogs_init(builder);
+	fft_plan_init();
 
 	ctx = osc_create_context();
 	if (ctx)
@@ -29,6 +29,15 @@
 #include "config.h"
 #include "iio_widget.h"
 #include "datatypes.h"
+#include "latency.h"
+#include "fft_plan.h"
+#include "dsp.h"
+#include "window.h"
+#include "ddc.h"
+#include "waterfall.h"
+#include "density.h"
+#include "envelope.h"
+#include "record.h"
 #include "osc_plugin.h"
 #include "math_expression_generator.h"
 
@@ -54,10 +63,11 @@ static void capture_button_clicked_cb (GtkToggleToolButton *btn, gpointer data);
 static void single_shot_clicked_cb (GtkToggleToolButton *btn, gpointer data);
 static void add_grid(OscPlot *plot);
 static void rescale_databox(OscPlotPrivate *priv, GtkDatabox *box, gfloat border);
-static void call_all_transform_functions(OscPlotPrivate *priv);
+static bool call_all_transform_functions(OscPlotPrivate *priv);
 static void capture_start(OscPlotPrivate *priv);
 static void plot_profile_save(OscPlot *plot, char *filename);
 static void transform_add_plot_markers(OscPlot *plot, Transform *transform);
+static void markers_set_count(OscPlot *plot, unsigned int max_markers);
 static void osc_plot_finalize(GObject *object);
 static void osc_plot_dispose(GObject *object);
 static void save_as(OscPlot *plot, const char *filename, int type);
@@ -80,7 +90,8 @@ static gdouble prefix2scale (char adc_scale);
 static struct iio_device * transform_get_device_parent(Transform *transform);
 static gboolean tree_get_selected_row_iter(GtkTreeView *treeview, GtkTreeIter *iter);
 static void set_channel_shadow_of_enabled(gpointer data, gpointer user_data);
-static gfloat * plot_channels_get_nth_data_ref(GSList *list, guint n);
+static bool plot_channels_read_nth(GSList *list, guint n, size_t pos,
+		gfloat *dst, size_t len);
 static void transform_add_own_markers(OscPlot *plot, Transform *transform);
 static void transform_remove_own_markers(Transform *transform);
 
@@ -186,7 +197,8 @@ struct channel_settings {
 	GdkColor graph_color;
 
 	struct iio_device * (*get_iio_parent)(PlotChn *);
-	gfloat * (*get_data_ref)(PlotChn *);
+	ssize_t (*read_data)(PlotChn *, size_t, gfloat *, size_t);
+	void (*update_data_ref)(PlotChn *);
 	void (*assert_used_iio_channels)(PlotChn *, bool);
 	void (*destroy)(PlotChn *);
 };
@@ -218,8 +230,25 @@ struct math_channel_settings {
 #define FFT_SETTINGS(obj) ((struct _fft_settings *)obj->settings)
 #define CONSTELLATION_SETTINGS(obj) ((struct _constellation_settings *)obj->settings)
 #define XCORR_SETTINGS(obj) ((struct _cross_correlation_settings *)obj->settings)
+#define WATERFALL_SETTINGS(obj) ((struct _waterfall_settings *)obj->settings)
 #define MATH_SETTINGS(obj) ((struct _math_settings *)obj->settings)
 
+/* The samples are binned in a 2D histogram rather than drawn one by one */
+static bool graph_type_is_density(OscPlotPrivate *priv)
+{
+	gchar *str = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(priv->plot_type));
+	bool density = str && !strcmp(str, "Density");
+
+	g_free(str);
+	return density;
+}
+
+/* The waterfall shows the spectra of the FFT plot, with the same settings */
+static inline bool plot_domain_uses_fft(int domain)
+{
+	return domain == FFT_PLOT || domain == WATERFALL_PLOT;
+}
+
 #define PLOT_CHN(obj) ((PlotChn *)obj)
 #define PLOT_IIO_CHN(obj) ((PlotIioChn *)obj)
 #define PLOT_MATH_CHN(obj) ((PlotMathChn *)obj)
@@ -278,12 +307,21 @@ struct _OscPlotPrivate
 	unsigned int sample_count;
 	GtkWidget *fft_size_widget;
 	GtkWidget *fft_avg_widget;
+	GtkWidget *fft_welch_widget;
+	GtkWidget *fft_window_widget;
+	GtkWidget *fft_window_beta_widget;
+	GtkWidget *fft_zoom_widget;
+	GtkWidget *fft_zoom_center_widget;
+	GtkWidget *waterfall_depth_widget;
+	GtkWidget *persistence_widget;
+	GtkWidget *eye_period_widget;
 	GtkWidget *fft_pwr_offset_widget;
 	GtkWidget *device_settings_menu;
 	GtkWidget *math_settings_menu;
 	GtkWidget *device_trigger_menuitem;
 	GtkWidget *math_menuitem;
 	GtkWidget *plot_trigger_menuitem;
+	GtkWidget *record_menuitem;
 	GtkWidget *channel_settings_menu;
 	GtkWidget *math_channel_settings_menu;
 	GtkWidget *channel_expression_edit_menuitem;
@@ -340,8 +378,11 @@ struct _OscPlotPrivate
 	/* Type of "Save As" currently selected*/
 	gint active_saveas_type;
 
-	/* The set of markers */
-	struct marker_type markers[MAX_MARKERS + 2];
+	/* The set of markers: max_markers is the index of the last one, and
+	 * an inactive entry follows it */
+	struct marker_type *markers;
+	unsigned int max_markers;
+	float *phase_avg;
 	struct marker_type *markers_copy;
 	enum marker_types marker_type;
 
@@ -354,9 +395,20 @@ struct _OscPlotPrivate
 
 	gint line_thickness;
 
-	gint redraw_function;
+	gboolean redraw_scheduled;
 	gboolean stop_redraw;
-	gboolean redraw;
+	/* Bumped each time the transforms produced new output, and the value
+	 * of the last redraw */
+	unsigned int generation;
+	unsigned int drawn_generation;
+
+	struct latency_hist transform_latency[TRANSFORMS_TYPES_COUNT];
+	struct latency_hist markers_latency;
+	struct latency_hist redraw_latency;
+	gint64 redraw_start;
+	gint64 latency_label_update;
+	GtkWidget *latency_label;
+	GtkWidget *latency_menuitem;
 
 	gboolean fullscreen_state;
 
@@ -466,18 +518,15 @@ void osc_plot_set_visible (OscPlot *plot, bool visible)
 	gtk_widget_set_visible(plot->priv->window, visible);
 }
 
-struct iio_buffer * osc_plot_get_buffer(OscPlot *plot)
+struct iio_device * osc_plot_get_device(OscPlot *plot)
 {
-	struct extra_dev_info *dev_info;
-
-	dev_info = iio_device_get_data(plot->priv->current_device);
-	return dev_info->buffer;
+	return plot->priv->current_device;
 }
 
 void osc_plot_data_update (OscPlot *plot)
 {
-	call_all_transform_functions(plot->priv);
-	plot->priv->redraw = TRUE;
+	if (call_all_transform_functions(plot->priv))
+		plot->priv->generation++;
 
 	if (plot->priv->single_shot_mode) {
 		plot->priv->single_shot_mode = false;
@@ -497,20 +546,24 @@ void osc_plot_update_rx_lbl(OscPlot *plot, bool force_update)
 	device_rx_info_update(plot);
 
 	/* Skip rescaling graphs, updating labels and others if the redrawing is currently halted. */
-	if (priv->redraw_function <= 0 && !force_update)
+	if (!priv->redraw_scheduled && !force_update)
 		return;
 
-	if (priv->active_transform_type == FFT_TRANSFORM || priv->active_transform_type == COMPLEX_FFT_TRANSFORM) {
+	if (priv->active_transform_type == FFT_TRANSFORM ||
+			priv->active_transform_type == COMPLEX_FFT_TRANSFORM ||
+			priv->active_transform_type == WATERFALL_TRANSFORM) {
+		Transform *tr;
 
 		/* In FFT mode we need to scale the x-axis according to the selected sampling frequency */
 		for (i = 0; i < tr_list->size; i++)
 			Transform_setup(tr_list->transforms[i]);
 
-		dev_info = iio_device_get_data(transform_get_device_parent(tr_list->transforms[i - 1]));
+		tr = tr_list->transforms[i - 1];
+		dev_info = iio_device_get_data(transform_get_device_parent(tr));
 		sprintf(buf, "%cHz", dev_info->adc_scale);
 		gtk_label_set_text(GTK_LABEL(priv->hor_scale), buf);
 
-		if (priv->active_transform_type == COMPLEX_FFT_TRANSFORM)
+		if (FFT_SETTINGS(tr)->fft_alg_data.num_active_channels == 2)
 			corr = dev_info->adc_freq / 2.0;
 		else
 			corr = 0;
@@ -518,7 +571,13 @@ void osc_plot_update_rx_lbl(OscPlot *plot, bool force_update)
 			return;
 		if (priv->profile_loaded_scale)
 			return;
-		gtk_databox_set_total_limits(GTK_DATABOX(priv->databox),
+		/* The waterfall shows the newest spectrum at the top */
+		if (priv->active_transform_type == WATERFALL_TRANSFORM)
+			gtk_databox_set_total_limits(GTK_DATABOX(priv->databox),
+				-5.0 - corr, dev_info->adc_freq / 2.0 + 5.0, 0.0,
+				-(gfloat) waterfall_get_depth(WATERFALL_SETTINGS(tr)->graph));
+		else
+			gtk_databox_set_total_limits(GTK_DATABOX(priv->databox),
 				-5.0 - corr, dev_info->adc_freq / 2.0 + 5.0,
 				0.0, -100.0);
 		priv->do_a_rescale_flag = 1;
@@ -538,7 +597,7 @@ void osc_plot_restart (OscPlot *plot)
 {
 	OscPlotPrivate *priv = plot->priv;
 
-	if (priv->redraw_function > 0)
+	if (priv->redraw_scheduled)
 	{
 		priv->stop_redraw = TRUE;
 		plot_setup(plot);
@@ -551,7 +610,7 @@ void osc_plot_restart (OscPlot *plot)
 
 bool osc_plot_running_state (OscPlot *plot)
 {
-	return !!plot->priv->redraw_function;
+	return !!plot->priv->redraw_scheduled;
 }
 
 void osc_plot_draw_start (OscPlot *plot)
@@ -654,7 +713,7 @@ bool osc_plot_set_sample_count (OscPlot *plot, gdouble count)
 	if (gtk_toggle_tool_button_get_active((GtkToggleToolButton *)priv->capture_button))
 		return false;
 
-	if (gtk_combo_box_get_active(GTK_COMBO_BOX(priv->plot_domain)) == FFT_PLOT) {
+	if (plot_domain_uses_fft(gtk_combo_box_get_active(GTK_COMBO_BOX(priv->plot_domain)))) {
 		char s_count[32];
 		snprintf(s_count, sizeof(s_count), "%d", (int)count);
 		ret = comboboxtext_set_active_by_string(GTK_COMBO_BOX(priv->fft_size_widget), s_count);
@@ -675,12 +734,32 @@ bool osc_plot_set_sample_count (OscPlot *plot, gdouble count)
 	return (ret) ? true : false;
 }
 
+/* Number of markers of the plot; can only be changed when not capturing */
+bool osc_plot_set_marker_count (OscPlot *plot, unsigned int count)
+{
+	OscPlotPrivate *priv = plot->priv;
+
+	if (gtk_toggle_tool_button_get_active((GtkToggleToolButton *)priv->capture_button))
+		return false;
+
+	if (count < MIN_MARKER_COUNT || count > MAX_MARKER_COUNT)
+		return false;
+
+	markers_set_count(plot, count - 1);
+	return true;
+}
+
+unsigned int osc_plot_get_marker_count (OscPlot *plot)
+{
+	return plot->priv->max_markers + 1;
+}
+
 double osc_plot_get_sample_count (OscPlot *plot) {
 
 	OscPlotPrivate *priv = plot->priv;
 	int count;
 
-	if (gtk_combo_box_get_active(GTK_COMBO_BOX(priv->plot_domain)) == FFT_PLOT)
+	if (plot_domain_uses_fft(gtk_combo_box_get_active(GTK_COMBO_BOX(priv->plot_domain))))
 		count = comboboxtext_get_active_text_as_int(GTK_COMBO_BOX_TEXT(priv->fft_size_widget));
 	else
 		count = gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->sample_count_widget));
@@ -766,172 +845,437 @@ static void osc_plot_finalize(GObject *object)
 	G_OBJECT_CLASS(osc_plot_parent_class)->finalize(object);
 }
 
-static double win_hanning(int j, int n)
+/* Lets a thread wait for the jobs it pushed to a GThreadPool */
+struct pool_join {
+	unsigned int pending;
+	GMutex lock;
+	GCond done;
+};
+
+static void pool_join_init(struct pool_join *join, unsigned int pending)
+{
+	join->pending = pending;
+	g_mutex_init(&join->lock);
+	g_cond_init(&join->done);
+}
+
+static void pool_join_done(struct pool_join *join)
+{
+	g_mutex_lock(&join->lock);
+	if (!--join->pending)
+		g_cond_signal(&join->done);
+	g_mutex_unlock(&join->lock);
+}
+
+static void pool_join_wait(struct pool_join *join)
+{
+	g_mutex_lock(&join->lock);
+	while (join->pending)
+		g_cond_wait(&join->done, &join->lock);
+	g_mutex_unlock(&join->lock);
+
+	g_mutex_clear(&join->lock);
+	g_cond_clear(&join->done);
+}
+
+/*
+ * The spectrum is the average of the power of overlapping segments of the
+ * capture (Welch's method). The segments are split in batches, one per
+ * processor; the calling thread runs the first one, and the others run in
+ * parallel on fft_batch_pool. Each batch has its own input and output
+ * arrays, and sums the power of its segments on its own.
+ */
+struct fft_batch {
+	struct _fft_settings *settings;
+	void *in;
+	void *out;
+	float *power;
+	unsigned int first;
+	unsigned int count;
+	unsigned int hop;
+	struct pool_join *join;
+};
+
+static GThreadPool *fft_batch_pool;
+
+/* Number of samples used by @segments segments overlapping by half */
+static unsigned int fft_welch_length(unsigned int fft_size,
+		unsigned int segments)
+{
+	return fft_size + (MAX(segments, 1) - 1) * (fft_size / 2);
+}
+
+static void fft_batch_run(struct fft_batch *batch)
+{
+	struct _fft_settings *settings = batch->settings;
+	struct _fft_alg_data *fft = &settings->fft_alg_data;
+	const struct window *win = fft->window;
+	unsigned int fft_size = settings->fft_size;
+	unsigned int seg, i;
+
+	memset(batch->power, 0, sizeof(float) * fft->m);
+
+	for (seg = batch->first; seg < batch->first + batch->count; seg++) {
+		const gfloat *in_data = fft->src_re + seg * batch->hop;
+		const gfloat *in_data_c = fft->src_im + seg * batch->hop;
+
+		/* normalization and scaling see fft_corr */
+		if (!fft->use_double && fft->is_complex) {
+			dsp_window_complex(batch->in, in_data, in_data_c,
+					win->coefs_f, fft_size);
+		} else if (!fft->use_double) {
+			dsp_window_real(batch->in, in_data, win->coefs_f,
+					fft_size);
+		} else if (fft->is_complex) {
+			fftw_complex *in_c = batch->in;
+
+			for (i = 0; i < fft_size; i++)
+				in_c[i] = in_data[i] * win->coefs[i] + I * in_data_c[i] * win->coefs[i];
+		} else {
+			double *in = batch->in;
+
+			for (i = 0; i < fft_size; i++)
+				in[i] = in_data[i] * win->coefs[i];
+		}
+
+		fft_plan_execute_shared(fft->plan_forward,
+				batch->in, batch->out);
+
+		if (fft->use_double)
+			dsp_power_add_double(batch->power, batch->out, fft->m);
+		else
+			dsp_power_add(batch->power, batch->out, fft->m);
+	}
+}
+
+static void fft_batch_func(gpointer data, gpointer user_data)
+{
+	struct fft_batch *batch = data;
+
+	fft_batch_run(batch);
+	pool_join_done(batch->join);
+}
+
+static void fft_alg_data_free(struct _fft_alg_data *fft)
+{
+	unsigned int i;
+
+	for (i = 0; i < fft->nb_batches; i++) {
+		fftw_free(fft->batches[i].in);
+		fftw_free(fft->batches[i].out);
+		fftwf_free(fft->batches[i].power);
+	}
+	g_free(fft->batches);
+
+	fft_plan_free(fft->plan_forward);
+	window_put(fft->window);
+	fftwf_free(fft->power);
+	fftwf_free(fft->mag);
+	if (fft->ddc)
+		ddc_free(fft->ddc);
+	g_free(fft->zoom_re);
+	g_free(fft->zoom_im);
+	g_free(fft->in_re);
+	g_free(fft->in_im);
+
+	fft->plan_forward = NULL;
+	fft->batches = NULL;
+	fft->nb_batches = 0;
+	fft->window = NULL;
+	fft->power = fft->mag = NULL;
+	fft->ddc = NULL;
+	fft->zoom_re = fft->zoom_im = NULL;
+	fft->zoom_length = 0;
+	fft->in_re = fft->in_im = NULL;
+	fft->in_length = 0;
+}
+
+static int fft_alg_data_alloc(struct _fft_settings *settings)
+{
+	struct _fft_alg_data *fft = &settings->fft_alg_data;
+	unsigned int fft_size = settings->fft_size;
+	size_t in_size, out_size;
+	unsigned int i;
+
+	fft->use_double = fft_plan_get_double();
+	fft->m = fft->is_complex ? fft_size : fft_size / 2;
+	fft->power = fftwf_malloc(sizeof(float) * fft->m);
+	fft->mag = fftwf_malloc(sizeof(float) * fft->m);
+	if (!fft->power || !fft->mag)
+		return -ENOMEM;
+
+	fft->window = window_get(settings->window, settings->window_beta,
+			fft_size);
+	if (!fft->window)
+		return -ENOMEM;
+
+	if (fft->use_double) {
+		in_size = fft->is_complex ?
+			sizeof(fftw_complex) : sizeof(double);
+		out_size = sizeof(fftw_complex);
+	} else {
+		in_size = fft->is_complex ?
+			sizeof(fftwf_complex) : sizeof(float);
+		out_size = sizeof(fftwf_complex);
+	}
+
+	fft->nb_batches = fft_batch_pool ? MIN(g_get_num_processors(),
+			MAX(settings->welch_segments, 1)) : 1;
+	fft->batches = g_new0(struct fft_batch, fft->nb_batches);
+
+	for (i = 0; i < fft->nb_batches; i++) {
+		struct fft_batch *batch = &fft->batches[i];
+
+		/* fftw_malloc() and fftwf_malloc() align the same way */
+		batch->settings = settings;
+		batch->in = fftw_malloc(in_size * fft_size);
+		batch->out = fftw_malloc(out_size * (fft->m + 1));
+		batch->power = fftwf_malloc(sizeof(float) * fft->m);
+		if (!batch->in || !batch->out || !batch->power)
+			return -ENOMEM;
+	}
+
+	if (settings->zoom > 1) {
+		fft->ddc = ddc_new(settings->zoom);
+		if (!fft->ddc)
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+/* Number of samples the spectrum is made of, before the decimation of the
+ * zoom mode */
+static unsigned int fft_input_length(unsigned int fft_size,
+		unsigned int segments, unsigned int zoom)
+{
+	unsigned int length = fft_welch_length(fft_size, segments);
+
+	return zoom > 1 ? ddc_input_length(zoom, length) : length;
+}
+
+/* Number of samples of the capture that the spectrum is made of */
+static unsigned int fft_capture_length(Transform *tr)
+{
+	struct _fft_settings *settings = tr->settings;
+	struct iio_device *iio_dev = transform_get_device_parent(tr);
+	struct extra_dev_info *dev_info = iio_device_get_data(iio_dev);
+
+	return MIN(fft_input_length(settings->fft_size,
+				settings->welch_segments, settings->zoom),
+			dev_info->sample_count);
+}
+
+/*
+ * Store in @maxX the bins of the highest local maxima of @data, by
+ * decreasing value, one per active marker and at least two. Bins past the
+ * peaks that were found are left alone.
+ */
+static void markers_find_peaks(const struct marker_type *markers,
+		unsigned int max_markers, const gfloat *data, size_t n,
+		bool absolute, unsigned int *maxX)
 {
-	double a = 2.0 * M_PI / (n - 1), w;
+	unsigned int k;
+	float *values;
 
-	w = 0.5 * (1.0 - cos(a * j));
+	for (k = 0; k <= max_markers && markers[k].active; k++);
+	k = MAX(k, 2);
 
-	return (w);
+	values = g_new(float, k);
+	dsp_find_peaks(data, n, absolute, -200.0f, maxX, values, k);
+	g_free(values);
 }
 
-static void do_fft(Transform *tr)
+/* Plugins get the first MAX_MARKERS markers, whatever the plot has */
+static void markers_copy_out(struct marker_type *dst,
+		const struct marker_type *markers, unsigned int max_markers)
+{
+	unsigned int n = MIN(max_markers + 1, MAX_MARKERS);
+
+	memcpy(dst, markers, sizeof(*dst) * n);
+	memset(dst + n, 0, sizeof(*dst) * (MAX_MARKERS + 2 - n));
+}
+
+/* Returns false if no new spectrum could be computed */
+static bool do_fft(Transform *tr)
 {
 	struct _fft_settings *settings = tr->settings;
 	struct _fft_alg_data *fft = &settings->fft_alg_data;
 	struct marker_type *markers = settings->markers;
 	enum marker_types marker_type = MARKER_OFF;
-	gfloat *in_data = settings->real_source;
-	gfloat *in_data_c;
 	gfloat *out_data = tr->y_axis;
 	gfloat *X = tr->x_axis;
 	unsigned int fft_size = settings->fft_size;
+	unsigned int length, nb_segments, per_batch, nb_batches, hop, half;
 	int i, j, k;
-	int cnt;
-	gfloat mag;
-	double avg, pwr_offset;
-	unsigned int maxX[MAX_MARKERS + 1];
-	gfloat maxY[MAX_MARKERS + 1];
+	double db_offset, win_corr;
+	unsigned int max_markers = settings->max_markers;
+	unsigned int *maxX;
 	gfloat plugin_fft_corr;
+	struct pool_join join;
 
 	if (settings->marker_type)
 		marker_type = *((enum marker_types *)settings->marker_type);
 
-	if ((fft->cached_fft_size == -1) || (fft->cached_fft_size != fft_size) ||
-		(fft->cached_num_active_channels != fft->num_active_channels)) {
-
-		if (fft->cached_fft_size != -1) {
-			fftw_destroy_plan(fft->plan_forward);
-			fftw_free(fft->win);
-			fftw_free(fft->out);
-			if (fft->in != NULL)
-				fftw_free(fft->in);
-			if (fft->in_c != NULL)
-				fftw_free(fft->in_c);
-			fft->in_c = NULL;
-			fft->in = NULL;
-		}
+	/* The tone markers look for DC and harmonics, which are usually not
+	 * in a zoomed in span */
+	if (fft->ddc && marker_type != MARKER_OFF && marker_type != MARKER_FIXED)
+		marker_type = MARKER_PEAK;
 
-		fft->win = fftw_malloc(sizeof(double) * fft_size);
-		if (fft->num_active_channels == 2) {
-			fft->m = fft_size;
-			fft->in_c = fftw_malloc(sizeof(fftw_complex) * fft_size);
-			fft->in = NULL;
-			fft->out = fftw_malloc(sizeof(fftw_complex) * (fft->m + 1));
-			fft->plan_forward = fftw_plan_dft_1d(fft_size, fft->in_c, fft->out, FFTW_FORWARD, FFTW_ESTIMATE);
-		} else {
-			fft->m = fft_size / 2;
-			fft->out = fftw_malloc(sizeof(fftw_complex) * (fft->m + 1));
-			fft->in_c = NULL;
-			fft->in = fftw_malloc(sizeof(double) * fft_size);
-			fft->plan_forward = fftw_plan_dft_r2c_1d(fft_size, fft->in, fft->out, FFTW_ESTIMATE);
-		}
+	if ((fft->cached_fft_size == -1) || (fft->cached_fft_size != fft_size) ||
+		(fft->cached_num_active_channels != fft->num_active_channels) ||
+		(fft->use_double != fft_plan_get_double())) {
 
-		for (i = 0; i < fft_size; i ++)
-			fft->win[i] = win_hanning(i, fft_size);
+		if (fft->cached_fft_size != -1)
+			fft_alg_data_free(fft);
 
 		fft->cached_fft_size = fft_size;
 		fft->cached_num_active_channels = fft->num_active_channels;
-	}
 
-	if (fft->num_active_channels == 2) {
-		in_data_c = settings->imag_source;
-		for (cnt = 0, i = 0; cnt < fft_size; cnt++) {
-			/* normalization and scaling see fft_corr */
-			fft->in_c[cnt] = in_data[i] * fft->win[cnt] + I * in_data_c[i] * fft->win[cnt];
-			i++;
-		}
-	} else {
-		for (cnt = 0, i = 0; i < fft_size; i++) {
-			/* normalization and scaling see fft_corr */
-			fft->in[cnt] = in_data[i] * fft->win[cnt];
-			cnt++;
+		if (fft_alg_data_alloc(settings) < 0) {
+			fprintf(stderr, "Unable to allocate a %u points FFT\n",
+					fft_size);
+			fft_alg_data_free(fft);
+			fft->cached_fft_size = -1;
+			return false;
 		}
 	}
 
+	if (!fft->plan_forward) {
+		enum fft_plan_type type;
+
+		if (fft->use_double && fft->is_complex)
+			type = FFT_PLAN_FORWARD;
+		else if (fft->use_double)
+			type = FFT_PLAN_R2C;
+		else if (fft->is_complex)
+			type = FFT_PLAN_FORWARD_F;
+		else
+			type = FFT_PLAN_R2C_F;
+
+		fft->plan_forward = fft_plan_new(type, fft_size,
+				fft->batches[0].in, fft->batches[0].out);
+
+		if (!fft->plan_forward)
+			return false;
+	}
+
 	struct iio_device *iio_dev = transform_get_device_parent(tr);
 	struct extra_dev_info *dev_info = iio_device_get_data(iio_dev);
 	plugin_fft_corr = dev_info->plugin_fft_corr;
 
-	fftw_execute(fft->plan_forward);
-	avg = (double)settings->fft_avg;
-	if (avg && avg != 128 )
-		avg = 1.0f / avg;
+	/* Only the first samples of the capture are used, they are read
+	 * from it instead of going through float views of the channels */
+	length = fft_capture_length(tr);
+	if (fft->in_length < length) {
+		fft->in_re = g_renew(float, fft->in_re, length);
+		if (fft->num_active_channels == 2)
+			fft->in_im = g_renew(float, fft->in_im, length);
+		fft->in_length = length;
+	}
+	if (!plot_channels_read_nth(tr->plot_channels, 0, 0, fft->in_re,
+				length))
+		return false;
+	if (fft->num_active_channels == 2 && !plot_channels_read_nth(
+				tr->plot_channels, 1, 0, fft->in_im, length))
+		return false;
+	fft->src_re = fft->in_re;
+	fft->src_im = fft->in_im;
+
+	if (fft->ddc) {
+		if (fft->zoom_length < length) {
+			fft->zoom_re = g_renew(float, fft->zoom_re, length);
+			fft->zoom_im = g_renew(float, fft->zoom_im, length);
+			fft->zoom_length = length;
+		}
+
+		length = ddc_process(fft->ddc, fft->in_re,
+				fft->num_active_channels == 2 ?
+					fft->in_im : NULL,
+				length, settings->zoom_center / dev_info->adc_freq,
+				fft->zoom_re, fft->zoom_im);
+		fft->src_re = fft->zoom_re;
+		fft->src_im = fft->zoom_im;
+	}
+
+	if (length < fft_size)
+		return false;
+
+	hop = fft_size / 2;
+	nb_segments = (length - fft_size) / hop + 1;
+	per_batch = (nb_segments + fft->nb_batches - 1) / fft->nb_batches;
+	nb_batches = (nb_segments + per_batch - 1) / per_batch;
+
+	pool_join_init(&join, nb_batches - 1);
+
+	/* The batches run the same plan concurrently */
+	fft_plan_update(fft->plan_forward);
 
-	pwr_offset = settings->fft_pwr_off;
+	for (i = 0; i < nb_batches; i++) {
+		struct fft_batch *batch = &fft->batches[i];
 
-	for (j = 0; j <= MAX_MARKERS; j++) {
-		maxX[j] = 0;
-		maxY[j] = -200.0f;
+		batch->first = i * per_batch;
+		batch->count = MIN(per_batch, nb_segments - batch->first);
+		batch->hop = hop;
+		batch->join = &join;
+
+		if (i)
+			g_thread_pool_push(fft_batch_pool, batch, NULL);
 	}
 
-	for (i = 0; i < fft->m; ++i) {
-		if (fft->num_active_channels == 2) {
-			if (i < (fft->m / 2))
-				j = i + (fft->m / 2);
-			else
-				j = i - (fft->m / 2);
-		} else {
-				j = i;
-		}
+	fft_batch_run(&fft->batches[0]);
+	pool_join_wait(&join);
+
+	/* Sum the batches, with DC in the middle for complex spectra */
+	half = fft->is_complex ? fft->m / 2 : 0;
+	for (i = 0; i < nb_batches; i++) {
+		float *power = fft->batches[i].power;
 
-		if (creal(fft->out[j]) == 0 && cimag(fft->out[j]) == 0)
-			fft->out[j] = FLT_MIN + I * FLT_MIN;
-
-		mag = 10 * log10((creal(fft->out[j]) * creal(fft->out[j]) +
-				cimag(fft->out[j]) * cimag(fft->out[j])) / ((unsigned long long)fft->m * fft->m)) +
-			fft->fft_corr + pwr_offset + plugin_fft_corr;
-		/* it's better for performance to have separate loops,
-		 * rather than do these tests inside the loop, but it makes
-		 * the code harder to understand... Oh well...
-		 ***/
-		if (out_data[i] == FLT_MAX) {
-			/* Don't average the first iteration */
-			 out_data[i] = mag;
-		} else if (!avg) {
-			/* keep peaks */
-			if (out_data[i] <= mag)
-				out_data[i] = mag;
-		} else if (avg == 128) {
-			/* keep min */
-			if (out_data[i] >= mag)
-				out_data[i] = mag;
+		if (i) {
+			dsp_add(fft->power, power + half, fft->m - half);
+			dsp_add(fft->power + fft->m - half, power, half);
 		} else {
-			/* do an average */
-			out_data[i] = ((1 - avg) * out_data[i]) + (avg * mag);
-		}
-		if (!settings->markers || i < 2)
-			continue;
-		if (MAX_MARKERS && (marker_type == MARKER_PEAK ||
-				marker_type == MARKER_ONE_TONE ||
-				marker_type == MARKER_IMAGE)) {
-			if (i == 0) {
-				maxX[0] = 0;
-				maxY[0] = out_data[0];
-			} else {
-				for (j = 0; j <= MAX_MARKERS && markers[j].active; j++) {
-					if  ((out_data[i - 1] > maxY[j]) &&
-						((!((out_data[i - 2] > out_data[i - 1]) &&
-						 (out_data[i - 1] > out_data[i]))) &&
-						 (!((out_data[i - 2] < out_data[i - 1]) &&
-						 (out_data[i - 1] < out_data[i]))))) {
-						if (marker_type == MARKER_PEAK) {
-							for (k = MAX_MARKERS; k > j; k--) {
-								maxY[k] = maxY[k - 1];
-								maxX[k] = maxX[k - 1];
-							}
-						}
-						maxY[j] = out_data[i - 1];
-						maxX[j] = i - 1;
-						break;
-					}
-				}
-			}
+			memcpy(fft->power, power + half,
+					sizeof(float) * (fft->m - half));
+			memcpy(fft->power + fft->m - half, power,
+					sizeof(float) * half);
 		}
 	}
 
+	/* normalization and scaling see fft_corr, which the window's gain
+	 * on tones (or on noise, for plugins that want a density) is taken
+	 * out of; the sum of the segments is turned into their mean here too */
+	win_corr = -20 * log10(fft->window->coherent_gain);
+	if (dev_info->plugin_fft_enbw_corr)
+		win_corr -= 10 * log10(fft->window->enbw);
+	db_offset = fft->fft_corr + win_corr + settings->fft_pwr_off +
+		plugin_fft_corr -
+		10 * log10((double) fft->m * fft->m * nb_segments);
+	dsp_power_to_db(fft->mag, fft->power, db_offset, fft->m);
+
+	if (out_data[0] == FLT_MAX) {
+		/* Don't average the first iteration */
+		memcpy(out_data, fft->mag, sizeof(float) * fft->m);
+	} else if (!settings->fft_avg) {
+		/* keep peaks */
+		dsp_max(out_data, fft->mag, fft->m);
+	} else if (settings->fft_avg == 128) {
+		/* keep min */
+		dsp_min(out_data, fft->mag, fft->m);
+	} else {
+		/* do an average */
+		dsp_ema(out_data, fft->mag, 1.0f / settings->fft_avg, fft->m);
+	}
+
 	if (!settings->markers)
-		return;
+		return true;
+
+	/* The tone markers need the two highest peaks, in case one is DC */
+	maxX = g_new0(unsigned int, max_markers + 2);
+	if (marker_type == MARKER_PEAK || marker_type == MARKER_ONE_TONE ||
+			marker_type == MARKER_IMAGE)
+		markers_find_peaks(markers, max_markers, out_data, fft->m,
+				false, maxX);
 
 	unsigned int m = fft->m;
 
@@ -945,8 +1289,8 @@ static void do_fft(Transform *tr)
 		maxX[0] = max_tmp;
 	}
 
-	if (MAX_MARKERS && marker_type != MARKER_OFF) {
-		for (j = 0; j <= MAX_MARKERS && markers[j].active; j++) {
+	if (marker_type != MARKER_OFF) {
+		for (j = 0; j <= max_markers && markers[j].active; j++) {
 			if (marker_type == MARKER_PEAK) {
 				markers[j].x = (gfloat)X[maxX[j]];
 				markers[j].y = (gfloat)out_data[maxX[j]];
@@ -1017,80 +1361,169 @@ static void do_fft(Transform *tr)
 
 			}
 			if (fft->num_active_channels == 2) {
-				markers[j].vector = I * settings->imag_source[markers[j].bin] +
-					in_data[markers[j].bin];
+				markers[j].vector = I * fft->in_im[markers[j].bin] +
+					fft->in_re[markers[j].bin];
 			} else {
 				markers[j].vector = 0 + I * 0;
 			}
 		}
 		if (settings->markers_copy && *settings->markers_copy) {
-			memcpy(*settings->markers_copy, settings->markers,
-				sizeof(struct marker_type) * MAX_MARKERS);
+			markers_copy_out(*settings->markers_copy,
+					settings->markers, max_markers);
 			*settings->markers_copy = NULL;
 			g_mutex_unlock(settings->marker_lock);
 		}
 	}
+
+	g_free(maxX);
+
+	return true;
+}
+
+static void xcorr_data_free(struct _cross_correlation_settings *settings)
+{
+	fft_plan_free(settings->plan_forward);
+	fft_plan_free(settings->plan_backward);
+	fftw_free(settings->signal_a);
+	fftw_free(settings->signal_b);
+	fftw_free(settings->spectrum_a);
+	fftw_free(settings->spectrum_b);
+	fftw_free(settings->xcorr_data);
+
+	settings->plan_forward = settings->plan_backward = NULL;
+	settings->signal_a = settings->signal_b = NULL;
+	settings->spectrum_a = settings->spectrum_b = NULL;
+	settings->xcorr_data = NULL;
+	settings->fft_size = 0;
 }
 
-static void xcorr(fftw_complex *signala, fftw_complex *signalb, fftw_complex *result, int N)
+static int xcorr_data_alloc(struct _cross_correlation_settings *settings)
 {
-	fftw_complex * signala_ext = (fftw_complex *) fftw_malloc(sizeof(fftw_complex) * (2 * N - 1));
-	fftw_complex * signalb_ext = (fftw_complex *) fftw_malloc(sizeof(fftw_complex) * (2 * N - 1));
-	fftw_complex * outa = (fftw_complex *) fftw_malloc(sizeof(fftw_complex) * (2 * N - 1));
-	fftw_complex * outb = (fftw_complex *) fftw_malloc(sizeof(fftw_complex) * (2 * N - 1));
-	fftw_complex * out = (fftw_complex *) fftw_malloc(sizeof(fftw_complex) * (2 * N - 1));
+	unsigned int n = settings->num_samples;
+	size_t size;
+
+	settings->fft_size = fft_plan_good_size(2 * n - 1);
+	size = sizeof(fftw_complex) * settings->fft_size;
+
+	settings->signal_a = fftw_malloc(size);
+	settings->signal_b = fftw_malloc(size);
+	settings->spectrum_a = fftw_malloc(size);
+	settings->spectrum_b = fftw_malloc(size);
+	settings->xcorr_data = fftw_malloc(size);
+	if (!settings->signal_a || !settings->signal_b ||
+			!settings->spectrum_a || !settings->spectrum_b ||
+			!settings->xcorr_data) {
+		xcorr_data_free(settings);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*
+ * Correlate signal_a, which holds the first signal after num_samples - 1
+ * zeros, with signal_b, which holds the second one at its start. Element i
+ * of xcorr_data is then the correlation at lag i - (num_samples - 1); the
+ * padding up to fft_size is long enough for the circular correlation not to
+ * wrap onto these 2 * num_samples - 1 lags.
+ */
+static int xcorr(struct _cross_correlation_settings *settings)
+{
+	unsigned int i, n = settings->fft_size;
 	fftw_complex scale;
-	int i;
 
-	if (!signala_ext || !signalb_ext || !outa || !outb || !out)
-		return;
+	if (!settings->plan_forward)
+		settings->plan_forward = fft_plan_new(FFT_PLAN_FORWARD, n,
+				settings->signal_a, settings->spectrum_a);
+	if (!settings->plan_backward)
+		settings->plan_backward = fft_plan_new(FFT_PLAN_BACKWARD, n,
+				settings->spectrum_a, settings->xcorr_data);
+	if (!settings->plan_forward || !settings->plan_backward)
+		return -ENOMEM;
 
-	fftw_plan pa = fftw_plan_dft_1d(2 * N - 1, signala_ext, outa, FFTW_FORWARD, FFTW_ESTIMATE);
-	fftw_plan pb = fftw_plan_dft_1d(2 * N - 1, signalb_ext, outb, FFTW_FORWARD, FFTW_ESTIMATE);
-	fftw_plan px = fftw_plan_dft_1d(2 * N - 1, out, result, FFTW_BACKWARD, FFTW_ESTIMATE);
+	/* Both forward transforms have the same layout and share a plan */
+	fft_plan_execute(settings->plan_forward,
+			settings->signal_a, settings->spectrum_a);
+	fft_plan_execute(settings->plan_forward,
+			settings->signal_b, settings->spectrum_b);
+
+	scale = 1.0 / n;
+	for (i = 0; i < n; i++)
+		settings->spectrum_a[i] *= conj(settings->spectrum_b[i]) * scale;
+
+	fft_plan_execute(settings->plan_backward,
+			settings->spectrum_a, settings->xcorr_data);
+
+	return 0;
+}
 
-	//zeropadding
-	memset(signala_ext, 0, sizeof(fftw_complex) * (N - 1));
-	memcpy(signala_ext + (N - 1), signala, sizeof(fftw_complex) * N);
-	memcpy(signalb_ext, signalb, sizeof(fftw_complex) * N);
-	memset(signalb_ext + N, 0, sizeof(fftw_complex) * (N - 1));
+/*
+ * The transforms read the samples of their channels from the capture, in
+ * blocks of TRANSFORM_BLOCK_SAMPLES when they work on them as they go, so
+ * that long captures never need a contiguous float copy of each channel.
+ */
+#define TRANSFORM_BLOCK_SAMPLES 4096
 
-	fftw_execute(pa);
-	fftw_execute(pb);
+/* A multiplication by one or an addition of zero is skipped, so functions
+ * that change nothing leave the y axis as the samples were read */
+static enum time_kernel time_kernel_select(const struct _time_settings *settings)
+{
+	bool scale = settings->apply_multiply_funct &&
+		settings->multiply_value != 1.0f;
+	bool offset = settings->apply_add_funct && settings->add_value != 0.0f;
 
-	scale = 1.0/(2 * N -1);
-	for (i = 0; i < 2 * N - 1; i++)
-		out[i] = outa[i] * conj(outb[i]) * scale;
+	if (settings->apply_inverse_funct)
+		return TIME_KERNEL_RECIPROCAL;
+	if (scale && offset)
+		return TIME_KERNEL_SCALE_OFFSET;
+	if (scale)
+		return TIME_KERNEL_SCALE;
+	if (offset)
+		return TIME_KERNEL_OFFSET;
 
-	fftw_execute(px);
+	return TIME_KERNEL_NONE;
+}
 
-	fftw_destroy_plan(pa);
-	fftw_destroy_plan(pb);
-	fftw_destroy_plan(px);
+/*
+ * Set up the density graph the traces are accumulated into: over the x axis
+ * of the plot, or for an eye diagram over two symbols, each sample then
+ * going at its offset from the start of the pair of symbols it falls in.
+ * The folded axis only depends on the settings, so it is computed here and
+ * the frames cost the binning alone.
+ */
+static void time_density_setup(Transform *tr)
+{
+	struct _time_settings *settings = tr->settings;
+	unsigned int i, axis_length = settings->num_samples;
+	double dx, span;
 
-	fftw_free(signala_ext);
-	fftw_free(signalb_ext);
-	fftw_free(out);
-	fftw_free(outa);
-	fftw_free(outb);
+	g_free(settings->eye_x_axis);
+	settings->eye_x_axis = NULL;
+	density_set_persistence(settings->density, settings->persistence);
 
-	fftw_cleanup();
+	if (settings->eye_period <= 0.0f || !axis_length) {
+		density_set_x_range(settings->density, tr->x_axis[0],
+				tr->x_axis[axis_length ? axis_length - 1 : 0]);
+		return;
+	}
 
-	return;
+	dx = settings->max_x_axis ? (double) settings->max_x_axis / axis_length : 1.0;
+	span = 2.0 * settings->eye_period;
+	settings->eye_x_axis = g_new(gfloat, axis_length);
+	for (i = 0; i < axis_length; i++)
+		settings->eye_x_axis[i] = fmod(i, span) * dx;
+	density_set_x_range(settings->density, 0.0f, span * dx);
 }
 
 void time_transform_function(Transform *tr, gboolean init_transform)
 {
 	struct _time_settings *settings = tr->settings;
 	unsigned axis_length = settings->num_samples;
-	gfloat *in_data;
+	gfloat scale, offset;
+	size_t pos, len;
 	int i;
 
 	if (init_transform) {
-
-		/* Set the sources of the transfrom */
-		settings->data_source = plot_channels_get_nth_data_ref(tr->plot_channels, 0);
-
 		/* Initialize axis */
 		Transform_resize_x_axis(tr, axis_length);
 		for (i = 0; i < axis_length; i++) {
@@ -1099,15 +1532,12 @@ void time_transform_function(Transform *tr, gboolean init_transform)
 			else
 				tr->x_axis[i] = i;
 		}
-		tr->y_axis_size = axis_length;
+		Transform_resize_y_axis(tr, axis_length);
 
-		if (settings->apply_inverse_funct ||
-				settings->apply_multiply_funct ||
-				settings->apply_add_funct) {
-			Transform_resize_y_axis(tr, tr->y_axis_size);
-		} else {
-			tr->y_axis = settings->data_source;
-		}
+		settings->kernel = time_kernel_select(settings);
+
+		if (settings->density)
+			time_density_setup(tr);
 
 		return;
 	}
@@ -1116,65 +1546,75 @@ void time_transform_function(Transform *tr, gboolean init_transform)
 		PlotMathChn *m = tr->plot_channels->data;
 		m->math_expression(m->iio_channels_data,
 			m->data_ref, settings->num_samples);
-	} else if (tr->plot_channels_type == PLOT_IIO_CHANNEL) {
-		if (!settings->apply_inverse_funct &&
-				!settings->apply_multiply_funct &&
-				!settings->apply_add_funct)
-			return;
+	}
 
-		in_data = plot_channels_get_nth_data_ref(tr->plot_channels, 0);
-		if (!in_data)
+	scale = settings->apply_multiply_funct ?
+		settings->multiply_value : 1.0f;
+	offset = settings->apply_add_funct ? settings->add_value : 0.0f;
+
+	/* The functions are applied to each block while it is in cache */
+	for (pos = 0; pos < tr->y_axis_size; pos += len) {
+		gfloat *y = tr->y_axis + pos;
+
+		len = MIN(TRANSFORM_BLOCK_SAMPLES, tr->y_axis_size - pos);
+		if (!plot_channels_read_nth(tr->plot_channels, 0, pos, y, len)) {
+			tr->updated = false;
 			return;
+		}
 
-		for (i = 0; i < tr->y_axis_size; i++) {
-			if (settings->apply_inverse_funct) {
-				if (in_data[i] != 0)
-					tr->y_axis[i] = 1 / in_data[i];
-				else
-					tr->y_axis[i] = 65535;
-			} else {
-				tr->y_axis[i] = in_data[i];
-			}
-			if (settings->apply_multiply_funct)
-				tr->y_axis[i] *= settings->multiply_value;
-			if (settings->apply_add_funct)
-				tr->y_axis[i] += settings->add_value;
+		switch (settings->kernel) {
+		case TIME_KERNEL_SCALE:
+			dsp_scale(y, y, scale, len);
+			break;
+		case TIME_KERNEL_OFFSET:
+			dsp_offset(y, y, offset, len);
+			break;
+		case TIME_KERNEL_SCALE_OFFSET:
+			dsp_scale_offset(y, y, scale, offset, len);
+			break;
+		case TIME_KERNEL_RECIPROCAL:
+			dsp_reciprocal(y, y, 65535, scale, offset, len);
+			break;
+		default:
+			break;
 		}
 	}
+
+	if (settings->density)
+		density_add(settings->density, settings->eye_x_axis ?: tr->x_axis,
+				tr->y_axis, tr->y_axis_size);
+	if (settings->envelope)
+		envelope_invalidate(settings->envelope);
 }
 
 void cross_correlation_transform_function(Transform *tr, gboolean init_transform)
 {
 	struct _cross_correlation_settings *settings = tr->settings;
 	unsigned axis_length = settings->num_samples;
-	gfloat *i_0, *q_0;
-	gfloat *i_1, *q_1;
-	int i;
+	gfloat *block[4];
+	fftw_complex *signal_a, *signal_b;
+	size_t pos, len;
+	int i, c;
 
 	if (init_transform) {
-		/* Set the sources of the transfrom */
-		settings->i0_source = plot_channels_get_nth_data_ref(tr->plot_channels, 0);
-		settings->q0_source = plot_channels_get_nth_data_ref(tr->plot_channels, 1);
-		settings->i1_source = plot_channels_get_nth_data_ref(tr->plot_channels, 2);
-		settings->q1_source = plot_channels_get_nth_data_ref(tr->plot_channels, 3);
-
-		/* Initialize axis */
-		if (settings->signal_a) {
-			fftw_free(settings->signal_a);
-			settings->signal_a = NULL;
-		}
-		if (settings->signal_b) {
-			fftw_free(settings->signal_b);
-			settings->signal_b = NULL;
+		/* Keep the buffers and plans as long as the size is the same */
+		if (axis_length && settings->fft_size !=
+				fft_plan_good_size(2 * axis_length - 1)) {
+			xcorr_data_free(settings);
+			if (xcorr_data_alloc(settings) < 0)
+				fprintf(stderr, "Unable to allocate the cross correlation buffers\n");
 		}
-		if (settings->xcorr_data) {
-			fftw_free(settings->xcorr_data);
-			settings->xcorr_data = NULL;
+
+		/* Only the samples are written on each frame, the padding
+		 * around them stays zero */
+		if (settings->fft_size) {
+			memset(settings->signal_a, 0,
+					sizeof(fftw_complex) * settings->fft_size);
+			memset(settings->signal_b, 0,
+					sizeof(fftw_complex) * settings->fft_size);
 		}
-		settings->signal_a = (fftw_complex *) fftw_malloc(sizeof(fftw_complex) * axis_length);
-		settings->signal_b = (fftw_complex *) fftw_malloc(sizeof(fftw_complex) * axis_length);
-		settings->xcorr_data = (fftw_complex *) fftw_malloc(sizeof(fftw_complex) * axis_length * 2);
 
+		/* Initialize axis */
 		Transform_resize_x_axis(tr, 2 * axis_length);
 		Transform_resize_y_axis(tr, 2 * axis_length);
 		for (i = 0; i < 2 * axis_length - 1; i++) {
@@ -1195,85 +1635,98 @@ void cross_correlation_transform_function(Transform *tr, gboolean init_transform
 				m->data_ref, settings->num_samples);
 		}
 
-	i_0 = settings->i0_source;
-	q_0 = settings->q0_source;
-	i_1 = settings->i1_source;
-	q_1 = settings->q1_source;
+	if (!settings->fft_size) {
+		tr->updated = false;
+		return;
+	}
 
-	for (i = 0; i < axis_length; i++) {
-		settings->signal_a[i] = q_0[i] + I * i_0[i];
-		settings->signal_b[i] = q_1[i] + I * i_1[i];
+	if (settings->revert_xcorr) {
+		signal_a = settings->signal_b;
+		signal_b = settings->signal_a + axis_length - 1;
+	} else {
+		signal_a = settings->signal_a + axis_length - 1;
+		signal_b = settings->signal_b;
 	}
 
-	if (settings->revert_xcorr)
-		xcorr(settings->signal_b, settings->signal_a, settings->xcorr_data, axis_length);
-	else
-		xcorr(settings->signal_a, settings->signal_b, settings->xcorr_data, axis_length);
+	/* I0, Q0, I1 and Q1, a block at a time */
+	block[0] = g_new(gfloat, 4 * TRANSFORM_BLOCK_SAMPLES);
+	for (c = 1; c < 4; c++)
+		block[c] = block[0] + c * TRANSFORM_BLOCK_SAMPLES;
+
+	for (pos = 0; pos < axis_length; pos += len) {
+		len = MIN(TRANSFORM_BLOCK_SAMPLES, axis_length - pos);
+		for (c = 0; c < 4; c++)
+			if (!plot_channels_read_nth(tr->plot_channels, c, pos,
+						block[c], len))
+				break;
+		if (c < 4)
+			break;
+
+		for (i = 0; i < len; i++) {
+			signal_a[pos + i] = block[1][i] + I * block[0][i];
+			signal_b[pos + i] = block[3][i] + I * block[2][i];
+		}
+	}
+	g_free(block[0]);
+
+	if (pos < axis_length || xcorr(settings) < 0) {
+		tr->updated = false;
+		return;
+	}
 
 	gfloat *out_data = tr->y_axis;
 	gfloat *X = tr->x_axis;
 	struct marker_type *markers = settings->markers;
 	enum marker_types marker_type = MARKER_OFF;
-	unsigned int maxX[MAX_MARKERS + 1];
-	gfloat maxY[MAX_MARKERS + 1];
-	int j, k;
+	unsigned int max_markers = settings->max_markers;
+	unsigned int *maxX;
+	int j;
 
 	if (settings->marker_type)
 		marker_type = *((enum marker_types *)settings->marker_type);
 
-	for (j = 0; j <= MAX_MARKERS; j++) {
-		maxX[j] = 0;
-		maxY[j] = -200.0f;
-	}
-
-	for (i = 0; i < 2 * axis_length - 1; i++) {
+	for (i = 0; i < 2 * axis_length - 1; i++)
 		tr->y_axis[i] =  2 * creal(settings->xcorr_data[i]) / (gfloat)axis_length;
-		if (!settings->markers)
-			continue;
-
-		if (MAX_MARKERS && marker_type == MARKER_PEAK) {
-			if (i == 0) {
-				maxX[0] = 0;
-				maxY[0] = out_data[0];
-			} else {
-				for (j = 0; j <= MAX_MARKERS && markers[j].active; j++) {
-					if  ((fabs(out_data[i - 1]) > maxY[j]) &&
-						((!((out_data[i - 2] > out_data[i - 1]) &&
-						 (out_data[i - 1] > out_data[i]))) &&
-						 (!((out_data[i - 2] < out_data[i - 1]) &&
-						 (out_data[i - 1] < out_data[i]))))) {
-						if (marker_type == MARKER_PEAK) {
-							for (k = MAX_MARKERS; k > j; k--) {
-								maxY[k] = maxY[k - 1];
-								maxX[k] = maxX[k - 1];
-							}
-						}
-						maxY[j] = fabs(out_data[i - 1]);
-						maxX[j] = i - 1;
-						break;
-					}
-				}
-			}
-		}
-	}
 
 	if (!settings->markers)
 		return;
 
-	if (MAX_MARKERS && marker_type != MARKER_OFF) {
-		for (j = 0; j <= MAX_MARKERS && markers[j].active; j++)
+	maxX = g_new0(unsigned int, max_markers + 2);
+	if (marker_type == MARKER_PEAK)
+		markers_find_peaks(markers, max_markers, out_data,
+				2 * axis_length - 1, true, maxX);
+
+	if (marker_type != MARKER_OFF) {
+		for (j = 0; j <= max_markers && markers[j].active; j++)
 			if (marker_type == MARKER_PEAK) {
 				markers[j].x = (gfloat)X[maxX[j]];
 				markers[j].y = (gfloat)out_data[maxX[j]];
 				markers[j].bin = maxX[j];
 			}
 		if (settings->markers_copy && *settings->markers_copy) {
-			memcpy(*settings->markers_copy, settings->markers,
-				sizeof(struct marker_type) * MAX_MARKERS);
+			markers_copy_out(*settings->markers_copy,
+					settings->markers, max_markers);
 			*settings->markers_copy = NULL;
 			g_mutex_unlock(settings->marker_lock);
 		}
 	}
+
+	g_free(maxX);
+}
+
+/* Returns false if no new spectrum could be computed */
+static bool fft_transform_update(Transform *tr)
+{
+	GSList *node;
+
+	if (tr->plot_channels_type == PLOT_MATH_CHANNEL)
+		for (node = tr->plot_channels; node; node = g_slist_next(node)) {
+			PlotMathChn *m = node->data;
+			m->math_expression(m->iio_channels_data,
+				m->data_ref, fft_capture_length(tr));
+		}
+
+	return do_fft(tr);
 }
 
 void fft_transform_function(Transform *tr, gboolean init_transform)
@@ -1281,26 +1734,17 @@ void fft_transform_function(Transform *tr, gboolean init_transform)
 	struct iio_device *dev;
 	struct extra_dev_info *dev_info;
 	struct _fft_settings *settings = tr->settings;
-	unsigned num_samples;
 	unsigned axis_length;
-	unsigned int bits_used;
+	unsigned int bits_used, zoom;
 	double corr;
 	int i;
 
 	if (init_transform) {
-		/* Set the sources of the transfrom */
-		settings->real_source = plot_channels_get_nth_data_ref(tr->plot_channels, 0);
-		if (g_slist_length(tr->plot_channels) > 1)
-			settings->imag_source = plot_channels_get_nth_data_ref(tr->plot_channels, 1);
-
 		/* Initialize axis */
 		dev = transform_get_device_parent(tr);
 		if (!dev)
 			return;
 		dev_info = iio_device_get_data(dev);
-		num_samples = dev_info->sample_count;
-		if (dev_info->channel_trigger_enabled)
-			num_samples /= 2;
 
 		PlotChn *chn = (PlotChn *)tr->plot_channels->data;
 		struct iio_channel *iio_chn = NULL;
@@ -1319,40 +1763,66 @@ void fft_transform_function(Transform *tr, gboolean init_transform)
 
 		if (!bits_used)
 			return;
-		axis_length = settings->fft_size * settings->fft_alg_data.num_active_channels / 2;
+		/* When zoomed in, the spectrum is the one of the complex
+		 * output of the down-converter, centered on zoom_center */
+		zoom = MAX(settings->zoom, 1);
+		settings->fft_alg_data.is_complex =
+			settings->fft_alg_data.num_active_channels == 2 || zoom > 1;
+		axis_length = settings->fft_alg_data.is_complex ?
+			settings->fft_size : settings->fft_size / 2;
 		Transform_resize_x_axis(tr, axis_length);
 		Transform_resize_y_axis(tr, axis_length);
 		tr->y_axis_size = axis_length;
-		if (settings->fft_alg_data.num_active_channels == 2)
+		if (zoom > 1)
+			corr = dev_info->adc_freq / zoom / 2.0 - settings->zoom_center;
+		else if (settings->fft_alg_data.is_complex)
 			corr = dev_info->adc_freq / 2.0;
 		else
 			corr = 0;
 		for (i = 0; i < axis_length; i++) {
-			tr->x_axis[i] = i * dev_info->adc_freq / num_samples - corr;
+			tr->x_axis[i] = i * dev_info->adc_freq / zoom / settings->fft_size - corr;
 			tr->y_axis[i] = FLT_MAX;
 		}
 
-		/* Compute FFT normalization and scaling offset */
-		settings->fft_alg_data.fft_corr = 20 * log10(2.0 / (1ULL << (bits_used - 1)));
+		/* Compute FFT normalization and scaling offset; once mixed
+		 * down, only the positive frequency half of a real tone is
+		 * left, at half its amplitude */
+		settings->fft_alg_data.fft_corr = 20 * log10(1.0 / (1ULL << (bits_used - 1)));
+		if (zoom > 1 && settings->fft_alg_data.num_active_channels == 1)
+			settings->fft_alg_data.fft_corr += 20 * log10(2.0);
 
 		/* Make sure that previous positions of markers are not out of bonds */
 		if (settings->markers)
-			for (i = 0; i <= MAX_MARKERS; i++)
+			for (i = 0; i <= settings->max_markers; i++)
 				if (settings->markers[i].bin >= axis_length)
 					settings->markers[i].bin = 0;
 
 		return;
 	}
 
-	GSList *node;
+	tr->updated = fft_transform_update(tr);
+}
 
-	if (tr->plot_channels_type == PLOT_MATH_CHANNEL)
-		for (node = tr->plot_channels; node; node = g_slist_next(node)) {
-			PlotMathChn *m = node->data;
-			m->math_expression(m->iio_channels_data,
-				m->data_ref, settings->fft_size);
-		}
-	do_fft(tr);
+void waterfall_transform_function(Transform *tr, gboolean init_transform)
+{
+	struct _waterfall_settings *settings = tr->settings;
+
+	if (init_transform) {
+		fft_transform_function(tr, init_transform);
+		if (!tr->x_axis_size)
+			return;
+
+		/* Only clears the history if the number of bins changed */
+		waterfall_set_size(settings->graph, tr->y_axis_size,
+				settings->depth);
+		waterfall_set_x_range(settings->graph, tr->x_axis[0],
+				tr->x_axis[tr->x_axis_size - 1]);
+		return;
+	}
+
+	tr->updated = fft_transform_update(tr);
+	if (tr->updated)
+		waterfall_push(settings->graph, tr->y_axis);
 }
 
 void constellation_transform_function(Transform *tr, gboolean init_transform)
@@ -1361,15 +1831,15 @@ void constellation_transform_function(Transform *tr, gboolean init_transform)
 	unsigned axis_length = settings->num_samples;
 
 	if (init_transform) {
-		/* Set the sources of the transfrom */
-		settings->x_source = plot_channels_get_nth_data_ref(tr->plot_channels, 0);
-		settings->y_source = plot_channels_get_nth_data_ref(tr->plot_channels, 1);
-
 		/* Initialize axis */
-		tr->x_axis_size = axis_length;
-		tr->y_axis_size = axis_length;
-		tr->x_axis = settings->x_source;
-		tr->y_axis = settings->y_source;
+		Transform_resize_x_axis(tr, axis_length);
+		Transform_resize_y_axis(tr, axis_length);
+
+		if (settings->density) {
+			density_set_x_range(settings->density, 0.0f, 0.0f);
+			density_set_persistence(settings->density,
+					settings->persistence);
+		}
 
 		return;
 	}
@@ -1382,13 +1852,27 @@ void constellation_transform_function(Transform *tr, gboolean init_transform)
 			m->math_expression(m->iio_channels_data,
 				m->data_ref, settings->num_samples);
 		}
+
+	if (!plot_channels_read_nth(tr->plot_channels, 0, 0, tr->x_axis,
+				axis_length) ||
+			!plot_channels_read_nth(tr->plot_channels, 1, 0,
+				tr->y_axis, axis_length)) {
+		tr->updated = false;
+		return;
+	}
+
+	if (settings->density)
+		density_add(settings->density, tr->x_axis, tr->y_axis,
+				axis_length);
 }
 
 
 /* Plot iio channel definitions */
 
 static struct iio_device * plot_iio_channel_get_iio_parent(PlotChn *obj);
-static gfloat* plot_iio_channel_get_data_ref(PlotChn *obj);
+static ssize_t plot_iio_channel_read_data(PlotChn *obj, size_t pos,
+		gfloat *dst, size_t len);
+static void plot_iio_channel_update_data_ref(PlotChn *obj);
 static void plot_iio_channel_assert_channels(PlotChn *obj, bool assert);
 static void plot_iio_channel_destroy(PlotChn *obj);
 
@@ -1404,7 +1888,8 @@ static PlotIioChn * plot_iio_channel_new(void)
 
 	obj->base.type = PLOT_IIO_CHANNEL;
 	obj->base.get_iio_parent = *plot_iio_channel_get_iio_parent;
-	obj->base.get_data_ref = *plot_iio_channel_get_data_ref;
+	obj->base.read_data = *plot_iio_channel_read_data;
+	obj->base.update_data_ref = *plot_iio_channel_update_data_ref;
 	obj->base.assert_used_iio_channels = *plot_iio_channel_assert_channels;
 	obj->base.destroy = *plot_iio_channel_destroy;
 
@@ -1426,20 +1911,21 @@ static struct iio_device *plot_iio_channel_get_iio_parent(PlotChn *obj)
 	return iio_dev;
 }
 
-static gfloat* plot_iio_channel_get_data_ref(PlotChn *obj)
+static ssize_t plot_iio_channel_read_data(PlotChn *obj, size_t pos,
+		gfloat *dst, size_t len)
 {
 	PlotIioChn *this = (PlotIioChn *)obj;
-	gfloat *ref = NULL;
 
-	if (this && this->iio_chn) {
-		struct extra_info *ch_info;
+	if (!this || !this->iio_chn)
+		return -ENODATA;
 
-		ch_info = iio_channel_get_data(this->iio_chn);
-		if (ch_info)
-			ref = ch_info->data_ref;
-	}
+	return osc_channel_read_float(this->iio_chn, pos, dst, len);
+}
 
-	return ref;
+/* The transforms read the samples from the capture, segment by segment,
+ * there is no float view of the channel to update */
+static void plot_iio_channel_update_data_ref(PlotChn *obj)
+{
 }
 
 static void plot_iio_channel_assert_channels(PlotChn *obj, bool assert)
@@ -1470,7 +1956,9 @@ static void plot_iio_channel_destroy(PlotChn *obj)
 /* Plot math channel definitions */
 
 static struct iio_device * plot_math_channel_get_iio_parent(PlotChn *obj);
-static gfloat * plot_math_channel_get_data_ref(PlotChn *obj);
+static ssize_t plot_math_channel_read_data(PlotChn *obj, size_t pos,
+		gfloat *dst, size_t len);
+static void plot_math_channel_update_data_ref(PlotChn *obj);
 static void plot_math_channel_assert_channels(PlotChn *obj, bool assert);
 static void plot_math_channel_destroy(PlotChn *obj);
 
@@ -1486,7 +1974,8 @@ static PlotMathChn * plot_math_channel_new(void)
 
 	obj->base.type = PLOT_MATH_CHANNEL;
 	obj->base.get_iio_parent = *plot_math_channel_get_iio_parent;
-	obj->base.get_data_ref = *plot_math_channel_get_data_ref;
+	obj->base.read_data = *plot_math_channel_read_data;
+	obj->base.update_data_ref = *plot_math_channel_update_data_ref;
 	obj->base.assert_used_iio_channels = *plot_math_channel_assert_channels;
 	obj->base.destroy = *plot_math_channel_destroy;
 
@@ -1506,15 +1995,34 @@ static struct iio_device *plot_math_channel_get_iio_parent(PlotChn *obj)
 	return iio_dev;
 }
 
-static gfloat * plot_math_channel_get_data_ref(PlotChn *obj)
+/* The expression was computed for the whole capture, see
+ * plot_channels_update() */
+static ssize_t plot_math_channel_read_data(PlotChn *obj, size_t pos,
+		gfloat *dst, size_t len)
 {
 	PlotMathChn *this = (PlotMathChn *)obj;
-	gfloat *ref = NULL;
 
-	if (this)
-		ref = this->data_ref;
+	if (!this || !this->data_ref)
+		return -ENODATA;
+
+	memcpy(dst, this->data_ref + pos, sizeof(gfloat) * len);
+
+	return (ssize_t) len;
+}
 
-	return ref;
+static void update_channel_float_data(gpointer data, gpointer user_data)
+{
+	osc_channel_get_float_data(data);
+}
+
+static void plot_math_channel_update_data_ref(PlotChn *obj)
+{
+	PlotMathChn *this = (PlotMathChn *)obj;
+
+	/* The expression reads the float views of its source channels */
+	if (this && this->iio_channels)
+		g_slist_foreach(this->iio_channels,
+				update_channel_float_data, NULL);
 }
 
 static void plot_math_channel_assert_channels(PlotChn *obj, bool assert)
@@ -1687,6 +2195,12 @@ static gboolean check_valid_setup_of_device(OscPlot *plot, const char *name)
 				"FFT needs 4 or 2 or less channels");
 			return false;
 		}
+	} else if (plot_type == WATERFALL_PLOT) {
+		if (num_enabled != 2 && num_enabled != 1) {
+			gtk_widget_set_tooltip_text(priv->capture_button,
+				"Waterfall needs 2 or 1 channels");
+			return false;
+		}
 	} else if (plot_type == XY_PLOT) {
 		if (num_enabled != 2) {
 			gtk_widget_set_tooltip_text(priv->capture_button,
@@ -1849,6 +2363,11 @@ static int plot_get_sample_count_of_device(OscPlot *plot, const char *device)
 	switch (gtk_combo_box_get_active(GTK_COMBO_BOX(priv->hor_units))) {
 	case 0:
 		count = (int)osc_plot_get_sample_count(plot);
+		if (plot_domain_uses_fft(gtk_combo_box_get_active(GTK_COMBO_BOX(priv->plot_domain))))
+			count = fft_input_length(count, gtk_spin_button_get_value(
+					GTK_SPIN_BUTTON(priv->fft_welch_widget)),
+					comboboxtext_get_active_text_as_int(
+					GTK_COMBO_BOX_TEXT(priv->fft_zoom_widget)));
 		break;
 	case 1:
 		iio_dev = iio_context_find_device(ctx, device);
@@ -1895,9 +2414,14 @@ static void update_transform_settings(OscPlot *plot, Transform *transform)
 	int plot_type;
 
 	plot_type = gtk_combo_box_get_active(GTK_COMBO_BOX(priv->plot_domain));
-	if (plot_type == FFT_PLOT) {
+	if (plot_domain_uses_fft(plot_type)) {
 		FFT_SETTINGS(transform)->fft_size = comboboxtext_get_active_text_as_int(GTK_COMBO_BOX_TEXT(priv->fft_size_widget));
 		FFT_SETTINGS(transform)->fft_avg = gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->fft_avg_widget));
+		FFT_SETTINGS(transform)->welch_segments = gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->fft_welch_widget));
+		FFT_SETTINGS(transform)->window = gtk_combo_box_get_active(GTK_COMBO_BOX(priv->fft_window_widget));
+		FFT_SETTINGS(transform)->window_beta = gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->fft_window_beta_widget));
+		FFT_SETTINGS(transform)->zoom = comboboxtext_get_active_text_as_int(GTK_COMBO_BOX_TEXT(priv->fft_zoom_widget));
+		FFT_SETTINGS(transform)->zoom_center = gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->fft_zoom_center_widget));
 		FFT_SETTINGS(transform)->fft_pwr_off = gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->fft_pwr_offset_widget));
 		FFT_SETTINGS(transform)->fft_alg_data.cached_fft_size = -1;
 		FFT_SETTINGS(transform)->fft_alg_data.cached_num_active_channels = -1;
@@ -1906,6 +2430,8 @@ static void update_transform_settings(OscPlot *plot, Transform *transform)
 		FFT_SETTINGS(transform)->markers_copy = NULL;
 		FFT_SETTINGS(transform)->marker_lock = NULL;
 		FFT_SETTINGS(transform)->marker_type = NULL;
+		if (plot_type == WATERFALL_PLOT)
+			WATERFALL_SETTINGS(transform)->depth = gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->waterfall_depth_widget));
 	} else if (plot_type == TIME_PLOT) {
 		struct iio_device *iio_dev = transform_get_device_parent(transform);
 		int dev_samples;
@@ -1932,8 +2458,15 @@ static void update_transform_settings(OscPlot *plot, Transform *transform)
 			TIME_SETTINGS(transform)->add_value = set->add_value;
 			TIME_SETTINGS(transform)->max_x_axis = gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->sample_count_widget));
 		}
+		TIME_SETTINGS(transform)->persistence = gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->persistence_widget));
+		TIME_SETTINGS(transform)->eye_period = gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->eye_period_widget));
+		if (graph_type_is_density(priv) && !TIME_SETTINGS(transform)->density)
+			TIME_SETTINGS(transform)->density = density_new();
 	} else if (plot_type == XY_PLOT){
 		CONSTELLATION_SETTINGS(transform)->num_samples = gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->sample_count_widget));
+		CONSTELLATION_SETTINGS(transform)->persistence = gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->persistence_widget));
+		if (graph_type_is_density(priv) && !CONSTELLATION_SETTINGS(transform)->density)
+			CONSTELLATION_SETTINGS(transform)->density = density_new();
 	} else if (plot_type == XCORR_PLOT){
 		XCORR_SETTINGS(transform)->num_samples = gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->sample_count_widget));
 		XCORR_SETTINGS(transform)->revert_xcorr = 0;
@@ -1955,6 +2488,7 @@ static Transform* add_transform_to_list(OscPlot *plot, int tr_type, GSList *chan
 	struct _fft_settings *fft_settings;
 	struct _constellation_settings *constellation_settings;
 	struct _cross_correlation_settings *xcross_settings;
+	struct _waterfall_settings *waterfall_settings;
 	GSList *node;
 
 	transform = Transform_new(tr_type);
@@ -1998,6 +2532,12 @@ static Transform* add_transform_to_list(OscPlot *plot, int tr_type, GSList *chan
 		xcross_settings = (struct _cross_correlation_settings *)calloc(sizeof(struct _cross_correlation_settings), 1);
 		Transform_attach_settings(transform, xcross_settings);
 		break;
+	case WATERFALL_TRANSFORM:
+		Transform_attach_function(transform, waterfall_transform_function);
+		waterfall_settings = (struct _waterfall_settings *)calloc(sizeof(struct _waterfall_settings), 1);
+		waterfall_settings->graph = waterfall_new();
+		Transform_attach_settings(transform, waterfall_settings);
+		break;
 	default:
 		printf("Invalid transform\n");
 		return NULL;
@@ -2061,12 +2601,85 @@ static void remove_transform_from_list(OscPlot *plot, Transform *tr)
 
 	transform_remove_own_markers(tr);
 	TrList_remove_transform(list, tr);
+
+	/* Release what the transform functions allocated in the settings */
+	switch (tr->type_id) {
+	case FFT_TRANSFORM:
+	case COMPLEX_FFT_TRANSFORM:
+		fft_alg_data_free(&FFT_SETTINGS(tr)->fft_alg_data);
+		break;
+	case CROSS_CORRELATION_TRANSFORM:
+		xcorr_data_free(XCORR_SETTINGS(tr));
+		break;
+	case TIME_TRANSFORM:
+		g_free(TIME_SETTINGS(tr)->eye_x_axis);
+		if (TIME_SETTINGS(tr)->density) {
+			gtk_databox_graph_remove(GTK_DATABOX(priv->databox),
+					TIME_SETTINGS(tr)->density);
+			g_object_unref(TIME_SETTINGS(tr)->density);
+		}
+		if (TIME_SETTINGS(tr)->envelope) {
+			gtk_databox_graph_remove(GTK_DATABOX(priv->databox),
+					TIME_SETTINGS(tr)->envelope);
+			g_object_unref(TIME_SETTINGS(tr)->envelope);
+		}
+		break;
+	case CONSTELLATION_TRANSFORM:
+		if (CONSTELLATION_SETTINGS(tr)->density) {
+			gtk_databox_graph_remove(GTK_DATABOX(priv->databox),
+					CONSTELLATION_SETTINGS(tr)->density);
+			g_object_unref(CONSTELLATION_SETTINGS(tr)->density);
+		}
+		break;
+	case WATERFALL_TRANSFORM:
+		fft_alg_data_free(&FFT_SETTINGS(tr)->fft_alg_data);
+		gtk_databox_graph_remove(GTK_DATABOX(priv->databox),
+				WATERFALL_SETTINGS(tr)->graph);
+		g_object_unref(WATERFALL_SETTINGS(tr)->graph);
+		break;
+	}
 	Transform_destroy(tr);
 	if (list->size == 0) {
 		priv->active_transform_type = NO_TRANSFORM_TYPE;
 	}
 }
 
+/*
+ * Resize the set of markers so that @max_markers is the last index. The
+ * graphs of the markers that are dropped are removed from the databox, the
+ * ones of new markers are created by markers_init() at the next capture.
+ */
+static void markers_set_count(OscPlot *plot, unsigned int max_markers)
+{
+	OscPlotPrivate *priv = plot->priv;
+	unsigned int i, old_count = priv->markers ? priv->max_markers + 1 : 0;
+
+	for (i = max_markers + 1; i < old_count; i++) {
+		if (!priv->markers[i].graph)
+			continue;
+		gtk_databox_graph_remove(GTK_DATABOX(priv->databox),
+				priv->markers[i].graph);
+		g_object_unref(priv->markers[i].graph);
+	}
+
+	priv->markers = g_renew(struct marker_type, priv->markers,
+			max_markers + 2);
+	priv->phase_avg = g_renew(float, priv->phase_avg, max_markers + 1);
+
+	for (i = old_count; i <= max_markers + 1; i++) {
+		memset(&priv->markers[i], 0, sizeof(priv->markers[i]));
+		priv->markers[i].active = (i <= 4 && i <= max_markers);
+	}
+	memset(&priv->markers[max_markers + 1], 0, sizeof(priv->markers[0]));
+
+	for (i = 0; i <= max_markers; i++)
+		priv->phase_avg[i] = NAN;
+
+	priv->max_markers = max_markers;
+	if (priv->marker_type != MARKER_OFF)
+		set_marker_labels(plot, NULL, priv->marker_type);
+}
+
 static void markers_init(OscPlot *plot)
 {
 	OscPlotPrivate *priv = plot->priv;
@@ -2091,7 +2704,7 @@ static void markers_init(OscPlot *plot)
 	if (priv->active_transform_type == FFT_TRANSFORM && priv->marker_type == MARKER_IMAGE)
 		priv->marker_type = MARKER_OFF;
 
-	for (i = 0; i <= MAX_MARKERS; i++) {
+	for (i = 0; i <= priv->max_markers; i++) {
 		markers[i].x = 0.0f;
 		markers[i].y = -100.0f;
 		if (markers[i].graph)
@@ -2121,11 +2734,13 @@ static void transform_add_plot_markers(OscPlot *plot, Transform *transform)
 	if (priv->active_transform_type == FFT_TRANSFORM ||
 		priv->active_transform_type == COMPLEX_FFT_TRANSFORM) {
 		FFT_SETTINGS(transform)->markers = priv->markers;
+		FFT_SETTINGS(transform)->max_markers = priv->max_markers;
 		FFT_SETTINGS(transform)->markers_copy = &priv->markers_copy;
 		FFT_SETTINGS(transform)->marker_type = &priv->marker_type;
 		FFT_SETTINGS(transform)->marker_lock = &priv->g_marker_copy_lock;
 	} else if (priv->active_transform_type == CROSS_CORRELATION_TRANSFORM) {
 		XCORR_SETTINGS(transform)->markers = priv->markers;
+		XCORR_SETTINGS(transform)->max_markers = priv->max_markers;
 		XCORR_SETTINGS(transform)->markers_copy = &priv->markers_copy;
 		XCORR_SETTINGS(transform)->marker_type = &priv->marker_type;
 		XCORR_SETTINGS(transform)->marker_lock = &priv->g_marker_copy_lock;
@@ -2138,7 +2753,7 @@ static void transform_add_own_markers(OscPlot *plot, Transform *transform)
 	struct marker_type *markers;
 	int i;
 
-	markers = calloc(sizeof(struct marker_type), MAX_MARKERS + 2);
+	markers = calloc(sizeof(struct marker_type), priv->max_markers + 2);
 	if (!markers) {
 		fprintf(stderr,
 			"Error: could not alloc memory for markers in %s\n",
@@ -2146,16 +2761,18 @@ static void transform_add_own_markers(OscPlot *plot, Transform *transform)
 		return;
 	}
 
-	for (i = 0; i < MAX_MARKERS; i++)
+	for (i = 0; i <= priv->max_markers; i++)
 		markers[i].active = (i <= 4);
 
 	if (transform->type_id == FFT_TRANSFORM ||
 		transform->type_id == COMPLEX_FFT_TRANSFORM) {
 		FFT_SETTINGS(transform)->markers = markers;
+		FFT_SETTINGS(transform)->max_markers = priv->max_markers;
 		FFT_SETTINGS(transform)->marker_type = FFT_SETTINGS(
 					priv->tr_with_marker)->marker_type;
 	} else if (transform->type_id == CROSS_CORRELATION_TRANSFORM) {
 		XCORR_SETTINGS(transform)->markers = markers;
+		XCORR_SETTINGS(transform)->max_markers = priv->max_markers;
 		XCORR_SETTINGS(transform)->marker_type = XCORR_SETTINGS(
 					priv->tr_with_marker)->marker_type;
 	}
@@ -2277,8 +2894,7 @@ static gdouble prefix2scale (char adc_scale)
 
 static void markers_phase_diff_show(OscPlotPrivate *priv)
 {
-	static float avg[MAX_MARKERS] = {NAN};
-
+	float *avg = priv->phase_avg;
 	GtkTextIter iter;
 	char text[256];
 	int m;
@@ -2302,8 +2918,8 @@ static void markers_phase_diff_show(OscPlotPrivate *priv)
 			filter = 1;
 		filter = 1.0 / filter;
 
-		if (MAX_MARKERS && priv->marker_type != MARKER_OFF) {
-			for (m = 0; m <= MAX_MARKERS &&
+		if (priv->marker_type != MARKER_OFF) {
+			for (m = 0; m <= priv->max_markers &&
 						trA_markers[m].active; m++) {
 
 				/* find out the quadrant
@@ -2357,7 +2973,7 @@ static void markers_phase_diff_show(OscPlotPrivate *priv)
 					angle,
 					/* lo_freq / markers_scale */ trA_markers[m].x,
 					/*dev_info->adc_scale */ 'M',
-					m != MAX_MARKERS ? '\n' : '\0');
+					m != priv->max_markers ? '\n' : '\0');
 
 				gtk_text_buffer_insert(priv->phase_buf,
 						&iter, text, -1);
@@ -2419,17 +3035,17 @@ static void draw_marker_values(OscPlotPrivate *priv, Transform *tr)
 
 	markers_scale = prefix2scale(dev_info->adc_scale);
 
-	if (MAX_MARKERS && priv->marker_type != MARKER_OFF) {
-		for (m = 0; m <= MAX_MARKERS && markers[m].active; m++) {
+	if (priv->marker_type != MARKER_OFF) {
+		for (m = 0; m <= priv->max_markers && markers[m].active; m++) {
 			if (tr->type_id == FFT_TRANSFORM || tr->type_id == COMPLEX_FFT_TRANSFORM) {
 				sprintf(text, "%s: %2.2f dBFS @ %2.3f %cHz%c",
 					markers[m].label, markers[m].y,
 					lo_freq / markers_scale + markers[m].x,
 					dev_info->adc_scale,
-					m != MAX_MARKERS ? '\n' : '\0');
+					m != priv->max_markers ? '\n' : '\0');
 			} else if (tr->type_id == CROSS_CORRELATION_TRANSFORM) {
 				sprintf(text, "M%i: %2.2f @ %2.3f%c", m, markers[m].y, markers[m].x,
-					m != MAX_MARKERS ? '\n' : '\0');
+					m != priv->max_markers ? '\n' : '\0');
 			}
 
 			if (m == 0) {
@@ -2459,35 +3075,156 @@ static void device_rx_info_update(OscPlot *plot)
 		const char *name = iio_device_get_name(dev) ?: iio_device_get_id(dev);
 		struct extra_dev_info *dev_info = iio_device_get_data(dev);
 
-		if (dev_info->input_device == false)
-			continue;
+		if (dev_info->input_device == false)
+			continue;
+
+		snprintf(text, sizeof(text), "%s:\n\tSampleRate: %f %cSPS\n",
+			name, dev_info->adc_freq, dev_info->adc_scale);
+		gtk_text_buffer_insert(priv->devices_buf, &iter, text, -1);
+	}
+}
+
+static void update_plot_channel_data(gpointer data, gpointer user_data)
+{
+	PlotChn *plot_ch = data;
+
+	plot_ch->update_data_ref(plot_ch);
+}
+
+/*
+ * Transforms that don't share a plot channel with another one only write
+ * to their own outputs, and are run in parallel on transform_pool. The
+ * others, which could compute the same math channel at the same time, run
+ * one after the other on the calling thread, which then waits for the
+ * pool. Markers are drawn afterwards, as they need GTK.
+ */
+struct transform_job {
+	OscPlotPrivate *priv;
+	Transform *tr;
+	struct pool_join *join;
+};
+
+static GThreadPool *transform_pool;
+
+/*
+ * The running plots are redrawn from a single timer rather than one each,
+ * so that their redraws happen together, at most redraw_max_fps times per
+ * second. A tick only redraws the plots whose transforms produced new
+ * output since their last redraw; the ticks the main loop was too busy to
+ * run are counted in redraw_missed_frames.
+ */
+static GSList *redraw_plots;
+static guint redraw_source;
+static unsigned int redraw_max_fps = OSC_PLOT_MAX_FPS_DEFAULT;
+static gint64 redraw_last_tick;
+static unsigned int redraw_missed_frames;
+
+static void transform_run(OscPlotPrivate *priv, Transform *tr)
+{
+	gint64 start = latency_start();
+
+	g_slist_foreach(tr->plot_channels, update_plot_channel_data, NULL);
+	Transform_update_output(tr);
+	latency_hist_add(&priv->transform_latency[tr->type_id], start);
+}
+
+static void transform_job_func(gpointer data, gpointer user_data)
+{
+	struct transform_job *job = data;
+
+	transform_run(job->priv, job->tr);
+	pool_join_done(job->join);
+}
+
+static bool transform_shares_channels(TrList *tr_list, Transform *tr)
+{
+	GSList *node;
+	int i;
+
+	for (i = 0; i < tr_list->size; i++) {
+		Transform *other = tr_list->transforms[i];
 
-		snprintf(text, sizeof(text), "%s:\n\tSampleRate: %f %cSPS\n",
-			name, dev_info->adc_freq, dev_info->adc_scale);
-		gtk_text_buffer_insert(priv->devices_buf, &iter, text, -1);
+		if (other == tr)
+			continue;
+		for (node = tr->plot_channels; node; node = g_slist_next(node))
+			if (g_slist_find(other->plot_channels, node->data))
+				return true;
 	}
+
+	return false;
 }
 
-static void call_all_transform_functions(OscPlotPrivate *priv)
+/* Returns true if at least one of the transforms produced new output */
+static bool call_all_transform_functions(OscPlotPrivate *priv)
 {
 	TrList *tr_list = priv->transform_list;
 	Transform *tr;
-	bool show_diff_phase = false;
+	struct transform_job *jobs;
+	struct pool_join join;
+	bool show_diff_phase = false, updated = false;
+	unsigned int nb_jobs = 0, first_serial;
 	int i = 0;
 
-	if (priv->redraw_function <= 0)
-		return;
+	if (!priv->redraw_scheduled)
+		return false;
+
+	/* The calling thread takes its share of the work, hence one thread
+	 * less than processors in each pool */
+	if (!transform_pool && g_get_num_processors() > 1) {
+		transform_pool = g_thread_pool_new(transform_job_func, NULL,
+				g_get_num_processors() - 1, FALSE, NULL);
+		fft_batch_pool = g_thread_pool_new(fft_batch_func, NULL,
+				g_get_num_processors() - 1, FALSE, NULL);
+	}
+
+	/* Pooled jobs are put at the start of the array, the others at
+	 * its end */
+	jobs = g_new(struct transform_job, tr_list->size);
+	first_serial = tr_list->size;
+	for (i = 0; i < tr_list->size; i++) {
+		struct transform_job *job;
+
+		tr = tr_list->transforms[i];
+		if (transform_pool && tr_list->size > 1 &&
+				!transform_shares_channels(tr_list, tr))
+			job = &jobs[nb_jobs++];
+		else
+			job = &jobs[--first_serial];
+
+		job->priv = priv;
+		job->tr = tr;
+		job->join = &join;
+	}
+
+	pool_join_init(&join, nb_jobs);
+	for (i = 0; i < nb_jobs; i++)
+		g_thread_pool_push(transform_pool, &jobs[i], NULL);
+
+	for (i = tr_list->size - 1; i >= (int) first_serial; i--)
+		transform_run(priv, jobs[i].tr);
 
-	for (; i < tr_list->size; i++) {
+	pool_join_wait(&join);
+	g_free(jobs);
+
+	for (i = 0; i < tr_list->size; i++) {
 		tr = tr_list->transforms[i];
-		Transform_update_output(tr);
+		updated |= tr->updated;
 		if (tr->has_the_marker) {
+			gint64 start = latency_start();
+
 			show_diff_phase = true;
 			draw_marker_values(priv, tr);
+			latency_hist_add(&priv->markers_latency, start);
 		}
 	}
-	if (show_diff_phase)
+	if (show_diff_phase) {
+		gint64 start = latency_start();
+
 		markers_phase_diff_show(priv);
+		latency_hist_add(&priv->markers_latency, start);
+	}
+
+	return updated;
 }
 
 static int enabled_channels_of_device(GtkTreeView *treeview, const char *name, unsigned *enabled_mask)
@@ -2565,31 +3302,31 @@ static int enabled_channels_count(OscPlot *plot)
 	return count;
 }
 
-static gfloat * plot_channels_get_nth_data_ref(GSList *list, guint n)
+/*
+ * Read @len samples of the nth channel of @list, from sample @pos, to @dst.
+ * Returns false if the channel doesn't have them, e.g. before its first
+ * capture.
+ */
+static bool plot_channels_read_nth(GSList *list, guint n, size_t pos,
+		gfloat *dst, size_t len)
 {
 	GSList *nth_node;
-	gfloat *data = NULL;
+	PlotChn *plot_ch;
 
 	if (!list) {
 		printf("Invalid list argument.");
-		goto end;
+		return false;
 	}
 
 	nth_node = g_slist_nth(list, n);
 	if (!nth_node || !nth_node->data) {
 		printf("Element at index %d does not exist.", n);
-		goto end;
+		return false;
 	}
 
-	PlotChn *plot_ch = nth_node->data;
-
-	data = plot_ch->get_data_ref(plot_ch);
-
-end:
-	if (!data)
-		printf("Could not find data reference in %s\n", __func__);
+	plot_ch = nth_node->data;
 
-	return data;
+	return plot_ch->read_data(plot_ch, pos, dst, len) == (ssize_t) len;
 }
 
 struct ch_tr_params {
@@ -2635,6 +3372,14 @@ static void channels_transform_assignment(GtkTreeModel *model,
 			}
 		}
 		break;
+	case WATERFALL_PLOT:
+		if (prm->enabled_channels == 1) {
+			transform = add_transform_to_list(plot, WATERFALL_TRANSFORM, prm->ch_settings);
+		} else if (prm->enabled_channels == 2 && num_added_chs == 2) {
+			prm->ch_settings = g_slist_reverse(prm->ch_settings);
+			transform = add_transform_to_list(plot, WATERFALL_TRANSFORM, prm->ch_settings);
+		}
+		break;
 	case XY_PLOT:
 		if (prm->enabled_channels == 2 && num_added_chs == 2) {
 			prm->ch_settings = g_slist_reverse(prm->ch_settings);
@@ -2734,32 +3479,229 @@ static void fps_counter(OscPlotPrivate *priv)
 	}
 }
 
+static const char * const transform_names[TRANSFORMS_TYPES_COUNT] = {
+	[TIME_TRANSFORM] = "Time transform",
+	[FFT_TRANSFORM] = "FFT transform",
+	[CONSTELLATION_TRANSFORM] = "Constellation transform",
+	[COMPLEX_FFT_TRANSFORM] = "Complex FFT transform",
+	[CROSS_CORRELATION_TRANSFORM] = "Correlation transform",
+	[WATERFALL_TRANSFORM] = "Waterfall transform",
+};
+
+static const char * const capture_stage_names[CAPTURE_STAGES_COUNT] = {
+	[CAPTURE_STAGE_REFILL] = "Refill",
+	[CAPTURE_STAGE_DEMUX] = "Demux",
+	[CAPTURE_STAGE_TRIGGER] = "Trigger",
+};
+
+bool osc_plot_get_latency(OscPlot *plot, int stage, int transform_type,
+		struct latency_stats *stats)
+{
+	OscPlotPrivate *priv = plot->priv;
+
+	switch (stage) {
+	case PLOT_STAGE_TRANSFORM:
+		if (transform_type <= NO_TRANSFORM_TYPE ||
+				transform_type >= TRANSFORMS_TYPES_COUNT)
+			return false;
+		latency_hist_get(&priv->transform_latency[transform_type], stats);
+		return true;
+	case PLOT_STAGE_MARKERS:
+		latency_hist_get(&priv->markers_latency, stats);
+		return true;
+	case PLOT_STAGE_REDRAW:
+		latency_hist_get(&priv->redraw_latency, stats);
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Stages that never ran are left out */
+static void plot_latency_format(OscPlotPrivate *priv, GString *str)
+{
+	struct extra_dev_info *dev_info;
+	struct latency_stats stats;
+	int i;
+
+	g_string_append_printf(str, "Capture%d:\n", priv->object_id);
+
+	for (i = NO_TRANSFORM_TYPE + 1; i < TRANSFORMS_TYPES_COUNT; i++) {
+		latency_hist_get(&priv->transform_latency[i], &stats);
+		if (stats.count)
+			latency_stats_append(str, transform_names[i], &stats);
+	}
+
+	latency_hist_get(&priv->markers_latency, &stats);
+	if (stats.count)
+		latency_stats_append(str, "Markers", &stats);
+	latency_hist_get(&priv->redraw_latency, &stats);
+	if (stats.count)
+		latency_stats_append(str, "Redraw", &stats);
+	g_string_append_printf(str, "Redraws at %u fps max, missed frames %u\n",
+			redraw_max_fps, redraw_missed_frames);
+
+	if (!priv->current_device)
+		return;
+
+	dev_info = iio_device_get_data(priv->current_device);
+	g_string_append_printf(str, "%s:\n",
+			iio_device_get_name(priv->current_device));
+	for (i = 0; i < CAPTURE_STAGES_COUNT; i++) {
+		latency_hist_get(&dev_info->capture_latency[i], &stats);
+		if (stats.count)
+			latency_stats_append(str, capture_stage_names[i], &stats);
+	}
+	g_string_append_printf(str, "Buffer resizes %u, busy frames %d\n",
+			dev_info->buffer_events[RX_BUFFER_GROW] +
+			dev_info->buffer_events[RX_BUFFER_SHRINK],
+			g_atomic_int_get(&dev_info->frames_busy));
+}
+
+void osc_plot_print_latency(OscPlot *plot, FILE *fp)
+{
+	GString *str = g_string_new(NULL);
+
+	plot_latency_format(plot->priv, str);
+	fputs(str->str, fp);
+	g_string_free(str, TRUE);
+}
+
+static void latency_label_update(OscPlotPrivate *priv)
+{
+	gint64 now = g_get_monotonic_time();
+	GString *str;
+	char *markup;
+
+	if (!gtk_widget_get_visible(priv->latency_label) ||
+			now - priv->latency_label_update < 500000)
+		return;
+	priv->latency_label_update = now;
+
+	str = g_string_new(NULL);
+	plot_latency_format(priv, str);
+	markup = g_markup_printf_escaped("<small><tt>%s</tt></small>", str->str);
+	gtk_label_set_markup(GTK_LABEL(priv->latency_label), markup);
+	g_free(markup);
+	g_string_free(str, TRUE);
+}
+
+static void latency_overlay_toggled(GtkCheckMenuItem *item, OscPlot *plot)
+{
+	OscPlotPrivate *priv = plot->priv;
+
+	priv->latency_label_update = 0;
+	gtk_widget_set_visible(priv->latency_label,
+			gtk_check_menu_item_get_active(item));
+	latency_label_update(priv);
+}
+
+static gboolean databox_expose_start(GtkWidget *widget, GdkEventExpose *event,
+		OscPlotPrivate *priv)
+{
+	priv->redraw_start = latency_start();
+	return FALSE;
+}
+
+static gboolean databox_expose_end(GtkWidget *widget, GdkEventExpose *event,
+		OscPlotPrivate *priv)
+{
+	if (priv->redraw_start) {
+		latency_hist_add(&priv->redraw_latency, priv->redraw_start);
+		priv->redraw_start = 0;
+	}
+	return FALSE;
+}
+
+/* Returns false once the plot stopped */
 static gboolean plot_redraw(OscPlotPrivate *priv)
 {
 	if (!GTK_IS_DATABOX(priv->databox))
 		return FALSE;
-	if (priv->redraw) {
+	if (priv->generation != priv->drawn_generation) {
+		priv->drawn_generation = priv->generation;
 		auto_scale_databox(priv, GTK_DATABOX(priv->databox));
 		gtk_widget_queue_draw(priv->databox);
 		fps_counter(priv);
+		latency_label_update(priv);
 	}
-	if (priv->stop_redraw == TRUE)
-		priv->redraw_function = 0;
 
-	priv->redraw = FALSE;
 	return !priv->stop_redraw;
 }
 
-static void capture_start(OscPlotPrivate *priv)
+static gboolean redraw_scheduler_tick(gpointer data)
 {
-	if (priv->redraw_function) {
-		priv->stop_redraw = FALSE;
-	} else {
-		priv->stop_redraw = FALSE;
-		priv->redraw_function = g_timeout_add_full(G_PRIORITY_DEFAULT_IDLE, 50, (GSourceFunc) plot_redraw, priv, NULL);
+	gint64 now = g_get_monotonic_time();
+	gint64 period = G_USEC_PER_SEC / redraw_max_fps;
+	GSList *node, *next;
+
+	/* The main loop was too busy to tick on time */
+	if (redraw_last_tick && now - redraw_last_tick >= 2 * period)
+		redraw_missed_frames += (now - redraw_last_tick) / period - 1;
+	redraw_last_tick = now;
+
+	for (node = redraw_plots; node; node = next) {
+		OscPlotPrivate *priv = node->data;
+
+		next = g_slist_next(node);
+		if (!plot_redraw(priv)) {
+			priv->redraw_scheduled = FALSE;
+			redraw_plots = g_slist_delete_link(redraw_plots, node);
+		}
+	}
+
+	if (redraw_plots)
+		return TRUE;
+
+	redraw_source = 0;
+	redraw_last_tick = 0;
+	return FALSE;
+}
+
+static void redraw_scheduler_start(void)
+{
+	redraw_source = g_timeout_add_full(G_PRIORITY_DEFAULT_IDLE,
+			1000 / redraw_max_fps, redraw_scheduler_tick, NULL, NULL);
+}
+
+static void redraw_unschedule(OscPlotPrivate *priv)
+{
+	redraw_plots = g_slist_remove(redraw_plots, priv);
+	priv->redraw_scheduled = FALSE;
+	if (!redraw_plots && redraw_source) {
+		g_source_remove(redraw_source);
+		redraw_source = 0;
+		redraw_last_tick = 0;
+	}
+}
+
+void osc_plot_set_max_fps(unsigned int fps)
+{
+	redraw_max_fps = CLAMP(fps, 1, 1000);
+	if (redraw_source) {
+		g_source_remove(redraw_source);
+		redraw_last_tick = 0;
+		redraw_scheduler_start();
 	}
 }
 
+unsigned int osc_plot_get_max_fps(void)
+{
+	return redraw_max_fps;
+}
+
+static void capture_start(OscPlotPrivate *priv)
+{
+	priv->stop_redraw = FALSE;
+	if (priv->redraw_scheduled)
+		return;
+
+	priv->redraw_scheduled = TRUE;
+	redraw_plots = g_slist_append(redraw_plots, priv);
+	if (!redraw_source)
+		redraw_scheduler_start();
+}
+
 static void plot_setup(OscPlot *plot)
 {
 	OscPlotPrivate *priv = plot->priv;
@@ -2768,6 +3710,7 @@ static void plot_setup(OscPlot *plot)
 	gfloat *transform_x_axis;
 	gfloat *transform_y_axis;
 	int max_x_axis = 0;
+	gfloat eye_span = 0.0f;
 	GtkDataboxGraph *graph;
 	int i;
 
@@ -2782,7 +3725,32 @@ static void plot_setup(OscPlot *plot)
 		transform_y_axis = Transform_get_y_axis_ref(transform);
 
 		gchar *plot_type_str = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(priv->plot_type));
-		if (strcmp(plot_type_str, "Lines")) {
+		if (transform->type_id == WATERFALL_TRANSFORM) {
+			graph = WATERFALL_SETTINGS(transform)->graph;
+		} else if (transform->type_id == TIME_TRANSFORM &&
+				TIME_SETTINGS(transform)->density) {
+			graph = TIME_SETTINGS(transform)->density;
+			if (TIME_SETTINGS(transform)->eye_x_axis)
+				eye_span = 2 * TIME_SETTINGS(transform)->eye_period;
+		} else if (transform->type_id == TIME_TRANSFORM) {
+			/* The samples only go to the databox decimated for the
+			 * screen; the transform keeps them at full resolution */
+			if (TIME_SETTINGS(transform)->envelope)
+				g_object_unref(TIME_SETTINGS(transform)->envelope);
+			if (strcmp(plot_type_str, "Lines"))
+				graph = envelope_new(transform->y_axis_size,
+						transform_x_axis, transform_y_axis,
+						transform->graph_color, 3, TRUE);
+			else
+				graph = envelope_new(transform->y_axis_size,
+						transform_x_axis, transform_y_axis,
+						transform->graph_color,
+						priv->line_thickness, FALSE);
+			TIME_SETTINGS(transform)->envelope = graph;
+		} else if (transform->type_id == CONSTELLATION_TRANSFORM &&
+				CONSTELLATION_SETTINGS(transform)->density) {
+			graph = CONSTELLATION_SETTINGS(transform)->density;
+		} else if (strcmp(plot_type_str, "Lines")) {
 			graph = gtk_databox_points_new(transform->y_axis_size,
 					transform_x_axis, transform_y_axis,
 					transform->graph_color, 3);
@@ -2810,7 +3778,8 @@ static void plot_setup(OscPlot *plot)
 	if (!priv->profile_loaded_scale) {
 		if (priv->active_transform_type == TIME_TRANSFORM &&
 			!gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(priv->enable_auto_scale)))
-			gtk_databox_set_total_limits(GTK_DATABOX(priv->databox), 0.0, max_x_axis,
+			gtk_databox_set_total_limits(GTK_DATABOX(priv->databox), 0.0,
+				eye_span ? eye_span : max_x_axis,
 				(int)(gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->y_axis_max))),
 				(int)(gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->y_axis_min))));
 		else if (priv->active_transform_type == CONSTELLATION_TRANSFORM &&
@@ -3473,7 +4442,8 @@ static void add_grid(OscPlot *plot)
 	grid = gtk_databox_grid_array_new (y, x, gridy, gridx, &color_grid, 1);
 	*/
 
-	if (priv->active_transform_type == FFT_TRANSFORM) {
+	if (priv->active_transform_type == FFT_TRANSFORM ||
+			priv->active_transform_type == WATERFALL_TRANSFORM) {
 		fill_axis(priv->gridx, 0, 10, 15);
 		fill_axis(priv->gridy, 10, -10, 15);
 		priv->grid = gtk_databox_grid_array_new (15, 15, priv->gridy, priv->gridx, &color_grid, 1);
@@ -3712,7 +4682,12 @@ static void transform_csv_print(OscPlotPrivate *priv, FILE *fp, Transform *tr)
 static void plot_destroyed (GtkWidget *object, OscPlot *plot)
 {
 	osc_plot_draw_stop(plot);
+	redraw_unschedule(plot->priv);
 	g_slist_free_full(plot->priv->ch_settings_list, *free);
+	g_free(plot->priv->markers);
+	g_free(plot->priv->phase_avg);
+	plot->priv->markers = NULL;
+	plot->priv->phase_avg = NULL;
 	g_mutex_trylock(&plot->priv->g_marker_copy_lock);
 	g_mutex_unlock(&plot->priv->g_marker_copy_lock);
 
@@ -3845,6 +4820,39 @@ static int * get_user_saveas_channel_selection(OscPlot *plot, unsigned int nb_ch
 	return mask;
 }
 
+/* Channels that were not captured have no data to save */
+static void skip_uncaptured_channels(struct iio_device *dev, int *mask)
+{
+	unsigned int i, nb_channels = iio_device_get_channels_count(dev);
+
+	for (i = 0; i < nb_channels; i++)
+		if (osc_channel_read_float(iio_device_get_channel(dev, i),
+					0, NULL, 0) < 0)
+			mask[i] = 1;
+}
+
+/* Samples are converted from the captured frame a block at a time, so
+ * saving a channel doesn't need a float copy of the whole capture */
+#define SAVE_BLOCK_SAMPLES 4096
+
+/* Convert @len samples from @pos of the channels to save, those of
+ * channel j to @block + j * SAVE_BLOCK_SAMPLES */
+static void save_block_read(struct iio_device *dev, const int *mask,
+		size_t pos, size_t len, gfloat *block)
+{
+	unsigned int i, nb_channels = iio_device_get_channels_count(dev);
+
+	for (i = 0; i < nb_channels; i++) {
+		gfloat *dst = block + i * SAVE_BLOCK_SAMPLES;
+
+		if (mask[i] == 1)
+			continue;
+		if (osc_channel_read_float(iio_device_get_channel(dev, i),
+					pos, dst, len) < (ssize_t) len)
+			memset(dst, 0, len * sizeof(*dst));
+	}
+}
+
 #define SAVE_AS_RAW_DATA 1
 
 static void saveas_dialog_show(GtkWidget *w, OscPlot *plot)
@@ -3885,6 +4893,8 @@ static void save_as(OscPlot *plot, const char *filename, int type)
 	int i, j, d;
 	unsigned int nb_channels;
 	const char *dev_name;
+	gfloat *block;
+	size_t pos, len, k;
 
 	name = malloc(strlen(filename) + 5);
 	switch(type) {
@@ -3909,6 +4919,7 @@ static void save_as(OscPlot *plot, const char *filename, int type)
 
 			/* Find which channel need to be saved */
 			save_channels_mask = get_user_saveas_channel_selection(plot, nb_channels);
+			skip_uncaptured_channels(dev, save_channels_mask);
 
 			/* Make a VSA file header */
 			fprintf(fp, "InputZoom\tTRUE\n");
@@ -3926,15 +4937,20 @@ static void save_as(OscPlot *plot, const char *filename, int type)
 			fprintf(fp, "Y\n");
 
 			/* Start writing the samples */
-			for (i = 0; i < dev_info->sample_count / 2; i++) {
-				for (j = 0; j < nb_channels; j++) {
-					struct extra_info *info = iio_channel_get_data(iio_device_get_channel(dev, j));
-					if (save_channels_mask[j] == 1)
-						continue;
-					fprintf(fp, "%g\t", info->data_ref[i]);
+			block = g_new(gfloat, nb_channels * SAVE_BLOCK_SAMPLES);
+			for (pos = 0; pos < dev_info->sample_count; pos += len) {
+				len = MIN(SAVE_BLOCK_SAMPLES, dev_info->sample_count - pos);
+				save_block_read(dev, save_channels_mask, pos, len, block);
+				for (k = 0; k < len; k++) {
+					for (j = 0; j < nb_channels; j++) {
+						if (save_channels_mask[j] == 1)
+							continue;
+						fprintf(fp, "%g\t", block[j * SAVE_BLOCK_SAMPLES + k]);
+					}
+					fprintf(fp, "\n");
 				}
-				fprintf(fp, "\n");
 			}
+			g_free(block);
 			fprintf(fp, "\n");
 			fclose(fp);
 			free(save_channels_mask);
@@ -3962,16 +4978,22 @@ static void save_as(OscPlot *plot, const char *filename, int type)
 
 				/* Find which channel need to be saved */
 				save_channels_mask = get_user_saveas_channel_selection(plot, nb_channels);
-
-				for (i = 0; i < dev_info->sample_count / 2; i++) {
-					for (j = 0; j < nb_channels; j++) {
-						struct extra_info *info = iio_channel_get_data(iio_device_get_channel(dev, j));
-						if (save_channels_mask[j] == 1)
-							continue;
-						fprintf(fp, "%g, ", info->data_ref[i]);
+				skip_uncaptured_channels(dev, save_channels_mask);
+
+				block = g_new(gfloat, nb_channels * SAVE_BLOCK_SAMPLES);
+				for (pos = 0; pos < dev_info->sample_count; pos += len) {
+					len = MIN(SAVE_BLOCK_SAMPLES, dev_info->sample_count - pos);
+					save_block_read(dev, save_channels_mask, pos, len, block);
+					for (k = 0; k < len; k++) {
+						for (j = 0; j < nb_channels; j++) {
+							if (save_channels_mask[j] == 1)
+								continue;
+							fprintf(fp, "%g, ", block[j * SAVE_BLOCK_SAMPLES + k]);
+						}
+						fprintf(fp, "\n");
 					}
-					fprintf(fp, "\n");
 				}
+				g_free(block);
 				fprintf(fp, "\n");
 				free(save_channels_mask);
 			} else {
@@ -4022,33 +5044,43 @@ static void save_as(OscPlot *plot, const char *filename, int type)
 
 			/* Find which channel need to be saved */
 			save_channels_mask = get_user_saveas_channel_selection(plot, nb_channels);
+			skip_uncaptured_channels(dev, save_channels_mask);
 
-			dims[0] = dev_info->sample_count / 2;
+			dims[0] = dev_info->sample_count;
 			for (i = 0; i < nb_channels; i++) {
 				struct iio_channel *chn = iio_device_get_channel(dev, i);
 				const char *ch_name = iio_channel_get_name(chn) ?:
 					iio_channel_get_id(chn);
-				struct extra_info *info = iio_channel_get_data(chn);
 				if (save_channels_mask[i] == 1)
 					continue;
 				sprintf(tmp, "%s_%s", dev_name, ch_name);
 				g_strdelimit(tmp, "-", '_');
 				if (!gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(priv->save_mat_scale))) {
-						matvar = Mat_VarCreate(tmp, MAT_C_SINGLE, MAT_T_SINGLE, 2, dims,
-					info->data_ref, 0);
+					gfloat *data = g_new0(gfloat, dev_info->sample_count);
+
+					osc_channel_read_float(chn, 0, data,
+							dev_info->sample_count);
+					matvar = Mat_VarCreate(tmp, MAT_C_SINGLE, MAT_T_SINGLE, 2, dims,
+							data, 0);
+					g_free(data);
 				} else {
 					const struct iio_data_format* format = iio_channel_get_data_format(chn);
 					gdouble *tmp_data;
+					gfloat samples[SAVE_BLOCK_SAMPLES];
 					double k;
 
-					tmp_data = g_new(gdouble, dev_info->sample_count / 2);
+					tmp_data = g_new(gdouble, dev_info->sample_count);
 					if (format->is_signed)
 						k = format->bits - 1;
 					else
 						k = format->bits;
-					for (j = 0; j < dev_info->sample_count / 2; j++) {
-						tmp_data[j] = (gdouble)info->data_ref[j] /
-									(pow(2.0, k));
+					for (pos = 0; pos < dev_info->sample_count; pos += len) {
+						len = MIN(SAVE_BLOCK_SAMPLES, dev_info->sample_count - pos);
+						if (osc_channel_read_float(chn, pos, samples, len) < (ssize_t) len)
+							memset(samples, 0, sizeof(samples));
+						for (j = 0; j < len; j++)
+							tmp_data[pos + j] = (gdouble)samples[j] /
+										(pow(2.0, k));
 					}
 					matvar = Mat_VarCreate(tmp, MAT_C_DOUBLE, MAT_T_DOUBLE,
 							2, dims, tmp_data, 0);
@@ -4299,6 +5331,8 @@ static void plot_profile_save(OscPlot *plot, char *filename)
 		fprintf(fp, "time\n");
 	else if (tmp_int == XCORR_PLOT)
 		fprintf(fp, "correlation\n");
+	else if (tmp_int == WATERFALL_PLOT)
+		fprintf(fp, "waterfall\n");
 	else
 		fprintf(fp, "unknown\n");
 
@@ -4319,6 +5353,25 @@ static void plot_profile_save(OscPlot *plot, char *filename)
 	tmp_int = (int)gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->fft_avg_widget));
 	fprintf(fp, "fft_avg=%d\n", tmp_int);
 
+	tmp_int = (int)gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->fft_welch_widget));
+	fprintf(fp, "fft_welch_segments=%d\n", tmp_int);
+
+	tmp_int = gtk_combo_box_get_active(GTK_COMBO_BOX(priv->fft_window_widget));
+	fprintf(fp, "fft_window=%s\n", window_get_name(tmp_int));
+
+	tmp_float = gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->fft_window_beta_widget));
+	fprintf(fp, "fft_window_beta=%f\n", tmp_float);
+
+	tmp_string = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(priv->fft_zoom_widget));
+	fprintf(fp, "fft_zoom=%s\n", tmp_string);
+	g_free(tmp_string);
+
+	tmp_float = gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->fft_zoom_center_widget));
+	fprintf(fp, "fft_zoom_center=%f\n", tmp_float);
+
+	tmp_int = gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->waterfall_depth_widget));
+	fprintf(fp, "waterfall_depth=%d\n", tmp_int);
+
 	tmp_float = gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->fft_pwr_offset_widget));
 	fprintf(fp, "fft_pwr_offset=%f\n", tmp_float);
 
@@ -4326,6 +5379,11 @@ static void plot_profile_save(OscPlot *plot, char *filename)
 	fprintf(fp, "graph_type=%s\n", tmp_string);
 	g_free(tmp_string);
 
+	tmp_int = gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->persistence_widget));
+	fprintf(fp, "persistence=%d\n", tmp_int);
+
+	fprintf(fp, "eye_period=%f\n", gtk_spin_button_get_value(GTK_SPIN_BUTTON(priv->eye_period_widget)));
+
 	tmp_int = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(priv->show_grid));
 	fprintf(fp, "show_grid=%d\n", tmp_int);
 
@@ -4386,6 +5444,8 @@ static void plot_profile_save(OscPlot *plot, char *filename)
 						info->trigger_falling_edge);
 				fprintf(fp, "%s.trigger_value=%f\n", name,
 						info->trigger_value);
+				fprintf(fp, "%s.trigger_pretrigger=%u\n", name,
+						info->trigger_pretrigger);
 			}
 		}
 
@@ -4435,12 +5495,13 @@ static void plot_profile_save(OscPlot *plot, char *filename)
 	else if (priv->marker_type == MARKER_IMAGE)
 		fprintf(fp, "marker_type = %s\n", IMAGE_MRK);
 
-	for (tmp_int = 0; tmp_int <= MAX_MARKERS; tmp_int++) {
+	fprintf(fp, "marker_count = %u\n", priv->max_markers + 1);
+	for (tmp_int = 0; tmp_int <= priv->max_markers; tmp_int++) {
 		if (priv->markers[tmp_int].active)
 			fprintf(fp, "marker.%i = %i\n", tmp_int, priv->markers[tmp_int].bin);
 	}
 
-	fprintf(fp, "capture_started=%d\n", (priv->redraw_function) ? 1 : 0);
+	fprintf(fp, "capture_started=%d\n", (priv->redraw_scheduled) ? 1 : 0);
 	fclose(fp);
 }
 
@@ -4560,7 +5621,7 @@ int osc_plot_ini_read_handler (OscPlot *plot, int line, const char *section,
 	switch(elem_type) {
 		case PLOT_ATTRIBUTE:
 			if (MATCH_NAME("capture_started")) {
-				if (priv->redraw_function && atoi(value))
+				if (priv->redraw_scheduled && atoi(value))
 					goto handled;
 				treeview_expand_update(plot);
 				treeview_icon_color_update(plot);
@@ -4587,6 +5648,8 @@ int osc_plot_ini_read_handler (OscPlot *plot, int line, const char *section,
 					gtk_combo_box_set_active(GTK_COMBO_BOX(priv->plot_domain), XY_PLOT);
 				else if (!strcmp(value, "correlation"))
 					gtk_combo_box_set_active(GTK_COMBO_BOX(priv->plot_domain), XCORR_PLOT);
+				else if (!strcmp(value, "waterfall"))
+					gtk_combo_box_set_active(GTK_COMBO_BOX(priv->plot_domain), WATERFALL_PLOT);
 				else
 					goto unhandled;
 			} else if (MATCH_NAME("sample_count")) {
@@ -4600,11 +5663,32 @@ int osc_plot_ini_read_handler (OscPlot *plot, int line, const char *section,
 					goto unhandled;
 			} else if (MATCH_NAME("fft_avg")) {
 				gtk_spin_button_set_value(GTK_SPIN_BUTTON(priv->fft_avg_widget), atoi(value));
+			} else if (MATCH_NAME("fft_welch_segments")) {
+				gtk_spin_button_set_value(GTK_SPIN_BUTTON(priv->fft_welch_widget), atoi(value));
+			} else if (MATCH_NAME("fft_window")) {
+				int type = window_find_by_name(value);
+
+				if (type < 0)
+					goto unhandled;
+				gtk_combo_box_set_active(GTK_COMBO_BOX(priv->fft_window_widget), type);
+			} else if (MATCH_NAME("fft_window_beta")) {
+				gtk_spin_button_set_value(GTK_SPIN_BUTTON(priv->fft_window_beta_widget), atof(value));
+			} else if (MATCH_NAME("fft_zoom")) {
+				if (!comboboxtext_set_active_by_string(GTK_COMBO_BOX(priv->fft_zoom_widget), value))
+					goto unhandled;
+			} else if (MATCH_NAME("fft_zoom_center")) {
+				gtk_spin_button_set_value(GTK_SPIN_BUTTON(priv->fft_zoom_center_widget), atof(value));
+			} else if (MATCH_NAME("waterfall_depth")) {
+				gtk_spin_button_set_value(GTK_SPIN_BUTTON(priv->waterfall_depth_widget), atoi(value));
 			} else if (MATCH_NAME("fft_pwr_offset")) {
 				gtk_spin_button_set_value(GTK_SPIN_BUTTON(priv->fft_pwr_offset_widget), atof(value));
 			} else if (MATCH_NAME("graph_type")) {
 				if (!comboboxtext_set_active_by_string(GTK_COMBO_BOX(priv->plot_type), value))
 					goto unhandled;
+			} else if (MATCH_NAME("persistence")) {
+				gtk_spin_button_set_value(GTK_SPIN_BUTTON(priv->persistence_widget), atoi(value));
+			} else if (MATCH_NAME("eye_period")) {
+				gtk_spin_button_set_value(GTK_SPIN_BUTTON(priv->eye_period_widget), atof(value));
 			} else if (MATCH_NAME("show_grid"))
 				gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(priv->show_grid), atoi(value));
 			else if (MATCH_NAME("enable_auto_scale"))
@@ -4647,8 +5731,11 @@ int osc_plot_ini_read_handler (OscPlot *plot, int line, const char *section,
 				}
 			} else if (MATCH_NAME("marker_type")) {
 				set_marker_labels(plot, (gchar *)value, MARKER_NULL);
-				for (i = 0; i <= MAX_MARKERS; i++)
+				for (i = 0; i <= priv->max_markers; i++)
 					priv->markers[i].active = FALSE;
+			} else if (MATCH_NAME("marker_count")) {
+				if (!osc_plot_set_marker_count(plot, atoi(value)))
+					goto unhandled;
 			} else if (MATCH_NAME("save_png")) {
 				save_as(plot, value, SAVE_PNG);
 			} else if (MATCH_NAME("cycle")) {
@@ -4677,7 +5764,7 @@ int osc_plot_ini_read_handler (OscPlot *plot, int line, const char *section,
 					}
 				}
 
-				for (i = 0; i <= MAX_MARKERS; i++) {
+				for (i = 0; i <= priv->max_markers; i++) {
 					if (priv->markers[i].active) {
 						fprintf(fd, ", %f, %f", priv->markers[i].x, priv->markers[i].y);
 						if (!isnan(priv->markers[i].angle))
@@ -4764,6 +5851,10 @@ int osc_plot_ini_read_handler (OscPlot *plot, int line, const char *section,
 				if (!dev_info)
 					goto unhandled;
 				dev_info->trigger_value = (float) atof(value);
+			} else if (MATCH(dev_property, "trigger_pretrigger")) {
+				if (!dev_info)
+					goto unhandled;
+				dev_info->trigger_pretrigger = CLAMP(atoi(value), 0, 100);
 			}
 			break;
 		case CHANNEL:
@@ -4914,19 +6005,16 @@ static void set_marker_labels (OscPlot *plot, gchar *buf, enum marker_types type
 	char tmp[128];
 	int i;
 
-	if (!MAX_MARKERS)
-		return;
-
 	if ((buf && !strcmp(buf, PEAK_MRK)) || type == MARKER_PEAK) {
 		priv->marker_type = MARKER_PEAK;
-		for (i = 0; i <= MAX_MARKERS; i++) {
+		for (i = 0; i <= priv->max_markers; i++) {
 			sprintf(tmp, "P%i", i);
 			marker_set(plot, i, tmp, FALSE);
 		}
 		return;
 	} else if ((buf && !strcmp(buf, FIX_MRK)) || type == MARKER_FIXED) {
 		priv->marker_type = MARKER_FIXED;
-		for (i = 0; i <= MAX_MARKERS; i++) {
+		for (i = 0; i <= priv->max_markers; i++) {
 			sprintf(tmp, "F%i", i);
 			marker_set(plot, i, tmp, FALSE);
 		}
@@ -4935,7 +6023,7 @@ static void set_marker_labels (OscPlot *plot, gchar *buf, enum marker_types type
 		priv->marker_type = MARKER_ONE_TONE;
 		marker_set(plot, 0, "Fund", TRUE);
 		marker_set(plot, 1, "DC", TRUE);
-		for (i = 2; i < MAX_MARKERS; i++) {
+		for (i = 2; i <= priv->max_markers; i++) {
 			sprintf(tmp, "%iH", i);
 			marker_set(plot, i, tmp, FALSE);
 		}
@@ -4948,7 +6036,7 @@ static void set_marker_labels (OscPlot *plot, gchar *buf, enum marker_types type
 		marker_set(plot, 0, "Fund", TRUE);
 		marker_set(plot, 1, "DC", TRUE);
 		marker_set(plot, 2, "Image", TRUE);
-		for (i = 3; i <= MAX_MARKERS; i++) {
+		for (i = 3; i <= priv->max_markers; i++) {
 			priv->markers[i].active = FALSE;
 			if(priv->markers[i].graph)
 				gtk_databox_graph_set_hide(priv->markers[i].graph, TRUE);
@@ -4956,13 +6044,13 @@ static void set_marker_labels (OscPlot *plot, gchar *buf, enum marker_types type
 		return;
 	} else if (buf && !strcmp(buf, OFF_MRK)) {
 		priv->marker_type = MARKER_OFF;
-		for (i = 0; i <= MAX_MARKERS; i++) {
+		for (i = 0; i <= priv->max_markers; i++) {
 			if (priv->markers[i].graph)
 				gtk_databox_graph_set_hide(priv->markers[i].graph, TRUE);
 		}
 		return;
 	} else if (buf && !strcmp(buf, REMOVE_MRK)) {
-		for (i = MAX_MARKERS; i != 0; i--) {
+		for (i = priv->max_markers; i != 0; i--) {
 			if (priv->markers[i].active) {
 				priv->markers[i].active = FALSE;
 				gtk_databox_graph_set_hide(priv->markers[i].graph, TRUE);
@@ -4971,7 +6059,7 @@ static void set_marker_labels (OscPlot *plot, gchar *buf, enum marker_types type
 		}
 		return;
 	} else if (buf && !strcmp(buf, ADD_MRK)) {
-		for (i = 0; i <= MAX_MARKERS; i++) {
+		for (i = 0; i <= priv->max_markers; i++) {
 			if (!priv->markers[i].active) {
 				priv->markers[i].active = TRUE;
 				gtk_databox_graph_set_hide(priv->markers[i].graph, FALSE);
@@ -5051,7 +6139,7 @@ static gint marker_button(GtkDatabox *box, GdkEventButton *event, gpointer data)
 	y = gtk_databox_pixel_to_value_y(box, event->y);
 	gtk_databox_get_total_limits(box, &left, &right, &top, &bottom);
 
-	for (i = 0; i <= MAX_MARKERS; i++) {
+	for (i = 0; i <= priv->max_markers; i++) {
 		if (priv->marker_type == MARKER_FIXED) {
 			/* sqrt of ((delta X / X range)^2 + (delta Y / Y range)^2 ) */
 			dist = sqrtf(powf((x - priv->markers[i].x) / (right - left), 2.0) +
@@ -5218,6 +6306,7 @@ static void plot_domain_changed_cb(GtkComboBox *box, OscPlot *plot)
 		return;
 	switch (plot_type) {
 	case FFT_PLOT:
+	case WATERFALL_PLOT:
 	case XY_PLOT:
 		enable_tree_device_selection(plot, true);
 		foreach_device_iter(GTK_TREE_VIEW(priv->channel_list_view),
@@ -5235,14 +6324,30 @@ static void plot_domain_changed_cb(GtkComboBox *box, OscPlot *plot)
 static gboolean domain_is_fft(GBinding *binding,
 	const GValue *source_value, GValue *target_value, gpointer user_data)
 {
-	g_value_set_boolean(target_value, g_value_get_int(source_value) == FFT_PLOT);
+	g_value_set_boolean(target_value,
+			plot_domain_uses_fft(g_value_get_int(source_value)));
+	return TRUE;
+}
+
+static gboolean domain_is_waterfall(GBinding *binding,
+	const GValue *source_value, GValue *target_value, gpointer user_data)
+{
+	g_value_set_boolean(target_value, g_value_get_int(source_value) == WATERFALL_PLOT);
 	return TRUE;
 }
 
 static gboolean domain_is_time(GBinding *binding,
 	const GValue *source_value, GValue *target_value, gpointer user_data)
 {
-	g_value_set_boolean(target_value, g_value_get_int(source_value) != FFT_PLOT);
+	g_value_set_boolean(target_value,
+			!plot_domain_uses_fft(g_value_get_int(source_value)));
+	return TRUE;
+}
+
+static gboolean domain_is_time_plot(GBinding *binding,
+	const GValue *source_value, GValue *target_value, gpointer user_data)
+{
+	g_value_set_boolean(target_value, g_value_get_int(source_value) == TIME_PLOT);
 	return TRUE;
 }
 
@@ -5692,6 +6797,10 @@ static void plot_trigger_save_settings(OscPlotPrivate *priv,
 				priv->builder, "spin_trigger_value"));
 	dev_info->trigger_value = gtk_spin_button_get_value(btn);
 
+	btn = GTK_SPIN_BUTTON(gtk_builder_get_object(
+				priv->builder, "spin_trigger_pretrigger"));
+	dev_info->trigger_pretrigger = gtk_spin_button_get_value_as_int(btn);
+
 	if (active_channel)
 		g_free(active_channel);
 }
@@ -5780,6 +6889,9 @@ static void plot_trigger_settings_cb(GtkMenuItem *menuitem, OscPlot *plot)
 	item = GTK_WIDGET(gtk_builder_get_object(priv->builder, "spin_trigger_value"));
 	gtk_spin_button_set_value(GTK_SPIN_BUTTON(item), dev_info->trigger_value);
 
+	item = GTK_WIDGET(gtk_builder_get_object(priv->builder, "spin_trigger_pretrigger"));
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(item), dev_info->trigger_pretrigger);
+
 	dialog = GTK_DIALOG(gtk_builder_get_object(priv->builder, "channel_trigger_dialog"));
 	switch (gtk_dialog_run(dialog)) {
 	case GTK_RESPONSE_CANCEL:
@@ -5795,6 +6907,61 @@ static void plot_trigger_settings_cb(GtkMenuItem *menuitem, OscPlot *plot)
 	gtk_widget_hide(GTK_WIDGET(dialog));
 }
 
+static void record_to_disk_cb(GtkMenuItem *menuitem, OscPlot *plot)
+{
+	OscPlotPrivate *priv = plot->priv;
+	struct record_stats stats;
+	struct iio_device *dev;
+	GtkWidget *dialog;
+	GtkTreeView *treeview;
+	GtkTreeModel *model;
+	GtkTreeIter iter;
+	const char *name;
+	char *filename;
+	int ret;
+
+	treeview = GTK_TREE_VIEW(priv->channel_list_view);
+	model = gtk_tree_view_get_model(treeview);
+	if (!tree_get_selected_row_iter(treeview, &iter))
+		return;
+	gtk_tree_model_get(model, &iter, ELEMENT_REFERENCE, &dev, -1);
+	if (!dev) {
+		fprintf(stderr, "Invalid reference of iio_device read from devicetree\n");
+		return;
+	}
+	name = iio_device_get_name(dev);
+
+	if (osc_record_active(name)) {
+		ret = osc_record_stop(name, &stats);
+		create_blocking_popup(ret ? GTK_MESSAGE_ERROR : GTK_MESSAGE_INFO,
+			GTK_BUTTONS_CLOSE, "Recording stopped",
+			"%llu bytes recorded (%u bytes per sample)\n"
+			"%llu buffers recorded, %llu buffers dropped%s%s",
+			(unsigned long long) stats.bytes_written, stats.sample_size,
+			(unsigned long long) stats.buffers_recorded,
+			(unsigned long long) stats.buffers_dropped,
+			ret ? "\nError: " : "", ret ? strerror(-ret) : "");
+		return;
+	}
+
+	dialog = gtk_file_chooser_dialog_new("Record to disk",
+			GTK_WINDOW(priv->window), GTK_FILE_CHOOSER_ACTION_SAVE,
+			GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+			GTK_STOCK_MEDIA_RECORD, GTK_RESPONSE_ACCEPT, NULL);
+	gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(dialog), TRUE);
+
+	if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+		filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+		ret = osc_record_start(name, filename);
+		if (ret < 0)
+			create_blocking_popup(GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
+				"Recording failed", "Unable to record %s to %s:\n%s",
+				name, filename, strerror(-ret));
+		g_free(filename);
+	}
+	gtk_widget_destroy(dialog);
+}
+
 static void channel_color_settings_cb(GtkMenuItem *menuitem, OscPlot *plot)
 {
 	OscPlotPrivate *priv = plot->priv;
@@ -5947,6 +7114,9 @@ static gboolean right_click_menu_show(OscPlot *plot, GdkEventButton *event)
 
 		gtk_widget_set_sensitive(priv->device_trigger_menuitem,
 				has_trigger);
+		gtk_menu_item_set_label(GTK_MENU_ITEM(priv->record_menuitem),
+				osc_record_active(iio_device_get_name(dev)) ?
+				"Stop recording" : "Record to disk...");
 
 		gtk_menu_popup(GTK_MENU(priv->device_settings_menu),
 				NULL, NULL, NULL, NULL,
@@ -6108,6 +7278,14 @@ static void create_plot(OscPlot *plot)
 	priv->sample_count_widget = GTK_WIDGET(gtk_builder_get_object(builder, "sample_count"));
 	priv->fft_size_widget = GTK_WIDGET(gtk_builder_get_object(builder, "fft_size"));
 	priv->fft_avg_widget = GTK_WIDGET(gtk_builder_get_object(builder, "fft_avg"));
+	priv->fft_welch_widget = GTK_WIDGET(gtk_builder_get_object(builder, "fft_welch"));
+	priv->fft_window_widget = GTK_WIDGET(gtk_builder_get_object(builder, "fft_window"));
+	priv->fft_window_beta_widget = GTK_WIDGET(gtk_builder_get_object(builder, "fft_window_beta"));
+	priv->fft_zoom_widget = GTK_WIDGET(gtk_builder_get_object(builder, "fft_zoom"));
+	priv->fft_zoom_center_widget = GTK_WIDGET(gtk_builder_get_object(builder, "fft_zoom_center"));
+	priv->waterfall_depth_widget = GTK_WIDGET(gtk_builder_get_object(builder, "waterfall_depth"));
+	priv->persistence_widget = GTK_WIDGET(gtk_builder_get_object(builder, "persistence"));
+	priv->eye_period_widget = GTK_WIDGET(gtk_builder_get_object(builder, "eye_period"));
 	priv->fft_pwr_offset_widget = GTK_WIDGET(gtk_builder_get_object(builder, "pwr_offset"));
 	priv->math_dialog = GTK_WIDGET(gtk_builder_get_object(builder, "dialog_math_settings"));
 	priv->capture_options_box = GTK_WIDGET(gtk_builder_get_object(builder, "box_capture_options"));
@@ -6140,6 +7318,17 @@ static void create_plot(OscPlot *plot)
 	gtk_databox_create_box_with_scrollbars_and_rulers(&priv->databox, &table,
 		TRUE, TRUE, TRUE, TRUE);
 	gtk_box_pack_start(GTK_BOX(priv->capture_graph), table, TRUE, TRUE, 0);
+
+	/* Latency overlay, shown from the View menu */
+	priv->latency_label = gtk_label_new(NULL);
+	gtk_misc_set_alignment(GTK_MISC(priv->latency_label), 0.0, 0.5);
+	gtk_widget_set_no_show_all(priv->latency_label, TRUE);
+	gtk_box_pack_end(GTK_BOX(priv->capture_graph), priv->latency_label,
+			FALSE, FALSE, 0);
+	priv->latency_menuitem = gtk_check_menu_item_new_with_label("Show Latency");
+	gtk_menu_shell_append(GTK_MENU_SHELL(gtk_builder_get_object(builder, "menu3")),
+			priv->latency_menuitem);
+	gtk_widget_show(priv->latency_menuitem);
 	gtk_widget_modify_bg(priv->databox, GTK_STATE_NORMAL, &color_background);
 	gtk_widget_set_size_request(table, 320, 240);
 	ruler_y = gtk_databox_get_ruler_y(GTK_DATABOX(priv->databox));
@@ -6177,6 +7366,13 @@ static void create_plot(OscPlot *plot)
 	gtk_image_menu_item_set_always_show_image(GTK_IMAGE_MENU_ITEM(priv->plot_trigger_menuitem), true);
 	gtk_menu_shell_append(GTK_MENU_SHELL(priv->device_settings_menu),
 		priv->plot_trigger_menuitem);
+
+	priv->record_menuitem = gtk_image_menu_item_new_with_label("Record to disk...");
+	image = gtk_image_new_from_stock(GTK_STOCK_MEDIA_RECORD, GTK_ICON_SIZE_MENU);
+	gtk_image_menu_item_set_image(GTK_IMAGE_MENU_ITEM(priv->record_menuitem), image);
+	gtk_image_menu_item_set_always_show_image(GTK_IMAGE_MENU_ITEM(priv->record_menuitem), true);
+	gtk_menu_shell_append(GTK_MENU_SHELL(priv->device_settings_menu),
+		priv->record_menuitem);
 	gtk_widget_show_all(priv->device_settings_menu);
 
 	priv->math_settings_menu = gtk_menu_new();
@@ -6300,6 +7496,8 @@ static void create_plot(OscPlot *plot)
 		G_CALLBACK(new_math_channel_cb), plot);
 	g_signal_connect(priv->plot_trigger_menuitem, "activate",
 		G_CALLBACK(plot_trigger_settings_cb), plot);
+	g_signal_connect(priv->record_menuitem, "activate",
+		G_CALLBACK(record_to_disk_cb), plot);
 	g_signal_connect(priv->channel_iio_color_menuitem, "activate",
 		G_CALLBACK(channel_color_settings_cb), plot);
 	g_signal_connect(priv->channel_math_color_menuitem, "activate",
@@ -6324,6 +7522,12 @@ static void create_plot(OscPlot *plot)
 		G_CALLBACK(marker_button), plot);
 	g_signal_connect(GTK_DATABOX(priv->databox), "button_release_event",
 		G_CALLBACK(marker_button), plot);
+	g_signal_connect(priv->databox, "expose-event",
+		G_CALLBACK(databox_expose_start), priv);
+	g_signal_connect_after(priv->databox, "expose-event",
+		G_CALLBACK(databox_expose_end), priv);
+	g_signal_connect(priv->latency_menuitem, "toggled",
+		G_CALLBACK(latency_overlay_toggled), plot);
 
 	g_builder_connect_signal(builder, "menuitem_save_as", "activate",
 		G_CALLBACK(saveas_dialog_show), plot);
@@ -6378,8 +7582,24 @@ static void create_plot(OscPlot *plot)
 		"capture_domain", "sensitive", G_BINDING_INVERT_BOOLEAN);
 	g_builder_bind_property(builder, "capture_button", "active",
 		"fft_size", "sensitive", G_BINDING_INVERT_BOOLEAN);
+	g_builder_bind_property(builder, "capture_button", "active",
+		"fft_welch", "sensitive", G_BINDING_INVERT_BOOLEAN);
+	g_builder_bind_property(builder, "capture_button", "active",
+		"fft_window", "sensitive", G_BINDING_INVERT_BOOLEAN);
+	g_builder_bind_property(builder, "capture_button", "active",
+		"fft_window_beta", "sensitive", G_BINDING_INVERT_BOOLEAN);
+	g_builder_bind_property(builder, "capture_button", "active",
+		"fft_zoom", "sensitive", G_BINDING_INVERT_BOOLEAN);
+	g_builder_bind_property(builder, "capture_button", "active",
+		"fft_zoom_center", "sensitive", G_BINDING_INVERT_BOOLEAN);
+	g_builder_bind_property(builder, "capture_button", "active",
+		"waterfall_depth", "sensitive", G_BINDING_INVERT_BOOLEAN);
 	g_builder_bind_property(builder, "capture_button", "active",
 		"plot_type", "sensitive", G_BINDING_INVERT_BOOLEAN);
+	g_builder_bind_property(builder, "capture_button", "active",
+		"persistence", "sensitive", G_BINDING_INVERT_BOOLEAN);
+	g_builder_bind_property(builder, "capture_button", "active",
+		"eye_period", "sensitive", G_BINDING_INVERT_BOOLEAN);
 	g_builder_bind_property(builder, "capture_button", "active",
 		"sample_count", "sensitive", G_BINDING_INVERT_BOOLEAN);
 	g_builder_bind_property(builder, "capture_button", "active",
@@ -6399,6 +7619,42 @@ static void create_plot(OscPlot *plot)
 	 g_object_bind_property_full(priv->plot_domain, "active", priv->fft_avg_widget, "visible",
 		0, domain_is_fft, NULL, NULL, NULL);
 
+	tmp = GTK_WIDGET(gtk_builder_get_object(builder, "fft_welch_label"));
+	 g_object_bind_property_full(priv->plot_domain, "active", tmp, "visible",
+		0, domain_is_fft, NULL, NULL, NULL);
+	 g_object_bind_property_full(priv->plot_domain, "active", priv->fft_welch_widget, "visible",
+		0, domain_is_fft, NULL, NULL, NULL);
+
+	tmp = GTK_WIDGET(gtk_builder_get_object(builder, "fft_window_label"));
+	 g_object_bind_property_full(priv->plot_domain, "active", tmp, "visible",
+		0, domain_is_fft, NULL, NULL, NULL);
+	 g_object_bind_property_full(priv->plot_domain, "active", priv->fft_window_widget, "visible",
+		0, domain_is_fft, NULL, NULL, NULL);
+
+	tmp = GTK_WIDGET(gtk_builder_get_object(builder, "fft_window_beta_label"));
+	 g_object_bind_property_full(priv->plot_domain, "active", tmp, "visible",
+		0, domain_is_fft, NULL, NULL, NULL);
+	 g_object_bind_property_full(priv->plot_domain, "active", priv->fft_window_beta_widget, "visible",
+		0, domain_is_fft, NULL, NULL, NULL);
+
+	tmp = GTK_WIDGET(gtk_builder_get_object(builder, "fft_zoom_label"));
+	 g_object_bind_property_full(priv->plot_domain, "active", tmp, "visible",
+		0, domain_is_fft, NULL, NULL, NULL);
+	 g_object_bind_property_full(priv->plot_domain, "active", priv->fft_zoom_widget, "visible",
+		0, domain_is_fft, NULL, NULL, NULL);
+
+	tmp = GTK_WIDGET(gtk_builder_get_object(builder, "fft_zoom_center_label"));
+	 g_object_bind_property_full(priv->plot_domain, "active", tmp, "visible",
+		0, domain_is_fft, NULL, NULL, NULL);
+	 g_object_bind_property_full(priv->plot_domain, "active", priv->fft_zoom_center_widget, "visible",
+		0, domain_is_fft, NULL, NULL, NULL);
+
+	tmp = GTK_WIDGET(gtk_builder_get_object(builder, "waterfall_depth_label"));
+	 g_object_bind_property_full(priv->plot_domain, "active", tmp, "visible",
+		0, domain_is_waterfall, NULL, NULL, NULL);
+	 g_object_bind_property_full(priv->plot_domain, "active", priv->waterfall_depth_widget, "visible",
+		0, domain_is_waterfall, NULL, NULL, NULL);
+
 	tmp = GTK_WIDGET(gtk_builder_get_object(builder, "pwr_offset_label"));
 	 g_object_bind_property_full(priv->plot_domain, "active", tmp, "visible",
 		0, domain_is_fft, NULL, NULL, NULL);
@@ -6419,11 +7675,29 @@ static void create_plot(OscPlot *plot)
 	 g_object_bind_property_full(priv->plot_domain, "active", priv->plot_type, "visible",
 		0, domain_is_time, NULL, NULL, NULL);
 
+	tmp = GTK_WIDGET(gtk_builder_get_object(builder, "persistence_label"));
+	 g_object_bind_property_full(priv->plot_domain, "active", tmp, "visible",
+		0, domain_is_time, NULL, NULL, NULL);
+	 g_object_bind_property_full(priv->plot_domain, "active", priv->persistence_widget, "visible",
+		0, domain_is_time, NULL, NULL, NULL);
+
+	tmp = GTK_WIDGET(gtk_builder_get_object(builder, "eye_period_label"));
+	 g_object_bind_property_full(priv->plot_domain, "active", tmp, "visible",
+		0, domain_is_time_plot, NULL, NULL, NULL);
+	 g_object_bind_property_full(priv->plot_domain, "active", priv->eye_period_widget, "visible",
+		0, domain_is_time_plot, NULL, NULL, NULL);
+
 	gtk_spin_button_set_value(GTK_SPIN_BUTTON(priv->sample_count_widget), 400);
 	priv->sample_count = 400;
 	g_signal_connect(priv->sample_count_widget, "value-changed", G_CALLBACK(count_changed_cb), plot);
 
 	gtk_combo_box_set_active(GTK_COMBO_BOX(priv->fft_size_widget), 2);
+	gtk_combo_box_set_active(GTK_COMBO_BOX(priv->fft_window_widget), WINDOW_HANNING);
+	gtk_combo_box_set_active(GTK_COMBO_BOX(priv->fft_zoom_widget), 0);
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(priv->waterfall_depth_widget),
+			WATERFALL_DEPTH_DEFAULT);
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(priv->fft_window_beta_widget),
+			WINDOW_KAISER_BETA_DEFAULT);
 	gtk_combo_box_set_active(GTK_COMBO_BOX(priv->plot_type), 0);
 	gtk_spin_button_set_value(GTK_SPIN_BUTTON(priv->y_axis_max), 1000);
 	gtk_spin_button_set_value(GTK_SPIN_BUTTON(priv->y_axis_min), -1000);
@@ -6434,13 +7708,8 @@ static void create_plot(OscPlot *plot)
 	g_mutex_init(&priv->g_marker_copy_lock);
 	device_rx_info_update(plot);
 
-	if (MAX_MARKERS) {
-		priv->marker_type = MARKER_OFF;
-		for (i = 0; i < MAX_MARKERS; i++) {
-			priv->markers[i].graph = NULL;
-			priv->markers[i].active = (i <= 4);
-		}
-	}
+	priv->marker_type = MARKER_OFF;
+	markers_set_count(plot, MAX_MARKERS);
 	priv->add_mrk.plot = plot;
 	priv->remove_mrk.plot = plot;
 	priv->peak_mrk.plot = plot;
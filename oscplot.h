@@ -19,6 +19,18 @@ G_BEGIN_DECLS
 #define IS_OSC_PLOT(obj)           (G_TYPE_CHECK_INSTANCE_TYPE((obj), OSC_PLOT_TYPE))
 #define IS_OSC_PLOT_CLASS(klass)   (G_TYPE_CHECK_CLASS_TYPE((klass), OSC_PLOT_TYPE))
 
+struct latency_stats;
+
+/* Redraws per second of the running plots, unless set otherwise */
+#define OSC_PLOT_MAX_FPS_DEFAULT 20
+
+/* Timed stages of a plot, see osc_plot_get_latency() */
+enum plot_stage {
+	PLOT_STAGE_TRANSFORM,
+	PLOT_STAGE_MARKERS,
+	PLOT_STAGE_REDRAW,
+};
+
 typedef struct _OscPlot            OscPlot;
 typedef struct _OscPlotPrivate     OscPlotPrivate;
 typedef struct _OscPlotClass       OscPlotClass;
@@ -42,7 +54,7 @@ GType         osc_plot_get_type         (void);
 GtkWidget*    osc_plot_new              (void);
 void          osc_plot_destroy          (OscPlot *plot);
 void          osc_plot_set_visible      (OscPlot *plot, bool visible);
-struct iio_buffer * osc_plot_get_buffer (OscPlot *plot);
+struct iio_device * osc_plot_get_device (OscPlot *plot);
 void          osc_plot_data_update      (OscPlot *plot);
 void          osc_plot_update_rx_lbl    (OscPlot *plot, bool force_update);
 void          osc_plot_restart          (OscPlot *plot);
@@ -63,12 +75,18 @@ int           osc_plot_get_plot_domain  (OscPlot *plot);
 GMutex *      osc_plot_get_marker_lock  (OscPlot *plot);
 bool          osc_plot_set_sample_count (OscPlot *plot, gdouble count);
 double        osc_plot_get_sample_count (OscPlot *plot);
+bool          osc_plot_set_marker_count (OscPlot *plot, unsigned int count);
+unsigned int  osc_plot_get_marker_count (OscPlot *plot);
 void          osc_plot_set_channel_state(OscPlot *plot, const char *dev, int channel, bool state);
 void          osc_plot_xcorr_revert     (OscPlot *plot, int revert);
 void          osc_plot_set_quit_callback(OscPlot *plot, void (*qcallback)(void *user_data), void *user_data);
 void          osc_plot_reset_numbering  (void);
 int           osc_plot_get_id           (OscPlot *plot);
 void          osc_plot_set_id           (OscPlot *plot, int id);
+bool          osc_plot_get_latency      (OscPlot *plot, int stage, int transform_type, struct latency_stats *stats);
+void          osc_plot_print_latency    (OscPlot *plot, FILE *fp);
+void          osc_plot_set_max_fps      (unsigned int fps);
+unsigned int  osc_plot_get_max_fps      (void);
 
 G_END_DECLS
 
@@ -32,8 +32,6 @@
 #include "./block_diagram.h"
 #include "dac_data_manager.h"
 
-#define HANNING_ENBW 1.50
-
 #define THIS_DRIVER "FMComms2/3/4"
 #define PHY_DEVICE "ad9361-phy"
 #define DDS_DEVICE "cf-ad9361-dds-core-lpc"
@@ -1374,7 +1372,7 @@ static GtkWidget * fmcomms2_init(GtkWidget *notebook, const char *ini_fn)
 	if (adc_dev) {
 		adc_info = iio_device_get_data(adc_dev);
 		if (adc_info)
-			adc_info->plugin_fft_corr = 20 * log10(1/sqrt(HANNING_ENBW));
+			adc_info->plugin_fft_enbw_corr = true;
 	}
 
 	block_diagram_init(builder, 2, "fmcomms2.svg", "AD_FMCOMM2S2_RevC.jpg");
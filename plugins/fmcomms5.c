@@ -36,8 +36,6 @@
 
 #define ARRAY_SIZE(x) (!sizeof(x) ?: sizeof(x) / sizeof((x)[0]))
 
-#define HANNING_ENBW 1.50
-
 #define PHY_DEVICE1 "ad9361-phy"
 #define DDS_DEVICE1 "cf-ad9361-dds-core-lpc" /* can be hpc as well */
 #define CAP_DEVICE1 "cf-ad9361-lpc"
@@ -1519,7 +1517,7 @@ static GtkWidget * fmcomms5_init(GtkWidget *notebook, const char *ini_fn)
 	if (adc_dev) {
 		adc_info = iio_device_get_data(adc_dev);
 		if (adc_info)
-			adc_info->plugin_fft_corr = 20 * log10(1/sqrt(HANNING_ENBW));
+			adc_info->plugin_fft_enbw_corr = true;
 	}
 
 	block_diagram_init(builder, 2, "fmcomms2.svg", "AD_FMCOMMS5_EBZ.jpg");
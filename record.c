@@ -0,0 +1,340 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <glib.h>
+#include <iio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "record.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/*
+ * The refill thread copies the raw content of each refill into one of two
+ * staging blocks. When a block is full it is handed to the writer thread,
+ * which writes it to disk in one go while the other block is being filled.
+ * If the writer still owns the next block when the refill thread needs it,
+ * the refill is dropped and counted: the file then has a gap.
+ */
+#define RECORD_BLOCKS 2
+#define RECORD_ALIGN 4096
+#define RECORD_REFILL_SIZE (1 << 20)
+#define RECORD_REFILLS_PER_BLOCK 8
+
+struct record_block {
+	char *data;
+	size_t used;
+	bool full;
+};
+
+struct recorder {
+	struct iio_device *dev;
+	struct iio_buffer *buf;
+	int fd;
+
+	GThread *refill_thread;
+	GThread *writer_thread;
+	GMutex lock;
+	GCond cond;
+	gint stop;
+	bool refill_done;
+
+	struct record_block blocks[RECORD_BLOCKS];
+	size_t block_size;
+	unsigned int fill;
+
+	struct record_stats stats;
+
+	/* Run from the main loop when the recording stops on an error */
+	GSourceFunc on_error;
+	gpointer on_error_data;
+};
+
+static void * record_alloc(size_t size)
+{
+#ifdef __MINGW32__
+	return _aligned_malloc(size, RECORD_ALIGN);
+#else
+	void *ptr;
+
+	if (posix_memalign(&ptr, RECORD_ALIGN, size))
+		return NULL;
+	return ptr;
+#endif
+}
+
+static void record_free(void *ptr)
+{
+#ifdef __MINGW32__
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+static int record_write_all(int fd, const char *data, size_t len)
+{
+	while (len) {
+		ssize_t ret = write(fd, data, len);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+
+		data += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+/* Called with the lock held. Only the first error is kept and reported. */
+static void record_fail(struct recorder *rec, int error)
+{
+	g_atomic_int_set(&rec->stop, TRUE);
+	if (rec->stats.error)
+		return;
+
+	rec->stats.error = error;
+	if (rec->on_error)
+		g_idle_add(rec->on_error, rec->on_error_data);
+}
+
+static gpointer record_writer_thread(gpointer data)
+{
+	struct recorder *rec = data;
+	unsigned int idx = 0;
+	int ret;
+
+	g_mutex_lock(&rec->lock);
+	while (true) {
+		struct record_block *blk = &rec->blocks[idx];
+
+		while (!blk->full && !rec->refill_done)
+			g_cond_wait(&rec->cond, &rec->lock);
+		if (!blk->full)
+			break;
+		g_mutex_unlock(&rec->lock);
+
+		ret = record_write_all(rec->fd, blk->data, blk->used);
+
+		g_mutex_lock(&rec->lock);
+		if (ret < 0) {
+			record_fail(rec, ret);
+			break;
+		}
+
+		rec->stats.bytes_written += blk->used;
+		blk->used = 0;
+		blk->full = false;
+		idx = (idx + 1) % RECORD_BLOCKS;
+		g_cond_signal(&rec->cond);
+	}
+	g_mutex_unlock(&rec->lock);
+
+	return NULL;
+}
+
+/* Hand the block being filled to the writer and move on to the next one */
+static void record_handoff(struct recorder *rec)
+{
+	g_mutex_lock(&rec->lock);
+	rec->blocks[rec->fill].full = true;
+	g_cond_signal(&rec->cond);
+	g_mutex_unlock(&rec->lock);
+	rec->fill = (rec->fill + 1) % RECORD_BLOCKS;
+}
+
+static void record_push(struct recorder *rec, const void *src, size_t len)
+{
+	struct record_block *blk = &rec->blocks[rec->fill];
+	bool full;
+
+	if (len > rec->block_size) {
+		rec->stats.buffers_dropped++;
+		return;
+	}
+
+	/* Whatever the size of the refills, a block is handed over as soon as
+	 * the next one would not fit */
+	if (blk->used + len > rec->block_size) {
+		record_handoff(rec);
+		blk = &rec->blocks[rec->fill];
+	}
+
+	g_mutex_lock(&rec->lock);
+	full = blk->full;
+	g_mutex_unlock(&rec->lock);
+
+	if (full) {
+		/* The writer can't keep up */
+		rec->stats.buffers_dropped++;
+		return;
+	}
+
+	memcpy(blk->data + blk->used, src, len);
+	blk->used += len;
+	rec->stats.buffers_recorded++;
+
+	if (blk->used == rec->block_size)
+		record_handoff(rec);
+}
+
+static gpointer record_refill_thread(gpointer data)
+{
+	struct recorder *rec = data;
+
+	while (!g_atomic_int_get(&rec->stop)) {
+		ssize_t ret = iio_buffer_refill(rec->buf);
+		char *start;
+
+		if (ret < 0) {
+			g_mutex_lock(&rec->lock);
+			record_fail(rec, (int) ret);
+			g_mutex_unlock(&rec->lock);
+			break;
+		}
+
+		start = iio_buffer_start(rec->buf);
+		record_push(rec, start, (char *) iio_buffer_end(rec->buf) - start);
+	}
+
+	return NULL;
+}
+
+static void recorder_free(struct recorder *rec)
+{
+	unsigned int i;
+
+	for (i = 0; i < RECORD_BLOCKS; i++)
+		record_free(rec->blocks[i].data);
+	if (rec->buf)
+		iio_buffer_destroy(rec->buf);
+	if (rec->fd >= 0)
+		close(rec->fd);
+	g_mutex_clear(&rec->lock);
+	g_cond_clear(&rec->cond);
+	g_free(rec);
+}
+
+/*
+ * Start recording the enabled channels of @dev to @filename, as raw
+ * interleaved samples in the device's own format. The device must not be
+ * used by anything else until recorder_stop() is called. If the recording
+ * stops on an error, @on_error is called from the main loop with @data.
+ */
+struct recorder * recorder_start(struct iio_device *dev,
+		const char *filename, GSourceFunc on_error, gpointer data,
+		int *error)
+{
+	struct recorder *rec;
+	unsigned int i;
+	size_t refill_samples;
+	ssize_t sample_size;
+
+	sample_size = iio_device_get_sample_size(dev);
+	if (sample_size <= 0) {
+		*error = sample_size ? (int) sample_size : -EINVAL;
+		return NULL;
+	}
+
+	rec = g_new0(struct recorder, 1);
+	g_mutex_init(&rec->lock);
+	g_cond_init(&rec->cond);
+	rec->dev = dev;
+	rec->stats.sample_size = sample_size;
+	rec->on_error = on_error;
+	rec->on_error_data = data;
+
+	/* Refills and blocks stay multiples of the page size */
+	refill_samples = RECORD_REFILL_SIZE / sample_size;
+	refill_samples -= refill_samples % RECORD_ALIGN;
+	if (!refill_samples)
+		refill_samples = RECORD_ALIGN;
+	rec->block_size = refill_samples * sample_size * RECORD_REFILLS_PER_BLOCK;
+
+	rec->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+	if (rec->fd < 0) {
+		*error = -errno;
+		goto err_free;
+	}
+
+	for (i = 0; i < RECORD_BLOCKS; i++) {
+		rec->blocks[i].data = record_alloc(rec->block_size);
+		if (!rec->blocks[i].data) {
+			*error = -ENOMEM;
+			goto err_free;
+		}
+	}
+
+	rec->buf = iio_device_create_buffer(dev, refill_samples, false);
+	if (!rec->buf) {
+		*error = -errno;
+		goto err_free;
+	}
+
+	rec->writer_thread = g_thread_new("record-writer",
+			record_writer_thread, rec);
+	rec->refill_thread = g_thread_new("record-refill",
+			record_refill_thread, rec);
+
+	printf("Recording %s to %s: %zd bytes per sample, %zu samples per refill\n",
+			iio_device_get_name(dev), filename,
+			sample_size, refill_samples);
+
+	return rec;
+
+err_free:
+	recorder_free(rec);
+	return NULL;
+}
+
+int recorder_get_error(struct recorder *rec)
+{
+	int error;
+
+	g_mutex_lock(&rec->lock);
+	error = rec->stats.error;
+	g_mutex_unlock(&rec->lock);
+
+	return error;
+}
+
+void recorder_stop(struct recorder *rec, struct record_stats *stats)
+{
+	struct record_block *blk;
+
+	g_atomic_int_set(&rec->stop, TRUE);
+	g_thread_join(rec->refill_thread);
+
+	/* Hand over the partially filled block and let the writer drain */
+	g_mutex_lock(&rec->lock);
+	blk = &rec->blocks[rec->fill];
+	if (blk->used && !blk->full)
+		blk->full = true;
+	rec->refill_done = true;
+	g_cond_signal(&rec->cond);
+	g_mutex_unlock(&rec->lock);
+	g_thread_join(rec->writer_thread);
+
+	if (stats)
+		*stats = rec->stats;
+
+	recorder_free(rec);
+}
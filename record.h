@@ -0,0 +1,29 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __RECORD_H__
+#define __RECORD_H__
+
+#include <glib.h>
+#include <iio.h>
+
+struct recorder;
+
+struct record_stats {
+	guint64 bytes_written;
+	guint64 buffers_recorded;
+	guint64 buffers_dropped;
+	unsigned int sample_size;
+	int error;
+};
+
+struct recorder * recorder_start(struct iio_device *dev,
+		const char *filename, GSourceFunc on_error, gpointer data,
+		int *error);
+int recorder_get_error(struct recorder *rec);
+void recorder_stop(struct recorder *rec, struct record_stats *stats);
+
+#endif /* __RECORD_H__ */
@@ -0,0 +1,207 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef __MINGW32__
+#include <sys/mman.h>
+#endif
+
+#include "segbuf.h"
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/*
+ * Small buffers are a single heap allocation, as before. Larger ones are
+ * made of separately mapped segments, so that they don't need one huge
+ * range of address space, and pages that are never written cost nothing.
+ * Past SEGBUF_FILE_THRESHOLD the segments are mapped from an unlinked
+ * file in the temporary directory ($TMPDIR), which lets a capture be
+ * larger than the RAM and leaves it to the kernel to page it out.
+ */
+enum segbuf_backing {
+	SEGBUF_HEAP,
+	SEGBUF_ANON,
+	SEGBUF_FILE,
+};
+
+struct segbuf {
+	size_t length;
+	size_t elem_size;
+	size_t seg_length;
+	size_t seg_bytes;
+	unsigned int nb_segs;
+	void **segs;
+	enum segbuf_backing backing;
+	int fd;
+};
+
+#ifndef __MINGW32__
+static void * segbuf_map(struct segbuf *sb, unsigned int seg)
+{
+	void *ptr;
+
+	if (sb->backing == SEGBUF_FILE)
+		ptr = mmap(NULL, sb->seg_bytes, PROT_READ | PROT_WRITE,
+				MAP_SHARED, sb->fd, (off_t) seg * sb->seg_bytes);
+	else
+		ptr = mmap(NULL, sb->seg_bytes, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+				-1, 0);
+
+	return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+static int segbuf_open_file(struct segbuf *sb)
+{
+	GError *err = NULL;
+	gchar *path;
+
+	sb->fd = g_file_open_tmp("osc-capture-XXXXXX", &path, &err);
+	if (sb->fd < 0) {
+		fprintf(stderr, "Unable to create capture file: %s\n",
+				err->message);
+		g_error_free(err);
+		return -EIO;
+	}
+
+	/* Only the descriptor is needed, the space is freed on close */
+	g_unlink(path);
+	g_free(path);
+
+	if (ftruncate(sb->fd, (off_t) sb->nb_segs * sb->seg_bytes) < 0) {
+		int ret = -errno;
+
+		fprintf(stderr, "Unable to size capture file: %s\n",
+				strerror(errno));
+		return ret;
+	}
+
+	return 0;
+}
+#endif
+
+struct segbuf * segbuf_new(size_t length, size_t elem_size, bool contiguous)
+{
+	struct segbuf *sb;
+	size_t total = length * elem_size;
+	unsigned int i;
+
+	sb = g_new0(struct segbuf, 1);
+	sb->length = length;
+	sb->elem_size = elem_size;
+	sb->fd = -1;
+
+#ifdef __MINGW32__
+	sb->backing = SEGBUF_HEAP;
+#else
+	if (total <= SEGBUF_SEGMENT_SIZE)
+		sb->backing = SEGBUF_HEAP;
+	else if (total <= SEGBUF_FILE_THRESHOLD)
+		sb->backing = SEGBUF_ANON;
+	else
+		sb->backing = SEGBUF_FILE;
+#endif
+
+	if (contiguous || sb->backing == SEGBUF_HEAP) {
+		sb->seg_length = length ?: 1;
+	} else {
+		/* Keep segment offsets aligned on pages for mmap() */
+		sb->seg_length = SEGBUF_SEGMENT_SIZE / elem_size;
+	}
+	sb->seg_bytes = sb->seg_length * elem_size;
+	sb->nb_segs = (length + sb->seg_length - 1) / sb->seg_length ?: 1;
+	sb->segs = g_new0(void *, sb->nb_segs);
+
+#ifndef __MINGW32__
+	if (sb->backing == SEGBUF_FILE) {
+		long page_size = sysconf(_SC_PAGESIZE);
+
+		sb->seg_bytes = (sb->seg_bytes + page_size - 1) & ~(page_size - 1);
+		if (segbuf_open_file(sb) < 0)
+			goto err_free;
+	}
+#endif
+
+	for (i = 0; i < sb->nb_segs; i++) {
+#ifndef __MINGW32__
+		if (sb->backing != SEGBUF_HEAP)
+			sb->segs[i] = segbuf_map(sb, i);
+		else
+#endif
+			sb->segs[i] = g_try_malloc0(sb->seg_bytes);
+
+		if (!sb->segs[i]) {
+			fprintf(stderr, "Unable to allocate %zu bytes of capture memory\n",
+					total);
+			goto err_free;
+		}
+	}
+
+	return sb;
+
+err_free:
+	segbuf_free(sb);
+	return NULL;
+}
+
+void segbuf_free(struct segbuf *sb)
+{
+	unsigned int i;
+
+	if (!sb)
+		return;
+
+	for (i = 0; i < sb->nb_segs; i++) {
+		if (!sb->segs[i])
+			continue;
+#ifndef __MINGW32__
+		if (sb->backing != SEGBUF_HEAP)
+			munmap(sb->segs[i], sb->seg_bytes);
+		else
+#endif
+			g_free(sb->segs[i]);
+	}
+
+	if (sb->fd >= 0)
+		close(sb->fd);
+	g_free(sb->segs);
+	g_free(sb);
+}
+
+size_t segbuf_length(const struct segbuf *sb)
+{
+	return sb->length;
+}
+
+size_t segbuf_segment_length(const struct segbuf *sb)
+{
+	return sb->seg_length;
+}
+
+void * segbuf_chunk(const struct segbuf *sb, size_t index, size_t *avail)
+{
+	size_t seg = index / sb->seg_length;
+	size_t pos = index % sb->seg_length;
+
+	if (avail) {
+		size_t left = sb->length - index;
+
+		*avail = MIN(sb->seg_length - pos, left);
+	}
+
+	return (char *) sb->segs[seg] + pos * sb->elem_size;
+}
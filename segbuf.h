@@ -0,0 +1,34 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __SEGBUF_H__
+#define __SEGBUF_H__
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Bytes per segment; buffers that fit in one segment live on the heap */
+#define SEGBUF_SEGMENT_SIZE (16 << 20)
+
+/* Above this total size, segments are backed by a temporary file */
+#define SEGBUF_FILE_THRESHOLD (256 << 20)
+
+struct segbuf;
+
+/* A zero-filled array of @length elements of @elem_size bytes, split in
+ * segments unless @contiguous is set. Returns NULL on failure. */
+struct segbuf * segbuf_new(size_t length, size_t elem_size, bool contiguous);
+void segbuf_free(struct segbuf *sb);
+
+size_t segbuf_length(const struct segbuf *sb);
+size_t segbuf_segment_length(const struct segbuf *sb);
+
+/* Address of element @index; if @avail is not NULL, it is set to the number
+ * of elements that can be accessed contiguously from there. */
+void * segbuf_chunk(const struct segbuf *sb, size_t index, size_t *avail);
+
+#endif /* __SEGBUF_H__ */
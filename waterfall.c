@@ -0,0 +1,323 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <glib.h>
+#include <glib-object.h>
+#include <gtk/gtk.h>
+#include <gtkdatabox.h>
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "image_graph.h"
+#include "waterfall.h"
+
+#define WATERFALL_COLORS 256
+
+#define WATERFALL_TYPE (waterfall_get_type())
+#define WATERFALL(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), WATERFALL_TYPE, Waterfall))
+
+typedef struct _Waterfall {
+	GtkDataboxGraph parent;
+	/* depth rows of width RGB pixels */
+	guchar *rows;
+	unsigned int width;
+	unsigned int depth;
+	/* Row of the newest spectrum, the older ones follow it */
+	unsigned int head;
+	/* Rows pushed since the history was cleared, up to depth */
+	unsigned int count;
+	/* Rows pushed since the history was cleared */
+	unsigned int pushes;
+	gfloat x_first;
+	gfloat x_last;
+	/* Image of the visible part of the history, sized for the databox */
+	struct image_frame frame;
+	/* What the image was rendered for: it is only scrolled for the rows
+	 * pushed since, unless something else changed */
+	bool frame_valid;
+	gint frame_x0;
+	gint frame_y0;
+	gint frame_w;
+	gint frame_h;
+	gfloat frame_left;
+	gfloat frame_right;
+	gfloat frame_top;
+	gfloat frame_bottom;
+	unsigned int frame_pushes;
+} Waterfall;
+
+typedef struct _WaterfallClass {
+	GtkDataboxGraphClass parent_class;
+} WaterfallClass;
+
+GType waterfall_get_type(void);
+
+G_DEFINE_TYPE(Waterfall, waterfall, GTK_DATABOX_TYPE_GRAPH)
+
+/* From the lowest level to the highest: black, blue, cyan, yellow, red */
+static guchar colormap[WATERFALL_COLORS][3];
+
+static void colormap_init(void)
+{
+	static const guchar stops[][3] = {
+		{ 0, 0, 0 },
+		{ 0, 0, 255 },
+		{ 0, 255, 255 },
+		{ 255, 255, 0 },
+		{ 255, 0, 0 },
+	};
+
+	image_graph_colormap(colormap[0], WATERFALL_COLORS, 3,
+			stops, G_N_ELEMENTS(stops));
+}
+
+/* Pixels the first @n spectra pushed take, @ppr being the height of one */
+static double waterfall_rows_height(double n, double ppr)
+{
+	return floor(n * ppr);
+}
+
+/*
+ * Spectrum shown on a pixel row of the image, the newest one starting on
+ * pixel row @offset, @ppr pixels high. The spectra are laid out from the
+ * first one pushed, each taking the pixels its row height adds, so that
+ * after new rows are pushed the image is the previous one moved down by
+ * waterfall_rows_height() of them, and only the new rows are rendered.
+ */
+struct waterfall_layout {
+	Waterfall *wf;
+	double ppr;
+	double top;
+	gint offset;
+	/* Age of the spectrum shown on the last pixel row rendered */
+	gint age;
+};
+
+static const guchar * waterfall_row(gint py, gpointer data)
+{
+	struct waterfall_layout *l = data;
+	Waterfall *wf = l->wf;
+	gint y = py - l->offset;
+
+	while (l->age > 0 && l->top - waterfall_rows_height(
+				(double) wf->pushes - l->age, l->ppr) > y)
+		l->age--;
+	while (l->age < (gint) wf->count - 1 && l->top - waterfall_rows_height(
+				(double) wf->pushes - l->age - 1, l->ppr) <= y)
+		l->age++;
+
+	return wf->rows + (size_t) ((wf->head + l->age) % wf->depth) *
+		wf->width * 3;
+}
+
+static void waterfall_render(Waterfall *wf, gint from, gint to, gint w,
+		double ppr, gint offset)
+{
+	struct waterfall_layout l;
+
+	l.wf = wf;
+	l.ppr = ppr;
+	l.top = waterfall_rows_height(wf->pushes, ppr);
+	l.offset = offset;
+	l.age = 0;
+	image_frame_render(&wf->frame, from, to, w, waterfall_row, &l);
+}
+
+static void waterfall_draw(GtkDataboxGraph *graph, GtkDatabox *box)
+{
+	Waterfall *wf = WATERFALL(graph);
+	GdkPixmap *pixmap = gtk_databox_get_backing_pixmap(box);
+	GtkAllocation alloc;
+	gfloat left, right, top, bottom, dx;
+	gint x0, x1, y0, y1, w, h, offset, shift;
+	double ppr;
+	guchar *pixels;
+	int rowstride, ret;
+
+	if (!wf->count || !pixmap)
+		return;
+
+	gtk_widget_get_allocation(GTK_WIDGET(box), &alloc);
+	gtk_databox_get_visible_limits(box, &left, &right, &top, &bottom);
+	if (alloc.height <= 0 || top == bottom)
+		return;
+
+	/* Each bin reaches half way to its neighbours */
+	dx = wf->width > 1 ? (wf->x_last - wf->x_first) / (wf->width - 1) : 1.0f;
+	x0 = MAX(gtk_databox_value_to_pixel_x(box, wf->x_first - dx / 2), 0);
+	x1 = MIN(gtk_databox_value_to_pixel_x(box, wf->x_last + dx / 2),
+			alloc.width);
+	y0 = MAX(gtk_databox_value_to_pixel_y(box, 0.0f), 0);
+	y1 = MIN(gtk_databox_value_to_pixel_y(box, -(gfloat) wf->count),
+			alloc.height);
+	w = x1 - x0;
+	h = y1 - y0;
+	if (w <= 0 || h <= 0 || dx <= 0.0f)
+		return;
+
+	ret = image_frame_reserve(&wf->frame, alloc.width, alloc.height);
+	if (ret)
+		wf->frame_valid = false;
+	if (ret < 0)
+		return;
+
+	/* Pixels per spectrum, and pixel row of the image where the newest
+	 * spectrum starts */
+	ppr = alloc.height / (double) (top - bottom);
+	offset = (gint) floor(top * ppr + 0.5) - y0;
+
+	/* The rows are only resampled here, never color-mapped again */
+	if (!wf->frame_valid || ppr <= 0.0 || wf->frame_x0 != x0 || wf->frame_y0 != y0 ||
+			wf->frame_w != w || wf->frame_h != h ||
+			wf->frame_left != left || wf->frame_right != right ||
+			wf->frame_top != top || wf->frame_bottom != bottom) {
+		image_frame_map_columns(&wf->frame, box, x0, w,
+				wf->x_first - dx / 2, 1.0f / dx, wf->width);
+		waterfall_render(wf, 0, h, w, ppr, offset);
+		wf->frame_valid = true;
+		wf->frame_x0 = x0;
+		wf->frame_y0 = y0;
+		wf->frame_w = w;
+		wf->frame_h = h;
+		wf->frame_left = left;
+		wf->frame_right = right;
+		wf->frame_top = top;
+		wf->frame_bottom = bottom;
+	} else if (wf->pushes != wf->frame_pushes) {
+		/* The rows already rendered move down, the new ones are
+		 * rendered at the top */
+		shift = (gint) (waterfall_rows_height(wf->pushes, ppr) -
+				waterfall_rows_height(wf->frame_pushes, ppr));
+		shift = MIN(shift, h);
+		pixels = gdk_pixbuf_get_pixels(wf->frame.pixbuf);
+		rowstride = gdk_pixbuf_get_rowstride(wf->frame.pixbuf);
+		if (shift < h)
+			memmove(pixels + shift * rowstride, pixels,
+					(size_t) (h - shift) * rowstride);
+		waterfall_render(wf, 0, shift, w, ppr, offset);
+	}
+	wf->frame_pushes = wf->pushes;
+
+	gdk_draw_pixbuf(pixmap, NULL, wf->frame.pixbuf, 0, 0, x0, y0, w, h,
+			GDK_RGB_DITHER_NONE, 0, 0);
+}
+
+static gint waterfall_calculate_extrema(GtkDataboxGraph *graph,
+		gfloat *min_x, gfloat *max_x, gfloat *min_y, gfloat *max_y)
+{
+	Waterfall *wf = WATERFALL(graph);
+
+	if (!wf->rows)
+		return -1;
+
+	*min_x = wf->x_first;
+	*max_x = wf->x_last;
+	*min_y = -(gfloat) wf->depth;
+	*max_y = 0.0f;
+
+	return 0;
+}
+
+static void waterfall_finalize(GObject *obj)
+{
+	Waterfall *wf = WATERFALL(obj);
+
+	g_free(wf->rows);
+	image_frame_free(&wf->frame);
+
+	G_OBJECT_CLASS(waterfall_parent_class)->finalize(obj);
+}
+
+static void waterfall_class_init(WaterfallClass *klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+	GtkDataboxGraphClass *graph_class = GTK_DATABOX_GRAPH_CLASS(klass);
+
+	gobject_class->finalize = waterfall_finalize;
+	graph_class->draw = waterfall_draw;
+	graph_class->calculate_extrema = waterfall_calculate_extrema;
+
+	colormap_init();
+}
+
+static void waterfall_init(Waterfall *wf)
+{
+	wf->frame.bpp = 3;
+}
+
+GtkDataboxGraph * waterfall_new(void)
+{
+	return g_object_new(WATERFALL_TYPE, NULL);
+}
+
+void waterfall_set_size(GtkDataboxGraph *graph, unsigned int width,
+		unsigned int depth)
+{
+	Waterfall *wf = WATERFALL(graph);
+
+	if (width)
+		depth = CLAMP(depth, 1, WATERFALL_MAX_BYTES / (3 * width));
+	if (width == wf->width && depth == wf->depth)
+		return;
+
+	g_free(wf->rows);
+	wf->rows = width && depth ? g_malloc((size_t) width * depth * 3) : NULL;
+	wf->width = width;
+	wf->depth = depth;
+	wf->head = 0;
+	wf->count = 0;
+	wf->pushes = 0;
+	wf->frame_valid = false;
+}
+
+unsigned int waterfall_get_depth(GtkDataboxGraph *graph)
+{
+	return WATERFALL(graph)->depth;
+}
+
+void waterfall_set_x_range(GtkDataboxGraph *graph, gfloat first, gfloat last)
+{
+	Waterfall *wf = WATERFALL(graph);
+
+	wf->x_first = first;
+	wf->x_last = last;
+	wf->frame_valid = false;
+}
+
+void waterfall_push(GtkDataboxGraph *graph, const gfloat *row)
+{
+	Waterfall *wf = WATERFALL(graph);
+	gfloat scale = (WATERFALL_COLORS - 1) /
+		(WATERFALL_LEVEL_MAX - WATERFALL_LEVEL_MIN);
+	guchar *dst;
+	unsigned int i;
+
+	if (!wf->rows)
+		return;
+
+	/* The newest row goes right before the previous one, so that the
+	 * rows from the newest to the oldest follow each other */
+	wf->head = (wf->head + wf->depth - 1) % wf->depth;
+	wf->count = MIN(wf->count + 1, wf->depth);
+	wf->pushes++;
+
+	dst = wf->rows + (size_t) wf->head * wf->width * 3;
+	for (i = 0; i < wf->width; i++) {
+		gfloat level = (row[i] - WATERFALL_LEVEL_MIN) * scale;
+		unsigned int index;
+
+		/* Also catches the NaN of empty bins */
+		if (!(level > 0.0f))
+			index = 0;
+		else if (level >= WATERFALL_COLORS - 1)
+			index = WATERFALL_COLORS - 1;
+		else
+			index = (unsigned int) level;
+
+		memcpy(dst + 3 * i, colormap[index], 3);
+	}
+}
@@ -0,0 +1,45 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __WATERFALL_H__
+#define __WATERFALL_H__
+
+#include <gtkdatabox_graph.h>
+
+#define WATERFALL_DEPTH_DEFAULT 256
+
+/* Memory the history of a waterfall may take, whatever its depth */
+#define WATERFALL_MAX_BYTES (32 * 1024 * 1024)
+
+/* Range of the color map, in dBFS */
+#define WATERFALL_LEVEL_MIN -130.0f
+#define WATERFALL_LEVEL_MAX 0.0f
+
+/*
+ * Databox graph showing the last spectra pushed to it, one row per
+ * spectrum: the newest one at y = 0, the older ones down to y = -depth.
+ * The rows are color-mapped when pushed and kept in a circular buffer, so
+ * a new spectrum costs one row and older ones are never mapped again.
+ * The image drawn is kept too and only scrolled for the new rows, unless
+ * the size of the databox or its visible limits changed.
+ * Released with g_object_unref().
+ */
+GtkDataboxGraph * waterfall_new(void);
+
+/* Number of bins of the rows and depth of the history; the history is
+ * cleared if they change. The depth is reduced to fit WATERFALL_MAX_BYTES,
+ * waterfall_get_depth() returns the one that was used. */
+void waterfall_set_size(GtkDataboxGraph *graph, unsigned int width,
+		unsigned int depth);
+unsigned int waterfall_get_depth(GtkDataboxGraph *graph);
+
+/* Values of the x axis of the first and the last bins */
+void waterfall_set_x_range(GtkDataboxGraph *graph, gfloat first, gfloat last);
+
+/* Add a row of width values, in dBFS */
+void waterfall_push(GtkDataboxGraph *graph, const gfloat *row);
+
+#endif /* __WATERFALL_H__ */
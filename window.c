@@ -0,0 +1,219 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#include <glib.h>
+#include <fftw3.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "window.h"
+
+/*
+ * Tables nobody uses anymore are kept for a while, so that rebuilding a
+ * plan or restarting a capture with the same settings does not compute
+ * them again. Only the WINDOW_CACHE_UNUSED most recently used are kept.
+ */
+#define WINDOW_CACHE_UNUSED 4
+
+static const char * const window_names[WINDOW_TYPES_COUNT] = {
+	[WINDOW_HANNING] = "Hanning",
+	[WINDOW_BLACKMAN_HARRIS] = "Blackman-Harris",
+	[WINDOW_FLAT_TOP] = "Flat Top",
+	[WINDOW_KAISER] = "Kaiser",
+};
+
+/* Most recently used first */
+static GList *window_cache;
+static GMutex window_lock;
+
+/* Sum of a[k] * cos(2 pi k j / (n - 1)), with alternating signs */
+static double win_cosine_sum(const double *a, unsigned int terms,
+		unsigned int j, unsigned int n)
+{
+	double x = 2.0 * M_PI * j / (n - 1), w = 0.0;
+	unsigned int k;
+
+	for (k = 0; k < terms; k++)
+		w += (k & 1 ? -a[k] : a[k]) * cos(k * x);
+
+	return w;
+}
+
+/* Modified Bessel function of the first kind, order 0 */
+static double bessel_i0(double x)
+{
+	double term = 1.0, sum = 1.0, y = x * x / 4.0;
+	unsigned int k;
+
+	for (k = 1; term > sum * 1e-12; k++) {
+		term *= y / ((double) k * k);
+		sum += term;
+	}
+
+	return sum;
+}
+
+static double win_kaiser(double beta, unsigned int j, unsigned int n)
+{
+	double r = 2.0 * j / (n - 1) - 1.0;
+
+	return bessel_i0(beta * sqrt(1.0 - r * r)) / bessel_i0(beta);
+}
+
+static double win_coef(enum window_type type, double beta,
+		unsigned int j, unsigned int n)
+{
+	static const double hanning[] = { 0.5, 0.5 };
+	static const double blackman_harris[] = {
+		0.35875, 0.48829, 0.14128, 0.01168,
+	};
+	/* Nearly flat over a bin: tone amplitudes barely depend on where
+	 * the tone falls between two bins */
+	static const double flat_top[] = {
+		0.21557895, 0.41663158, 0.277263158, 0.083578947, 0.006947368,
+	};
+
+	if (n < 2)
+		return 1.0;
+
+	switch (type) {
+	case WINDOW_BLACKMAN_HARRIS:
+		return win_cosine_sum(blackman_harris,
+				G_N_ELEMENTS(blackman_harris), j, n);
+	case WINDOW_FLAT_TOP:
+		return win_cosine_sum(flat_top, G_N_ELEMENTS(flat_top), j, n);
+	case WINDOW_KAISER:
+		return win_kaiser(beta, j, n);
+	case WINDOW_HANNING:
+	default:
+		return win_cosine_sum(hanning, G_N_ELEMENTS(hanning), j, n);
+	}
+}
+
+static void window_free(struct window *win)
+{
+	fftw_free(win->coefs);
+	fftwf_free(win->coefs_f);
+	g_free(win);
+}
+
+static struct window * window_new(enum window_type type, double beta,
+		unsigned int size)
+{
+	struct window *win;
+	double sum = 0.0, sum_sq = 0.0;
+	unsigned int i;
+
+	win = g_new0(struct window, 1);
+	win->type = type;
+	win->beta = beta;
+	win->size = size;
+	win->coefs = fftw_malloc(sizeof(double) * size);
+	win->coefs_f = fftwf_malloc(sizeof(float) * size);
+	if (!win->coefs || !win->coefs_f) {
+		window_free(win);
+		return NULL;
+	}
+
+	for (i = 0; i < size; i++) {
+		double w = win_coef(type, beta, i, size);
+
+		win->coefs[i] = w;
+		win->coefs_f[i] = w;
+		sum += w;
+		sum_sq += w * w;
+	}
+
+	win->coherent_gain = sum / size;
+	win->enbw = size * sum_sq / (sum * sum);
+
+	return win;
+}
+
+/* Drop the unused tables past the WINDOW_CACHE_UNUSED most recent ones */
+static void window_cache_trim(void)
+{
+	unsigned int unused = 0;
+	GList *node = window_cache, *next;
+
+	for (; node; node = next) {
+		struct window *win = node->data;
+
+		next = node->next;
+		if (win->refcount || ++unused <= WINDOW_CACHE_UNUSED)
+			continue;
+
+		window_cache = g_list_delete_link(window_cache, node);
+		window_free(win);
+	}
+}
+
+struct window * window_get(enum window_type type, double beta,
+		unsigned int size)
+{
+	struct window *win = NULL;
+	GList *node;
+
+	if (type >= WINDOW_TYPES_COUNT)
+		type = WINDOW_HANNING;
+	if (type != WINDOW_KAISER)
+		beta = 0.0;
+
+	g_mutex_lock(&window_lock);
+
+	for (node = window_cache; node; node = node->next) {
+		struct window *tmp = node->data;
+
+		if (tmp->type == type && tmp->beta == beta && tmp->size == size) {
+			win = tmp;
+			window_cache = g_list_remove_link(window_cache, node);
+			g_list_free(node);
+			break;
+		}
+	}
+
+	if (!win)
+		win = window_new(type, beta, size);
+	if (win) {
+		win->refcount++;
+		window_cache = g_list_prepend(window_cache, win);
+	}
+
+	g_mutex_unlock(&window_lock);
+
+	return win;
+}
+
+void window_put(struct window *win)
+{
+	if (!win)
+		return;
+
+	g_mutex_lock(&window_lock);
+	if (!--win->refcount)
+		window_cache_trim();
+	g_mutex_unlock(&window_lock);
+}
+
+const char * window_get_name(enum window_type type)
+{
+	if (type >= WINDOW_TYPES_COUNT)
+		return NULL;
+
+	return window_names[type];
+}
+
+int window_find_by_name(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < WINDOW_TYPES_COUNT; i++)
+		if (!strcmp(name, window_names[i]))
+			return i;
+
+	return -EINVAL;
+}
@@ -0,0 +1,51 @@
+/**
+ * Copyright (C) 2012-2013 Analog Devices, Inc.
+ *
+ * Licensed under the GPL-2.
+ *
+ **/
+#ifndef __WINDOW_H__
+#define __WINDOW_H__
+
+enum window_type {
+	WINDOW_HANNING,
+	WINDOW_BLACKMAN_HARRIS,
+	WINDOW_FLAT_TOP,
+	WINDOW_KAISER,
+	WINDOW_TYPES_COUNT,
+};
+
+/* Side lobes around -90 dB, like the 4-term Blackman-Harris */
+#define WINDOW_KAISER_BETA_DEFAULT 12.0
+
+/*
+ * Table of the @size coefficients of a window, in double and single
+ * precision, allocated with fftw_malloc() and fftwf_malloc(). The tables
+ * are shared by all the transforms that use the same window and size, and
+ * must not be modified.
+ */
+struct window {
+	enum window_type type;
+	double beta;
+	unsigned int size;
+	double *coefs;
+	float *coefs_f;
+	/* Mean of the coefficients: the gain of the window on a tone */
+	double coherent_gain;
+	/* Equivalent noise bandwidth, in bins: the gain on noise is
+	 * coherent_gain^2 * enbw */
+	double enbw;
+	unsigned int refcount;
+};
+
+/* Get a reference on the table of a window; @beta is only used by the
+ * Kaiser window. Returns NULL if it could not be allocated. */
+struct window * window_get(enum window_type type, double beta,
+		unsigned int size);
+void window_put(struct window *win);
+
+const char * window_get_name(enum window_type type);
+/* Returns the type, or -EINVAL if @name is not a window */
+int window_find_by_name(const char *name);
+
+#endif /* __WINDOW_H__ */